@@ -1,7 +1,10 @@
 #define NOMINMAX
 #include <WS2tcpip.h>
 
+#include <cstddef>
 #include <limits>
+#include <iterator>
+#include <algorithm>
 #include <string>
 #include <system_error>
 #include <utility>
@@ -9,7 +12,6 @@
 #include "SocketError.hpp"
 #include "AddressInfoError.hpp"
 
-using std::move;
 using std::numeric_limits;
 using std::string;
 using std::error_condition;
@@ -47,52 +49,63 @@ namespace netsocket
 
 netsocket::BaseException::Tag const netsocket::addressExceptionTag { "GetAddressInfo API error" };
 
+namespace
+{
+    using netsocket::Error;
+    using netsocket::AddressInfoError;
+
+    struct AddressInfoMapping
+    {
+	Error error;
+	AddressInfoError addressInfoError;
+    };
+
+    // WinSock2 errors reported by getaddrinfo(), with the EAI_ code they stand for, sorted by error
+    constexpr AddressInfoMapping addressInfoMappings[] =
+    {
+	{ Error::NotEnoughMemory,	AddressInfoError::Memory },
+	{ Error::EInval,		AddressInfoError::BadFlags },
+	{ Error::ESockTNoSupprot,	AddressInfoError::SockType },
+	{ Error::EAFNoSupport,		AddressInfoError::Family },
+	{ Error::TypeNotFound,		AddressInfoError::Service },
+	{ Error::HostNotFound,		AddressInfoError::NoName },
+	{ Error::TryAgain,		AddressInfoError::Again },
+	{ Error::NoRecovery,		AddressInfoError::Fail }
+    };
+
+    constexpr bool sortedMappings() noexcept
+    {
+	for (std::size_t position = 1U; position < std::size(addressInfoMappings); position++)
+	    if (+addressInfoMappings[position - 1U].error >= +addressInfoMappings[position].error)
+		return false;
+
+	return true;
+    }
+
+    static_assert(sortedMappings(), "Address info error mappings must be sorted by error value");
+}
+
+// The EAI_ codes are WinSock2 errors, so this is the text gai_strerror() would format each time
 string netsocket::AddressInfoErrorCategory::message(int ev) const
 {
-    return move(string(gai_strerrorA(ev)));
+    return string(errorMessage(ev));
 }
 
 error_condition netsocket::WinSock2AddressInfoErrorCategory::default_error_condition(int ev) const noexcept
 {
-    if (ev)
-    {
-	AddressInfoError gai_error = AddressInfoError::Ok;
+    if (!ev)
+	return make_error_condition(AddressInfoError::Ok);
 
-	switch (ev)
-	{
-	case +Error::TryAgain:
-	    gai_error = AddressInfoError::Again;
-	    break;
-	case +Error::EInval:
-	    gai_error = AddressInfoError::BadFlags;
-	    break;
-	case +Error::NoRecovery:
-	    gai_error = AddressInfoError::Fail;
-	    break;
-	case +Error::EAFNoSupport:
-	    gai_error = AddressInfoError::Family;
-	    break;
-	case +Error::NotEnoughMemory:
-	    gai_error = AddressInfoError::Memory;
-	    break;
-	case +Error::HostNotFound:
-	    gai_error = AddressInfoError::NoName;
-	    break;
-	case +Error::TypeNotFound:
-	    gai_error = AddressInfoError::Service;
-	    break;
-	case +Error::ESockTNoSupprot:
-	    gai_error = AddressInfoError::SockType;
-	    break;
-	}
+    AddressInfoMapping const *mapping = std::lower_bound
+	(
+	    std::begin(addressInfoMappings), std::end(addressInfoMappings), ev,
+	    [](AddressInfoMapping const &entry, int value) { return +entry.error < value; }
+	);
 
-	if (+gai_error)
-	    return move(make_error_condition(gai_error));
-
-	return move(this->ErrorCategory::default_error_condition(ev));
-    }
+    if (mapping != std::end(addressInfoMappings) && +mapping->error == ev)
+	return make_error_condition(mapping->addressInfoError);
 
-    return move(make_error_condition(AddressInfoError::Ok));
+    return this->ErrorCategory::default_error_condition(ev);
 }
 
 error_category const &netsocket::generic_address_info_category()
@@ -34,6 +34,7 @@ namespace netsocket
 
     class AddressException: public BaseExceptionType<addressExceptionTag>, public std::system_error
     {
+    public:
 	AddressException(int wsaError);
 	AddressException(int wsaError, std::string const& errorMessage);
 	AddressException(int wsaError, char const* errorMessage);
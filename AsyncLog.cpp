@@ -0,0 +1,416 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "AsyncLog.hpp"
+
+using std::size_t;
+using std::uint_least8_t;
+using std::uint_least16_t;
+using std::uint_least32_t;
+using std::uint_least64_t;
+using std::int_least64_t;
+using std::atomic;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::unique_ptr;
+
+namespace
+{
+    // Records start on 8-byte boundaries, and never wrap around the end of the ring. The header is
+    // followed by one kind byte for each argument, padded to 8 bytes, one 8-byte value for each
+    // argument, and the string bytes. A string value holds the offset in the record and the length.
+    struct RecordHeader
+    {
+	uint_least32_t length;			// of the whole record
+	uint_least8_t level;
+	uint_least8_t argumentCount;
+	uint_least16_t padding;			// 1 for the filler up to the end of the ring
+	int_least64_t ticks;
+	char const *format;
+    };
+
+    constexpr size_t align8(size_t length) noexcept
+    {
+	return (length + 7U) & ~static_cast<size_t>(7U);
+    }
+
+    int_least64_t ticks() noexcept
+    {
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart;
+    }
+
+    char const *levelName(uint_least8_t level) noexcept
+    {
+	static char const *const names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+	return level < sizeof names / sizeof names[0] ? names[level] : "?";
+    }
+}
+
+class netsocket::AsyncLog::Ring
+{
+public:
+    unique_ptr<unsigned char[]> data;
+    size_t mask;
+    DWORD threadId;
+    uint_least64_t reportedDropped = 0U;	// writer thread
+    bool retired = false;			// writer thread, closed and drained
+
+    alignas(64) atomic<uint_least64_t> writePosition { 0U };
+    atomic<uint_least64_t> dropped { 0U };
+    atomic<bool> closed { false };
+    alignas(64) atomic<uint_least64_t> readPosition { 0U };
+
+    Ring(size_t capacity)
+	: data(new unsigned char[capacity]), mask(capacity - 1U), threadId(::GetCurrentThreadId())
+    {
+    }
+};
+
+netsocket::AsyncLog::AsyncLog(Sink &sink, Settings const &settings)
+    : sink(sink), settings(settings), originTicks(ticks())
+{
+    LARGE_INTEGER frequency;
+    ::QueryPerformanceFrequency(&frequency);
+    ticksPerSecond = frequency.QuadPart;
+
+    size_t capacity = 256U;
+
+    while (capacity < this->settings.ringCapacity)
+	capacity *= 2U;
+
+    this->settings.ringCapacity = capacity;
+    writerThread = std::thread([this]() { runWriter(); });
+}
+
+netsocket::AsyncLog::~AsyncLog()
+{
+    {
+	lock_guard<mutex> lock(ringMutex);
+	stopping = true;
+    }
+
+    wakeCondition.notify_one();
+    writerThread.join();
+}
+
+netsocket::AsyncLog::Statistics netsocket::AsyncLog::statistics() const noexcept
+{
+    Statistics result { written.load(), retiredDropped.load() };
+    lock_guard<mutex> lock(ringMutex);
+
+    for (auto const &ring: rings)
+	result.dropped += ring->dropped.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+// Lost wake-ups are possible, and only delay the writer until its next poll
+void netsocket::AsyncLog::wakeWriter() noexcept
+{
+    if (!wakeRequested.load(std::memory_order_relaxed) && !wakeRequested.exchange(true))
+	wakeCondition.notify_one();
+}
+
+void netsocket::AsyncLog::runWriter()
+{
+    unique_lock<mutex> lock(ringMutex);
+
+    for (;;)
+    {
+	bool finalPass = stopping;
+
+	activeRings.clear();
+
+	for (auto const &ring: rings)
+	    activeRings.push_back(ring.get());
+
+	lock.unlock();
+
+	for (Ring *ring: activeRings)
+	    drain(*ring);
+
+	if (!text.empty())
+	{
+	    sink.write(text.data(), text.size());
+	    sink.flush();
+	    text.clear();
+	}
+
+	lock.lock();
+
+	auto retired = std::remove_if(rings.begin(), rings.end(), [this](unique_ptr<Ring> const &ring)
+	{
+	    if (ring->retired)
+		retiredDropped += ring->dropped.load();
+
+	    return ring->retired;
+	});
+
+	rings.erase(retired, rings.end());
+
+	if (finalPass)
+	    break;
+
+	wakeCondition.wait_for(lock, std::chrono::milliseconds(settings.flushIntervalMs), [this]() { return stopping || wakeRequested.load(); });
+	wakeRequested = false;
+    }
+}
+
+// A ring found closed before the read is complete after it, and can be retired
+void netsocket::AsyncLog::drain(Ring &ring)
+{
+    bool closed = ring.closed.load(std::memory_order_acquire);
+    uint_least64_t position = ring.readPosition.load(std::memory_order_relaxed);
+    uint_least64_t end = ring.writePosition.load(std::memory_order_acquire);
+    size_t capacity = ring.mask + 1U;
+
+    while (position < end)
+    {
+	size_t offset = static_cast<size_t>(position & ring.mask);
+
+	if (capacity - offset < sizeof(RecordHeader))
+	{
+	    position += capacity - offset;
+	    continue;
+	}
+
+	unsigned char const *record = ring.data.get() + offset;
+	RecordHeader header;
+
+	std::memcpy(&header, record, sizeof header);
+
+	if (!header.padding)
+	{
+	    format(ring, record);
+	    written.fetch_add(1U, std::memory_order_relaxed);
+	}
+
+	position += header.length;
+    }
+
+    ring.readPosition.store(position, std::memory_order_release);
+
+    uint_least64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+
+    if (dropped != ring.reportedDropped)
+    {
+	char line[128];
+	int length = std::snprintf(line, sizeof line, "%12s %-5s %5lu %llu log records dropped\n", "", levelName(static_cast<uint_least8_t>(Level::Warning)),
+		static_cast<unsigned long>(ring.threadId), static_cast<unsigned long long>(dropped - ring.reportedDropped));
+
+	text.append(line, static_cast<size_t>(std::max(length, 0)));
+	ring.reportedDropped = dropped;
+    }
+
+    ring.retired = closed;
+}
+
+void netsocket::AsyncLog::format(Ring const &ring, unsigned char const *record)
+{
+    RecordHeader header;
+
+    std::memcpy(&header, record, sizeof header);
+
+    unsigned char const *kinds = record + sizeof header;
+    unsigned char const *values = kinds + align8(header.argumentCount);
+    double seconds = static_cast<double>(header.ticks - originTicks) / static_cast<double>(ticksPerSecond);
+    char buffer[64];
+    int length = std::snprintf(buffer, sizeof buffer, "%12.6f %-5s %5lu ", seconds, levelName(header.level), static_cast<unsigned long>(ring.threadId));
+
+    text.append(buffer, static_cast<size_t>(std::max(length, 0)));
+
+    unsigned index = 0U;
+
+    for (char const *format = header.format; *format; format++)
+    {
+	if (format[0] != '{' || format[1] != '}' || index >= header.argumentCount)
+	{
+	    text.push_back(*format);
+	    continue;
+	}
+
+	uint_least64_t value;
+
+	std::memcpy(&value, values + index * 8U, sizeof value);
+	length = 0;
+
+	switch (static_cast<Kind>(kinds[index]))
+	{
+	case Kind::Signed:
+	    length = std::snprintf(buffer, sizeof buffer, "%lld", static_cast<long long>(static_cast<int_least64_t>(value)));
+	    break;
+
+	case Kind::Unsigned:
+	    length = std::snprintf(buffer, sizeof buffer, "%llu", static_cast<unsigned long long>(value));
+	    break;
+
+	case Kind::Floating:
+	{
+	    double floatingValue;
+
+	    std::memcpy(&floatingValue, &value, sizeof floatingValue);
+	    length = std::snprintf(buffer, sizeof buffer, "%g", floatingValue);
+	    break;
+	}
+
+	case Kind::Boolean:
+	    text.append(value ? "true" : "false");
+	    break;
+
+	case Kind::Pointer:
+	    length = std::snprintf(buffer, sizeof buffer, "%p", reinterpret_cast<void const *>(static_cast<std::uintptr_t>(value)));
+	    break;
+
+	case Kind::String:
+	    text.append(static_cast<char const *>(static_cast<void const *>(record + (value & 0xFFFFFFFFU))), static_cast<size_t>(value >> 32U));
+	    break;
+	}
+
+	text.append(buffer, static_cast<size_t>(std::max(length, 0)));
+	format++;
+	index++;
+    }
+
+    text.push_back('\n');
+}
+
+netsocket::AsyncLog::Producer::Producer(AsyncLog &asyncLog)
+    : asyncLog(asyncLog)
+{
+    unique_ptr<Ring> newRing(new Ring(asyncLog.settings.ringCapacity));
+    lock_guard<mutex> lock(asyncLog.ringMutex);
+
+    asyncLog.rings.push_back(std::move(newRing));
+    ring = asyncLog.rings.back().get();
+}
+
+// The writer frees the ring once it has read the records left
+netsocket::AsyncLog::Producer::~Producer()
+{
+    ring->closed.store(true, std::memory_order_release);
+}
+
+bool netsocket::AsyncLog::Producer::write(Level level, char const *format, Argument const *arguments, size_t count) noexcept
+{
+    size_t valuesOffset = sizeof(RecordHeader) + align8(count), size = valuesOffset + count * 8U;
+
+    for (size_t index = 0U; index < count; index++)
+	if (arguments[index].kind == Kind::String)
+	    size += arguments[index].length;
+
+    size = align8(size);
+
+    size_t capacity = ring->mask + 1U;
+    uint_least64_t position = ring->writePosition.load(std::memory_order_relaxed);
+    uint_least64_t readPosition = ring->readPosition.load(std::memory_order_acquire);
+    size_t offset = static_cast<size_t>(position & ring->mask), filler = 0U;
+
+    if (size > capacity - offset)
+	filler = capacity - offset;
+
+    if (size > capacity / 2U || position + filler + size - readPosition > capacity)
+    {
+	ring->dropped.fetch_add(1U, std::memory_order_relaxed);
+	return false;
+    }
+
+    if (filler)
+    {
+	if (filler >= sizeof(RecordHeader))
+	{
+	    RecordHeader fillerHeader { static_cast<uint_least32_t>(filler), 0U, 0U, 1U, 0, nullptr };
+
+	    std::memcpy(ring->data.get() + offset, &fillerHeader, sizeof fillerHeader);
+	}
+
+	position += filler;
+	offset = 0U;
+    }
+
+    unsigned char *record = ring->data.get() + offset;
+    RecordHeader header { static_cast<uint_least32_t>(size), static_cast<uint_least8_t>(level), static_cast<uint_least8_t>(count), 0U, ticks(), format };
+    size_t stringOffset = valuesOffset + count * 8U;
+
+    std::memcpy(record, &header, sizeof header);
+
+    for (size_t index = 0U; index < count; index++)
+    {
+	Argument const &argument = arguments[index];
+	uint_least64_t value = argument.unsignedValue;
+
+	record[sizeof header + index] = static_cast<unsigned char>(argument.kind);
+
+	if (argument.kind == Kind::Floating)
+	    std::memcpy(&value, &argument.floatingValue, sizeof value);
+	else if (argument.kind == Kind::Pointer)
+	    value = static_cast<uint_least64_t>(reinterpret_cast<std::uintptr_t>(argument.pointerValue));
+	else if (argument.kind == Kind::String)
+	{
+	    std::memcpy(record + stringOffset, argument.text, argument.length);
+	    value = static_cast<uint_least64_t>(stringOffset) | static_cast<uint_least64_t>(argument.length) << 32U;
+	    stringOffset += argument.length;
+	}
+
+	std::memcpy(record + valuesOffset + index * 8U, &value, sizeof value);
+    }
+
+    ring->writePosition.store(position + size, std::memory_order_release);
+
+    if (position + size - readPosition > capacity / 2U)
+	asyncLog.wakeWriter();
+
+    return true;
+}
+
+netsocket::AsyncLog::FileSink::FileSink(char const *path)
+    : hFile(::CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)), owned(true)
+{
+    if (hFile == INVALID_HANDLE_VALUE)
+	raiseError(static_cast<int>(::GetLastError()));
+}
+
+netsocket::AsyncLog::FileSink::FileSink(HANDLE hFile) noexcept
+    : hFile(hFile), owned(false)
+{
+}
+
+netsocket::AsyncLog::FileSink::~FileSink()
+{
+    if (owned)
+	::CloseHandle(hFile);
+}
+
+// Output that fails to write is lost
+void netsocket::AsyncLog::FileSink::write(char const *text, size_t length) noexcept
+{
+    while (length)
+    {
+	DWORD dwWritten = 0U;
+	DWORD dwLength = static_cast<DWORD>(std::min(length, static_cast<size_t>(0x40000000U)));
+
+	if (!::WriteFile(hFile, text, dwLength, &dwWritten, nullptr) || !dwWritten)
+	    return;
+
+	text += dwWritten;
+	length -= dwWritten;
+    }
+}
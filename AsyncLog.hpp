@@ -0,0 +1,270 @@
+#if !defined(WINSOCK2_CXX_ASYNC_LOG)
+#define WINSOCK2_CXX_ASYNC_LOG
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <type_traits>
+
+#include "SocketError.hpp"
+
+namespace netsocket
+{
+    // Logging for event loop threads, that never blocks the caller. Each logging thread owns a
+    // Producer, with its own single-producer ring of binary records: the format string pointer,
+    // the time and the raw arguments, with only strings copied. A background writer thread
+    // formats the records and hands the text to the Sink, in batches.
+    //
+    // When a ring is full, the record is dropped and counted, and the writer reports the count in
+    // the log. A producer only wakes the writer when its ring gets half full, otherwise the writer
+    // polls the rings every flush interval.
+    class AsyncLog
+    {
+    public:
+	class Sink;
+	class FileSink;
+	class Producer;
+
+	enum class Level: std::uint_least8_t
+	{
+	    Debug,
+	    Info,
+	    Warning,
+	    Error
+	};
+
+	struct Settings
+	{
+	    std::size_t ringCapacity = 65536U;		// bytes for each producer, rounded up to a power of 2
+	    std::uint_least32_t flushIntervalMs = 10U;
+	    Level minLevel = Level::Debug;
+	};
+
+	struct Statistics
+	{
+	    std::uint_least64_t written, dropped;
+	};
+
+	Statistics statistics() const noexcept;
+
+	AsyncLog(Sink &sink);
+	AsyncLog(Sink &sink, Settings const &settings);
+	~AsyncLog();				// writes out the records left, after all producers are gone
+	AsyncLog(AsyncLog const &other) = delete;
+	AsyncLog &operator =(AsyncLog const &other) = delete;
+
+    protected:
+	class Ring;
+
+	enum class Kind: std::uint_least8_t
+	{
+	    Signed,
+	    Unsigned,
+	    Floating,
+	    Boolean,
+	    Pointer,
+	    String
+	};
+
+	// Argument as passed to the producer ring. Strings are copied into the record.
+	struct Argument
+	{
+	    Kind kind;
+
+	    union
+	    {
+		std::int_least64_t	 signedValue;
+		std::uint_least64_t	 unsignedValue;
+		double			 floatingValue;
+		void const		*pointerValue;
+	    };
+
+	    char const *text;
+	    std::size_t length;
+	};
+
+	Sink &sink;
+	Settings settings;
+	std::int_least64_t originTicks, ticksPerSecond;
+	mutable std::mutex ringMutex;
+	std::condition_variable wakeCondition;
+	std::vector<std::unique_ptr<Ring>> rings;		// guarded by ringMutex
+	std::vector<Ring *> activeRings;			// writer thread copy
+	std::atomic<bool> wakeRequested { false };
+	bool stopping = false;
+	std::atomic<std::uint_least64_t> written { 0U }, retiredDropped { 0U };
+	std::string text;					// writer thread buffer
+	std::thread writerThread;
+
+	template <typename Value>
+	    static Argument argument(Value const &value) noexcept;
+	static Argument argument(char const *value) noexcept;
+	static Argument argument(std::string const &value) noexcept;
+	static Argument argument(std::string_view value) noexcept;
+	static Argument argument(bool value) noexcept;
+
+	void wakeWriter() noexcept;
+	void runWriter();
+	void drain(Ring &ring);
+	void format(Ring const &ring, unsigned char const *record);
+
+	friend class Producer;
+    };
+
+    // Text output for the writer thread. Errors can not be reported back to the logging threads,
+    // so a sink that fails should count or drop the output.
+    class AsyncLog::Sink
+    {
+    public:
+	virtual void write(char const *text, std::size_t length) noexcept = 0;
+	virtual void flush() noexcept;
+
+	virtual ~Sink();
+    };
+
+    class AsyncLog::FileSink: public Sink
+    {
+    public:
+	virtual void write(char const *text, std::size_t length) noexcept override;
+
+	FileSink(char const *path);			// appends, creating the file if needed
+	FileSink(HANDLE hFile) noexcept;		// not owned, like GetStdHandle(STD_ERROR_HANDLE)
+	~FileSink();
+	FileSink(FileSink const &other) = delete;
+	FileSink &operator =(FileSink const &other) = delete;
+
+    protected:
+	HANDLE hFile;
+	bool owned;
+    };
+
+    class AsyncLog::Producer
+    {
+    public:
+	// Each {} in the format is replaced by the next argument: integers, floating point, bool,
+	// pointers and strings. The format is not copied, and must be a string literal, or live as
+	// long as the log. Returns false when the record was dropped.
+	template <typename... Args>
+	    bool log(Level level, char const *format, Args const &... args) noexcept;
+
+	Producer(AsyncLog &asyncLog);
+	~Producer();
+	Producer(Producer const &other) = delete;
+	Producer &operator =(Producer const &other) = delete;
+
+    protected:
+	AsyncLog &asyncLog;
+	Ring *ring;
+
+	bool write(Level level, char const *format, Argument const *arguments, std::size_t count) noexcept;
+    };
+}
+
+template <typename Value>
+    inline netsocket::AsyncLog::Argument netsocket::AsyncLog::argument(Value const &value) noexcept
+{
+    Argument result;
+
+    result.text = nullptr;
+    result.length = 0U;
+
+    if constexpr (std::is_integral_v<Value> && std::is_signed_v<Value>)
+    {
+	result.kind = Kind::Signed;
+	result.signedValue = static_cast<std::int_least64_t>(value);
+    }
+    else if constexpr (std::is_integral_v<Value> || std::is_enum_v<Value>)
+    {
+	result.kind = Kind::Unsigned;
+	result.unsignedValue = static_cast<std::uint_least64_t>(value);
+    }
+    else if constexpr (std::is_floating_point_v<Value>)
+    {
+	result.kind = Kind::Floating;
+	result.floatingValue = static_cast<double>(value);
+    }
+    else if constexpr (std::is_same_v<Value, char *>)
+	return argument(std::string_view(value ? value : "(null)"));
+    else
+    {
+	static_assert(std::is_pointer_v<Value>, "AsyncLog arguments are numbers, bool, pointers or strings");
+
+	result.kind = Kind::Pointer;
+	result.pointerValue = static_cast<void const *>(value);
+    }
+
+    return result;
+}
+
+inline netsocket::AsyncLog::Argument netsocket::AsyncLog::argument(char const *value) noexcept
+{
+    return argument(std::string_view(value ? value : "(null)"));
+}
+
+inline netsocket::AsyncLog::Argument netsocket::AsyncLog::argument(std::string const &value) noexcept
+{
+    return argument(std::string_view(value));
+}
+
+inline netsocket::AsyncLog::Argument netsocket::AsyncLog::argument(std::string_view value) noexcept
+{
+    Argument result;
+
+    result.kind = Kind::String;
+    result.unsignedValue = 0U;
+    result.text = value.data();
+    result.length = value.size();
+
+    return result;
+}
+
+inline netsocket::AsyncLog::Argument netsocket::AsyncLog::argument(bool value) noexcept
+{
+    Argument result;
+
+    result.kind = Kind::Boolean;
+    result.unsignedValue = value ? 1U : 0U;
+    result.text = nullptr;
+    result.length = 0U;
+
+    return result;
+}
+
+inline netsocket::AsyncLog::AsyncLog(Sink &sink)
+    : AsyncLog(sink, Settings())
+{
+}
+
+inline netsocket::AsyncLog::Sink::~Sink()
+{
+}
+
+inline void netsocket::AsyncLog::Sink::flush() noexcept
+{
+}
+
+template <typename... Args>
+    inline bool netsocket::AsyncLog::Producer::log(Level level, char const *format, Args const &... args) noexcept
+{
+    static_assert(sizeof...(Args) < 256U, "Too many AsyncLog arguments");
+
+    if (level < asyncLog.settings.minLevel)
+	return true;
+
+    Argument const arguments[sizeof...(Args) ? sizeof...(Args) : 1U] = { argument(args)... };
+
+    return write(level, format, arguments, sizeof...(Args));
+}
+
+#endif // !defined(WINSOCK2_CXX_ASYNC_LOG)
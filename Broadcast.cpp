@@ -0,0 +1,240 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "Broadcast.hpp"
+
+using std::size_t;
+using std::uint_least64_t;
+using std::vector;
+using std::min;
+
+netsocket::Broadcast::Payload netsocket::Broadcast::payload(void const *data, size_t length, uint_least64_t key)
+{
+    Block *block = new (::operator new(sizeof(Block) + length)) Block { 1U, length, key };
+
+    if (length)
+	std::memcpy(block->data(), data, length);
+
+    return Payload(block);
+}
+
+netsocket::Broadcast::~Broadcast()
+{
+    for (Subscriber *subscriber: subscribers)
+    {
+	subscriber->clear();
+	subscriber->broadcast = nullptr;
+    }
+}
+
+void netsocket::Broadcast::publish(Payload const &payload)
+{
+    Block *block = payload.block;
+
+    if (!block || !block->length)
+	return;
+
+    for (Subscriber *subscriber: subscribers)
+	if (!subscriber->enqueue(block))
+	    dropCount++;
+
+    counters.published++;
+    eventLoop.requestIterationEnd(*this);
+}
+
+void netsocket::Broadcast::subscribe(Subscriber &subscriber)
+{
+    if (subscriber.broadcast)
+	subscriber.broadcast->unsubscribe(subscriber);
+
+    subscriber.ring.resize(settings.maxQueued ? settings.maxQueued : 1U);
+    subscribers.push_back(&subscriber);
+    subscriber.broadcast = this;
+    subscriber.position = subscribers.size() - 1U;
+    subscriber.blocked = subscriber.dropPending = false;
+}
+
+void netsocket::Broadcast::unsubscribe(Subscriber &subscriber) noexcept
+{
+    if (subscriber.broadcast != this)
+	return;
+
+    Subscriber *last = subscribers.back();
+
+    subscribers[subscriber.position] = last;
+    last->position = subscriber.position;
+    subscribers.pop_back();
+
+    if (subscriber.dropPending)
+	dropCount--;
+
+    subscriber.clear();
+    subscriber.broadcast = nullptr;
+}
+
+// Subscribers waiting for the socket to be writable are left for their own flush() call. A send
+// error drops the subscriber, like a full queue.
+void netsocket::Broadcast::flush()
+{
+    for (Subscriber *subscriber: subscribers)
+	if (subscriber->count && !subscriber->blocked && !subscriber->dropPending)
+	    try
+	    {
+		subscriber->flush();
+	    }
+	    catch (Exception const &)
+	    {
+		subscriber->dropPending = true;
+		dropCount++;
+	    }
+
+    if (dropCount)
+	dropSubscribers();
+}
+
+// All subscribers are removed before the first callback, so the callbacks can change the
+// subscriber list
+void netsocket::Broadcast::dropSubscribers()
+{
+    vector<Subscriber *> dropped;
+
+    dropped.reserve(dropCount);
+
+    for (Subscriber *subscriber: subscribers)
+	if (subscriber->dropPending)
+	    dropped.push_back(subscriber);
+
+    for (Subscriber *subscriber: dropped)
+	unsubscribe(*subscriber);
+
+    counters.dropped += dropped.size();
+
+    for (Subscriber *subscriber: dropped)
+	subscriber->onDropped(*this);
+}
+
+void netsocket::Broadcast::onIterationEnd(EventLoop &)
+{
+    flush();
+}
+
+bool netsocket::Broadcast::Subscriber::flush()
+{
+    while (count)
+    {
+	WSABUF buffers[maxBuffers];
+	DWORD bufferCount = static_cast<DWORD>(min(count, static_cast<size_t>(maxBuffers)));
+
+	for (DWORD index = 0U; index < bufferCount; index++)
+	{
+	    Block *block = ring[(head + index) % ring.size()];
+	    size_t offset = index ? 0U : headOffset;
+
+	    buffers[index].buf = static_cast<char *>(static_cast<void *>(block->data() + offset));
+	    buffers[index].len = static_cast<ULONG>(block->length - offset);
+	}
+
+	DWORD dwSent = socket.send(buffers, bufferCount);
+
+	if (!dwSent)
+	{
+	    blocked = true;
+	    return false;
+	}
+
+	consume(dwSent);
+    }
+
+    blocked = false;
+
+    return true;
+}
+
+// A message that was not started yet is replaced by a newer one with the same key, within the
+// same byte limit. Returns false when the subscriber has to be dropped.
+bool netsocket::Broadcast::Subscriber::enqueue(Block *block) noexcept
+{
+    if (dropPending)
+	return true;
+
+    Settings const &settings = broadcast->settings;
+
+    if (settings.policy == Policy::Conflate && block->key)
+	for (size_t index = headOffset ? 1U : 0U; index < count; index++)
+	{
+	    Block *&queued = ring[(head + index) % ring.size()];
+
+	    if (queued->key == block->key)
+	    {
+		if (bytes - queued->length + block->length > settings.maxQueuedBytes)
+		{
+		    dropPending = true;
+		    return false;
+		}
+
+		bytes += block->length - queued->length;
+		block->references++;
+		release(queued);
+		queued = block;
+		broadcast->counters.conflated++;
+
+		return true;
+	    }
+	}
+
+    if (count == ring.size() || bytes + block->length > settings.maxQueuedBytes)
+    {
+	dropPending = true;
+	return false;
+    }
+
+    block->references++;
+    ring[(head + count) % ring.size()] = block;
+    count++;
+    bytes += block->length;
+
+    return true;
+}
+
+void netsocket::Broadcast::Subscriber::consume(size_t length) noexcept
+{
+    bytes -= length;
+
+    while (length)
+    {
+	Block *block = ring[head];
+	size_t available = block->length - headOffset;
+
+	if (length < available)
+	{
+	    headOffset += length;
+	    return;
+	}
+
+	length -= available;
+	release(block);
+	head = (head + 1U) % ring.size();
+	count--;
+	headOffset = 0U;
+    }
+}
+
+void netsocket::Broadcast::Subscriber::clear() noexcept
+{
+    for (; count; count--)
+    {
+	release(ring[head]);
+	head = (head + 1U) % ring.size();
+    }
+
+    head = headOffset = bytes = 0U;
+    blocked = dropPending = false;
+}
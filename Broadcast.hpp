@@ -0,0 +1,287 @@
+#if !defined(WINSOCK2_CXX_BROADCAST)
+#define WINSOCK2_CXX_BROADCAST
+
+#include <WinSock2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+
+namespace netsocket
+{
+    // Fan-out of the same messages to many connections on one event loop. Each message is a single
+    // reference-counted immutable Payload, and every subscriber queues a pointer to it, with an
+    // offset into the message at the head of its queue, instead of a copy. Queues are sent with
+    // gathered WSASend() calls at the end of the loop iteration in which messages were published.
+    //
+    // A subscriber that can not keep up is dropped when its queue is full, or with the Conflate
+    // policy, a new message replaces a queued message with the same key that was not started yet.
+    // Payload reference counts are not atomic: the broadcast, its subscribers and its payloads
+    // belong to the loop thread.
+    class Broadcast: public EventLoop::IterationEndHandler
+    {
+    public:
+	class Payload;
+	class Subscriber;
+
+	static constexpr DWORD maxBuffers = 64U;		// per WSASend() call
+
+	enum class Policy
+	{
+	    Drop,
+	    Conflate
+	};
+
+	struct Settings
+	{
+	    std::size_t maxQueued = 64U;			// messages per subscriber
+	    std::size_t maxQueuedBytes = 1048576U;
+	    Policy policy = Policy::Drop;
+	};
+
+	struct Statistics
+	{
+	    std::size_t subscribers;
+	    std::uint_least64_t published, conflated, dropped;
+	};
+
+	// Key 0 is never conflated
+	static Payload payload(void const *data, std::size_t length, std::uint_least64_t key = 0U);
+
+	void publish(Payload const &payload);		// empty payloads are ignored
+	void subscribe(Subscriber &subscriber);
+	void unsubscribe(Subscriber &subscriber) noexcept;
+	void flush();
+
+	Statistics statistics() const noexcept;
+
+	Broadcast(EventLoop &eventLoop);
+	Broadcast(EventLoop &eventLoop, Settings const &settings);
+	~Broadcast();
+	Broadcast(Broadcast const &other) = delete;
+	Broadcast &operator =(Broadcast const &other) = delete;
+
+    protected:
+	struct Block
+	{
+	    std::size_t references;
+	    std::size_t length;
+	    std::uint_least64_t key;
+
+	    unsigned char *data() noexcept;			// the message follows the header
+	};
+
+	EventLoop &eventLoop;
+	Settings settings;
+	std::vector<Subscriber *> subscribers;
+	std::size_t dropCount = 0U;				// subscribers waiting to be dropped
+	Statistics counters { };
+
+	static void release(Block *block) noexcept;
+
+	void dropSubscribers();
+
+	virtual void onIterationEnd(EventLoop &eventLoop) override;
+
+	friend class Payload;
+	friend class Subscriber;
+    };
+
+    class Broadcast::Payload
+    {
+    protected:
+	Block *block = nullptr;
+
+	explicit Payload(Block *block) noexcept;
+
+	friend class Broadcast;
+
+    public:
+	unsigned char const *data() const noexcept;
+	std::size_t size() const noexcept;
+	std::uint_least64_t key() const noexcept;
+	explicit operator bool() const noexcept;
+
+	Payload() noexcept = default;
+	Payload(Payload const &other) noexcept;
+	Payload(Payload &&other) noexcept;
+	Payload &operator =(Payload const &other) noexcept;
+	Payload &operator =(Payload &&other) noexcept;
+	~Payload();
+    };
+
+    // Connection side of the broadcast. Call flush() when the socket is writable again after a
+    // send would block, for example on FD_WRITE.
+    class Broadcast::Subscriber
+    {
+    public:
+	bool flush();					// true when the whole queue was sent
+	std::size_t queuedBytes() const noexcept;
+	std::size_t queuedCount() const noexcept;
+	bool waiting() const noexcept;			// for the socket to be writable
+	bool subscribed() const noexcept;
+
+	Subscriber(Socket &socket);
+	virtual ~Subscriber();
+	Subscriber(Subscriber const &other) = delete;
+	Subscriber &operator =(Subscriber const &other) = delete;
+
+    protected:
+	Socket &socket;
+	Broadcast *broadcast = nullptr;
+	std::size_t position = 0U;			// in the broadcast subscribers
+	std::vector<Block *> ring;
+	std::size_t head = 0U, count = 0U, headOffset = 0U, bytes = 0U;
+	bool blocked = false, dropPending = false;
+
+	// Called at the end of the iteration, after the subscriber was removed from the broadcast,
+	// when its queue was full or a send failed
+	virtual void onDropped(Broadcast &broadcast) = 0;
+
+	bool enqueue(Block *block) noexcept;
+	void consume(std::size_t length) noexcept;
+	void clear() noexcept;
+
+	friend class Broadcast;
+    };
+}
+
+inline unsigned char *netsocket::Broadcast::Block::data() noexcept
+{
+    return reinterpret_cast<unsigned char *>(this + 1);
+}
+
+inline void netsocket::Broadcast::release(Block *block) noexcept
+{
+    if (!--block->references)
+    {
+	block->~Block();
+	::operator delete(block);
+    }
+}
+
+inline netsocket::Broadcast::Statistics netsocket::Broadcast::statistics() const noexcept
+{
+    Statistics result = counters;
+
+    result.subscribers = subscribers.size();
+
+    return result;
+}
+
+inline netsocket::Broadcast::Broadcast(EventLoop &eventLoop)
+    : Broadcast(eventLoop, Settings())
+{
+}
+
+inline netsocket::Broadcast::Broadcast(EventLoop &eventLoop, Settings const &settings)
+    : eventLoop(eventLoop), settings(settings)
+{
+}
+
+inline netsocket::Broadcast::Payload::Payload(Block *block) noexcept
+    : block(block)
+{
+}
+
+inline unsigned char const *netsocket::Broadcast::Payload::data() const noexcept
+{
+    return block->data();
+}
+
+inline std::size_t netsocket::Broadcast::Payload::size() const noexcept
+{
+    return block->length;
+}
+
+inline std::uint_least64_t netsocket::Broadcast::Payload::key() const noexcept
+{
+    return block->key;
+}
+
+inline netsocket::Broadcast::Payload::operator bool() const noexcept
+{
+    return block != nullptr;
+}
+
+inline netsocket::Broadcast::Payload::Payload(Payload const &other) noexcept
+    : block(other.block)
+{
+    if (block)
+	block->references++;
+}
+
+inline netsocket::Broadcast::Payload::Payload(Payload &&other) noexcept
+    : block(other.block)
+{
+    other.block = nullptr;
+}
+
+inline netsocket::Broadcast::Payload &netsocket::Broadcast::Payload::operator =(Payload const &other) noexcept
+{
+    if (other.block)
+	other.block->references++;
+
+    if (block)
+	release(block);
+
+    block = other.block;
+
+    return *this;
+}
+
+inline netsocket::Broadcast::Payload &netsocket::Broadcast::Payload::operator =(Payload &&other) noexcept
+{
+    if (this != &other)
+    {
+	if (block)
+	    release(block);
+
+	block = other.block;
+	other.block = nullptr;
+    }
+
+    return *this;
+}
+
+inline netsocket::Broadcast::Payload::~Payload()
+{
+    if (block)
+	release(block);
+}
+
+inline std::size_t netsocket::Broadcast::Subscriber::queuedBytes() const noexcept
+{
+    return bytes;
+}
+
+inline std::size_t netsocket::Broadcast::Subscriber::queuedCount() const noexcept
+{
+    return count;
+}
+
+inline bool netsocket::Broadcast::Subscriber::waiting() const noexcept
+{
+    return blocked;
+}
+
+inline bool netsocket::Broadcast::Subscriber::subscribed() const noexcept
+{
+    return broadcast != nullptr;
+}
+
+inline netsocket::Broadcast::Subscriber::Subscriber(Socket &socket)
+    : socket(socket)
+{
+}
+
+inline netsocket::Broadcast::Subscriber::~Subscriber()
+{
+    if (broadcast)
+	broadcast->unsubscribe(*this);
+}
+
+#endif // !defined(WINSOCK2_CXX_BROADCAST)
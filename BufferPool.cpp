@@ -0,0 +1,197 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <new>
+#include <memory_resource>
+#include <mutex>
+
+#include "BufferPool.hpp"
+
+using std::size_t;
+using std::lock_guard;
+using std::mutex;
+
+// Slabs of 256 KiB, but with at least 16 buffers, for fewer and larger VirtualAlloc() calls
+static size_t slabSize(size_t bufferSize)
+{
+    size_t size = 256U * 1024U;
+
+    return size / bufferSize < 16U ? bufferSize * 16U : size;
+}
+
+// For slabs from a memory resource, page aligned like VirtualAlloc()
+static constexpr size_t slabAlignment = 4096U;
+
+netsocket::BufferPool::BufferPool(size_t maxBytes, std::pmr::memory_resource *slabResource)
+    : maxBytes(maxBytes), slabResource(slabResource)
+{
+}
+
+netsocket::BufferPool::~BufferPool()
+{
+    for (size_t sizeClass = 0U; sizeClass < classCount; sizeClass++)
+	for (void *slab: reserves[sizeClass].slabs)
+	    if (slabResource)
+		slabResource->deallocate(slab, slabSize(classSizes[sizeClass]), slabAlignment);
+	    else
+		::VirtualFree(slab, 0U, MEM_RELEASE);
+}
+
+bool netsocket::BufferPool::addSlab(size_t sizeClass, Reserve &reserve)
+{
+    size_t bufferSize = classSizes[sizeClass], size = slabSize(bufferSize);
+
+    if (maxBytes && totalBytes.load(std::memory_order_relaxed) + size > maxBytes)
+	return false;
+
+    reserve.slabs.reserve(reserve.slabs.size() + 1U);
+
+    unsigned char *slab;
+
+    if (slabResource)
+	try
+	{
+	    slab = static_cast<unsigned char *>(slabResource->allocate(size, slabAlignment));
+	}
+	catch (std::bad_alloc const &)
+	{
+	    return false;
+	}
+    else
+	slab = static_cast<unsigned char *>(::VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+    if (!slab)
+	return false;
+
+    reserve.slabs.push_back(slab);
+
+    for (size_t offset = size; offset; )
+    {
+	offset -= bufferSize;
+
+	FreeBuffer *freeBuffer = new (slab + offset) FreeBuffer { reserve.head };
+	reserve.head = freeBuffer;
+    }
+
+    reserve.count += size / bufferSize;
+    reserve.capacity += size / bufferSize;
+    totalBytes.fetch_add(size, std::memory_order_relaxed);
+
+    return true;
+}
+
+// Detaches up to one batch of free buffers from the reserve, allocating a new slab when empty
+size_t netsocket::BufferPool::takeBatch(size_t sizeClass, FreeBuffer *&head)
+{
+    Reserve &reserve = reserves[sizeClass];
+    lock_guard<mutex> lock(reserve.reserveMutex);
+
+    if (!reserve.head && !addSlab(sizeClass, reserve))
+    {
+	head = nullptr;
+	return 0U;
+    }
+
+    size_t count = 1U, batch = batchSize(sizeClass);
+    FreeBuffer *tail = reserve.head;
+
+    while (count < batch && tail->next)
+    {
+	tail = tail->next;
+	count++;
+    }
+
+    head = reserve.head;
+    reserve.head = tail->next;
+    reserve.count -= count;
+    tail->next = nullptr;
+
+    return count;
+}
+
+void netsocket::BufferPool::returnBatch(size_t sizeClass, FreeBuffer *head, FreeBuffer *tail, size_t count)
+{
+    Reserve &reserve = reserves[sizeClass];
+    lock_guard<mutex> lock(reserve.reserveMutex);
+
+    tail->next = reserve.head;
+    reserve.head = head;
+    reserve.count += count;
+}
+
+// Only when the reserve lock is free, as std::mutex::try_lock() does not throw
+bool netsocket::BufferPool::tryReturnBatch(size_t sizeClass, FreeBuffer *head, FreeBuffer *tail, size_t count) noexcept
+{
+    Reserve &reserve = reserves[sizeClass];
+
+    if (!reserve.reserveMutex.try_lock())
+	return false;
+
+    lock_guard<mutex> lock(reserve.reserveMutex, std::adopt_lock);
+
+    tail->next = reserve.head;
+    reserve.head = head;
+    reserve.count += count;
+
+    return true;
+}
+
+netsocket::BufferPool::Statistics netsocket::BufferPool::statistics(size_t sizeClass)
+{
+    Reserve &reserve = reserves[sizeClass];
+    lock_guard<mutex> lock(reserve.reserveMutex);
+
+    return { classSizes[sizeClass], reserve.capacity, reserve.count, reserve.slabs.size() };
+}
+
+// Keeps up to two batches of free buffers, so a loop that acquires and releases around a batch
+// boundary does not go to the reserve every time. Releasing can not block or throw, so a batch is
+// only returned when the reserve lock is free, and otherwise on a later release.
+void netsocket::BufferPool::Cache::release(size_t sizeClass, void *data) noexcept
+{
+    FreeList &freeList = freeLists[sizeClass];
+
+    freeList.head = new (data) FreeBuffer { freeList.head };
+    freeList.count++;
+    freeList.checkedOut--;
+
+    size_t batch = batchSize(sizeClass);
+
+    if (freeList.count > batch * 2U)
+    {
+	FreeBuffer *head = freeList.head, *tail = head;
+
+	for (size_t count = 1U; count < batch; count++)
+	    tail = tail->next;
+
+	FreeBuffer *next = tail->next;
+
+	if (pool.tryReturnBatch(sizeClass, head, tail, batch))
+	{
+	    freeList.head = next;
+	    freeList.count -= batch;
+	}
+    }
+}
+
+void netsocket::BufferPool::Cache::flush()
+{
+    for (size_t sizeClass = 0U; sizeClass < classCount; sizeClass++)
+    {
+	FreeList &freeList = freeLists[sizeClass];
+
+	if (freeList.head)
+	{
+	    FreeBuffer *tail = freeList.head;
+
+	    while (tail->next)
+		tail = tail->next;
+
+	    pool.returnBatch(sizeClass, freeList.head, tail, freeList.count);
+
+	    freeList.head = nullptr;
+	    freeList.count = 0U;
+	}
+    }
+}
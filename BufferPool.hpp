@@ -0,0 +1,267 @@
+#if !defined(WINSOCK2_CXX_BUFFER_POOL)
+#define WINSOCK2_CXX_BUFFER_POOL
+
+#include <cstddef>
+#include <new>
+#include <memory_resource>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+namespace netsocket
+{
+    // Fixed-size I/O buffers carved out of large slabs, in three size classes. Buffers are meant to
+    // be checked out only while data is actually in flight (received and not yet consumed, or
+    // queued and not yet sent), so idle connections hold no buffer memory at all.
+    //
+    // Each event loop thread takes buffers through its own Cache, without locks. Caches refill from
+    // and spill back to the shared reserve of the pool a batch at a time, under the reserve lock.
+    class BufferPool
+    {
+    public:
+	class Cache;
+	class Buffer;
+
+	static constexpr std::size_t classCount = 3U;
+	static constexpr std::size_t classSizes[classCount] = { 2048U, 16384U, 65536U };
+
+	struct Statistics
+	{
+	    std::size_t bufferSize;
+	    std::size_t capacity;	// buffers in all slabs of the class
+	    std::size_t reserved;	// buffers in the shared reserve, not held by any cache
+	    std::size_t slabs;
+	};
+
+	static std::size_t sizeClass(std::size_t size);	// throws std::length_error above 64 KiB
+
+	Statistics statistics(std::size_t sizeClass);
+	std::size_t allocatedBytes() const noexcept;
+
+	// Slabs are never freed before the pool, so maxBytes limits the memory the pool will ever use.
+	// Slabs come from VirtualAlloc(), or from the slab resource when given, for example an arena
+	// on the NUMA node of the loop threads. The resource is called under the reserve lock, from
+	// any thread that refills a cache, and must be thread safe when the caches are.
+	BufferPool(std::size_t maxBytes = 0U, std::pmr::memory_resource *slabResource = nullptr);
+	~BufferPool();
+	BufferPool(BufferPool const &other) = delete;
+	BufferPool &operator =(BufferPool const &other) = delete;
+
+    protected:
+	struct FreeBuffer
+	{
+	    FreeBuffer *next;
+	};
+
+	struct Reserve
+	{
+	    std::mutex reserveMutex;
+	    FreeBuffer *head = nullptr;
+	    std::size_t count = 0U, capacity = 0U;
+	    std::vector<void *> slabs;
+	};
+
+	Reserve reserves[classCount];
+	std::size_t maxBytes;
+	std::pmr::memory_resource *slabResource;
+	std::atomic<std::size_t> totalBytes { 0U };
+
+	static std::size_t batchSize(std::size_t sizeClass) noexcept;
+
+	std::size_t takeBatch(std::size_t sizeClass, FreeBuffer *&head);
+	void returnBatch(std::size_t sizeClass, FreeBuffer *head, FreeBuffer *tail, std::size_t count);
+	bool tryReturnBatch(std::size_t sizeClass, FreeBuffer *head, FreeBuffer *tail, std::size_t count) noexcept;
+	bool addSlab(std::size_t sizeClass, Reserve &reserve);
+
+	friend class Cache;
+    };
+
+    // Per-thread front end to the pool. A cache, and every buffer it hands out, must only be used
+    // from the one thread that owns it, normally the event loop thread. Every buffer must be
+    // released before its cache is destroyed, as a buffer goes back to the cache it came from.
+    class BufferPool::Cache
+    {
+    public:
+	struct Statistics
+	{
+	    std::size_t cached;		// free buffers held in this cache
+	    std::size_t checkedOut;	// buffers from this cache currently in use
+	};
+
+	Buffer acquire(std::size_t size);	// throws std::bad_alloc when the pool limit is reached
+	Buffer tryAcquire(std::size_t size);	// empty buffer when the pool limit is reached
+
+	Statistics statistics(std::size_t sizeClass) const noexcept;
+	void flush();				// returns all free buffers to the pool reserve
+
+	Cache(BufferPool &pool);
+	~Cache();				// with no buffers checked out
+	Cache(Cache const &other) = delete;
+	Cache &operator =(Cache const &other) = delete;
+
+    protected:
+	struct FreeList
+	{
+	    FreeBuffer *head = nullptr;
+	    std::size_t count = 0U, checkedOut = 0U;
+	};
+
+	BufferPool &pool;
+	FreeList freeLists[classCount];
+
+	void release(std::size_t sizeClass, void *data) noexcept;
+
+	friend class Buffer;
+    };
+
+    // Checked out buffer, that goes back to its cache when released or destroyed
+    class BufferPool::Buffer
+    {
+    protected:
+	Cache *cache = nullptr;
+	void *bufferData = nullptr;
+	std::size_t bufferClass = 0U;
+
+	Buffer(Cache *cache, void *data, std::size_t sizeClass) noexcept;
+
+	friend class Cache;
+
+    public:
+	unsigned char *data() const noexcept;
+	std::size_t size() const noexcept;
+	explicit operator bool() const noexcept;
+	void release() noexcept;
+
+	Buffer() noexcept = default;
+	Buffer(Buffer &&other) noexcept;
+	Buffer &operator =(Buffer &&other) noexcept;
+	Buffer(Buffer const &other) = delete;
+	Buffer &operator =(Buffer const &other) = delete;
+	~Buffer();
+    };
+}
+
+inline std::size_t netsocket::BufferPool::sizeClass(std::size_t size)
+{
+    for (std::size_t cls = 0U; cls < classCount; cls++)
+	if (size <= classSizes[cls])
+	    return cls;
+
+    throw std::length_error("Buffer size exceeds the largest buffer pool class");
+}
+
+inline std::size_t netsocket::BufferPool::allocatedBytes() const noexcept
+{
+    return totalBytes.load(std::memory_order_relaxed);
+}
+
+inline std::size_t netsocket::BufferPool::batchSize(std::size_t sizeClass) noexcept
+{
+    std::size_t count = 65536U / classSizes[sizeClass];
+
+    return count < 4U ? 4U : count;
+}
+
+inline netsocket::BufferPool::Buffer netsocket::BufferPool::Cache::acquire(std::size_t size)
+{
+    Buffer buffer = tryAcquire(size);
+
+    if (!buffer)
+	throw std::bad_alloc();
+
+    return buffer;
+}
+
+inline netsocket::BufferPool::Buffer netsocket::BufferPool::Cache::tryAcquire(std::size_t size)
+{
+    std::size_t cls = sizeClass(size);
+    FreeList &freeList = freeLists[cls];
+
+    if (!freeList.head)
+    {
+	freeList.count = pool.takeBatch(cls, freeList.head);
+
+	if (!freeList.head)
+	    return Buffer();
+    }
+
+    FreeBuffer *freeBuffer = freeList.head;
+
+    freeList.head = freeBuffer->next;
+    freeList.count--;
+    freeList.checkedOut++;
+
+    return Buffer(this, freeBuffer, cls);
+}
+
+inline netsocket::BufferPool::Cache::Statistics netsocket::BufferPool::Cache::statistics(std::size_t sizeClass) const noexcept
+{
+    return { freeLists[sizeClass].count, freeLists[sizeClass].checkedOut };
+}
+
+inline netsocket::BufferPool::Cache::Cache(BufferPool &pool)
+    : pool(pool)
+{
+}
+
+inline netsocket::BufferPool::Cache::~Cache()
+{
+    flush();
+}
+
+inline netsocket::BufferPool::Buffer::Buffer(Cache *cache, void *data, std::size_t sizeClass) noexcept
+    : cache(cache), bufferData(data), bufferClass(sizeClass)
+{
+}
+
+inline unsigned char *netsocket::BufferPool::Buffer::data() const noexcept
+{
+    return static_cast<unsigned char *>(bufferData);
+}
+
+inline std::size_t netsocket::BufferPool::Buffer::size() const noexcept
+{
+    return bufferData ? classSizes[bufferClass] : 0U;
+}
+
+inline netsocket::BufferPool::Buffer::operator bool() const noexcept
+{
+    return bufferData != nullptr;
+}
+
+inline void netsocket::BufferPool::Buffer::release() noexcept
+{
+    if (bufferData)
+    {
+	cache->release(bufferClass, bufferData);
+	bufferData = nullptr;
+    }
+}
+
+inline netsocket::BufferPool::Buffer::Buffer(Buffer &&other) noexcept
+    : cache(other.cache), bufferData(std::exchange(other.bufferData, nullptr)), bufferClass(other.bufferClass)
+{
+}
+
+inline netsocket::BufferPool::Buffer &netsocket::BufferPool::Buffer::operator =(Buffer &&other) noexcept
+{
+    if (this != &other)
+    {
+	release();
+
+	cache = other.cache;
+	bufferData = std::exchange(other.bufferData, nullptr);
+	bufferClass = other.bufferClass;
+    }
+
+    return *this;
+}
+
+inline netsocket::BufferPool::Buffer::~Buffer()
+{
+    release();
+}
+
+#endif // !defined(WINSOCK2_CXX_BUFFER_POOL)
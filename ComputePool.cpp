@@ -0,0 +1,208 @@
+#include <WinSock2.h>
+
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include "SocketLibrary.hpp"
+#include "SocketEventLoop.hpp"
+#include "ComputePool.hpp"
+
+using std::size_t;
+using std::move;
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::thread;
+
+namespace
+{
+    thread_local netsocket::ComputePool const *currentPool = nullptr;
+    thread_local size_t currentWorker = 0U;
+
+    // Threads outside the pool spread their submissions over the worker queues on their own,
+    // without a shared counter
+    thread_local size_t submitCursor = std::hash<thread::id>()(std::this_thread::get_id());
+}
+
+void netsocket::ComputePool::WorkerQueue::pushBack(Task &&task)
+{
+    lock_guard<mutex> lock(queueMutex);
+
+    if (tasks.empty())
+	tasks.resize(64U);
+    else
+	if (tail - head == tasks.size())
+	{
+	    vector<Task> largerTasks(2U * tasks.size());
+
+	    for (size_t index = head; index != tail; index++)
+		largerTasks[index - head] = move(tasks[index & (tasks.size() - 1U)]);
+
+	    tail -= head;
+	    head = 0U;
+	    tasks.swap(largerTasks);
+	}
+
+    tasks[tail++ & (tasks.size() - 1U)] = move(task);
+}
+
+bool netsocket::ComputePool::WorkerQueue::popBack(Task &task)
+{
+    lock_guard<mutex> lock(queueMutex);
+
+    if (head == tail)
+	return false;
+
+    task = move(tasks[--tail & (tasks.size() - 1U)]);
+
+    return true;
+}
+
+bool netsocket::ComputePool::WorkerQueue::popFront(Task &task)
+{
+    lock_guard<mutex> lock(queueMutex);
+
+    if (head == tail)
+	return false;
+
+    task = move(tasks[head++ & (tasks.size() - 1U)]);
+
+    return true;
+}
+
+void netsocket::ComputePool::enqueue(Task &&task)
+{
+    size_t queueIndex = currentPool == this ? currentWorker : submitCursor++ % queueCount;
+
+    pendingTasks.fetch_add(1U);
+    queues[queueIndex].pushBack(move(task));
+
+    if (idleWorkers.load())
+    {
+	lock_guard<mutex> lock(idleMutex);
+	idleCondition.notify_one();
+    }
+}
+
+bool netsocket::ComputePool::dequeue(size_t workerIndex, Task &task)
+{
+    bool found = queues[workerIndex].popBack(task);
+
+    for (size_t offset = 1U; !found && offset < queueCount; offset++)
+	found = queues[(workerIndex + offset) % queueCount].popFront(task);
+
+    if (found)
+	pendingTasks.fetch_sub(1U);
+
+    return found;
+}
+
+void netsocket::ComputePool::runWorker(size_t workerIndex)
+{
+    Task task;
+
+    currentPool = this;
+    currentWorker = workerIndex;
+
+    while (true)
+    {
+	if (dequeue(workerIndex, task))
+	{
+	    try
+	    {
+		task();
+	    }
+	    catch (...)
+	    {
+		// Tasks submitted with completions deliver their exceptions to the loop. Any other
+		// task has no one to report to.
+	    }
+
+	    task = Task();
+	    continue;
+	}
+
+	unique_lock<mutex> lock(idleMutex);
+
+	if (stopping)
+	    break;
+
+	idleWorkers++;
+	idleCondition.wait(lock, [this] { return stopping || pendingTasks.load() > 0U; });
+	idleWorkers--;
+
+	if (stopping)
+	    break;
+    }
+
+    currentPool = nullptr;
+}
+
+netsocket::ComputePool::~ComputePool()
+{
+    {
+	lock_guard<mutex> lock(idleMutex);
+	stopping = true;
+    }
+
+    idleCondition.notify_all();
+
+    for (auto &worker: workers)
+	worker.join();
+}
+
+netsocket::ComputePool::ComputePool(unsigned workerCount)
+    : queues(new WorkerQueue[workerCount ? workerCount : 1U]), queueCount(workerCount ? workerCount : 1U)
+{
+    workers.reserve(queueCount);
+
+    for (size_t workerIndex = 0U; workerIndex < queueCount; workerIndex++)
+	workers.emplace_back(&ComputePool::runWorker, this, workerIndex);
+}
+
+void netsocket::ComputePool::Completions::post(Task &&task)
+{
+    bool wasEmpty;
+
+    {
+	lock_guard<mutex> lock(postedMutex);
+
+	wasEmpty = posted.empty();
+	posted.push_back(move(task));
+    }
+
+    if (wasEmpty)
+	event.set();
+}
+
+bool netsocket::ComputePool::Completions::onEventTrigger(EventLoop &eventLoop)
+{
+    event.reset();
+
+    {
+	lock_guard<mutex> lock(postedMutex);
+	posted.swap(running);
+    }
+
+    for (auto &task: running)
+	try
+	{
+	    task();
+	}
+	catch (...)
+	{
+	    eventLoop.doExceptionEvent();
+	}
+
+    running.clear();
+
+    return true;
+}
@@ -0,0 +1,327 @@
+#if !defined(WINSOCK2_CXX_COMPUTE_POOL)
+#define WINSOCK2_CXX_COMPUTE_POOL
+
+#include <WinSock2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <exception>
+#include <type_traits>
+
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    // Work-stealing thread pool for CPU-heavy work that should not run on an event loop thread.
+    // Each worker owns a deque: submissions are spread over the deques, a worker takes its newest
+    // task first, and idle workers steal the oldest tasks from the others. Results are delivered
+    // back on the loop thread, through a Completions handler registered with that loop.
+    class ComputePool
+    {
+    public:
+	class Task;
+	class Completions;
+
+	template <typename Work>
+	    void submit(Work &&work);
+
+	template <typename Work, typename Done>
+	    void submit(Completions &completions, Work &&work, Done &&done);
+
+	std::size_t workerCount() const noexcept;
+
+	~ComputePool();
+	ComputePool(unsigned workerCount = std::thread::hardware_concurrency());
+	ComputePool(ComputePool const &other) = delete;
+	ComputePool &operator =(ComputePool const &other) = delete;
+
+    protected:
+	class WorkerQueue;
+
+	std::unique_ptr<WorkerQueue[]> queues;
+	std::size_t queueCount;
+	std::vector<std::thread> workers;
+	std::atomic<std::size_t> pendingTasks { 0U };
+	std::atomic<unsigned> idleWorkers { 0U };
+	std::mutex idleMutex;
+	std::condition_variable idleCondition;
+	bool stopping = false;
+
+	void enqueue(Task &&task);
+	bool dequeue(std::size_t workerIndex, Task &task);
+	void runWorker(std::size_t workerIndex);
+    };
+
+    // Move-only callable, stored in place when small enough, so submitting small closures does not
+    // allocate. The whole object takes one cache line.
+    class ComputePool::Task
+    {
+    public:
+	static constexpr std::size_t inlineSize = 64U - sizeof(void *);
+
+    protected:
+	struct Operations
+	{
+	    void (*invoke)(void *storage);
+	    void (*relocate)(void *destination, void *source) noexcept;
+	    void (*destroy)(void *storage) noexcept;
+	};
+
+	template <typename Function>
+	    struct InlineOperations;
+
+	template <typename Function>
+	    struct HeapOperations;
+
+	alignas(std::max_align_t) unsigned char storage[inlineSize];
+	Operations const *operations = nullptr;
+
+    public:
+	template <typename Function>
+	    static constexpr bool fitsInline =
+		sizeof(Function) <= inlineSize
+		    && alignof(Function) <= alignof(std::max_align_t)
+		    && std::is_nothrow_move_constructible_v<Function>;
+
+	explicit operator bool() const noexcept;
+	void operator ()();
+
+	Task() noexcept = default;
+
+	template <typename Function, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Function>, Task>>>
+	    Task(Function &&function);
+
+	Task(Task &&other) noexcept;
+	Task &operator =(Task &&other) noexcept;
+	~Task();
+    };
+
+    class alignas(64) ComputePool::WorkerQueue
+    {
+    protected:
+	std::mutex queueMutex;
+	std::vector<Task> tasks;		// ring buffer, size is a power of 2
+	std::size_t head = 0U, tail = 0U;	// oldest task at head, newest at tail - 1
+
+    public:
+	void pushBack(Task &&task);
+	bool popBack(Task &task);
+	bool popFront(Task &task);
+    };
+
+    // Event handler that runs job completions on the loop thread. Register it with the loop that
+    // submits the jobs, and keep it (and the loop) alive until all the jobs posted to it are done.
+    // Exceptions thrown by the jobs or by their completions go to the loop exception handler.
+    class ComputePool::Completions: public EventLoop::EventHandler
+    {
+    protected:
+	Event event;
+	std::mutex postedMutex;
+	std::vector<Task> posted, running;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+
+    public:
+	void post(Task &&task);
+
+	Completions(Library &socketLib);
+    };
+}
+
+template <typename Function>
+    struct netsocket::ComputePool::Task::InlineOperations
+{
+    static Function *target(void *storage) noexcept
+    {
+	return std::launder(static_cast<Function *>(storage));
+    }
+
+    static void invoke(void *storage)
+    {
+	(*target(storage))();
+    }
+
+    static void relocate(void *destination, void *source) noexcept
+    {
+	new (destination) Function(std::move(*target(source)));
+	target(source)->~Function();
+    }
+
+    static void destroy(void *storage) noexcept
+    {
+	target(storage)->~Function();
+    }
+
+    static constexpr Operations operations { &invoke, &relocate, &destroy };
+};
+
+template <typename Function>
+    struct netsocket::ComputePool::Task::HeapOperations
+{
+    static Function *&target(void *storage) noexcept
+    {
+	return *std::launder(static_cast<Function **>(storage));
+    }
+
+    static void invoke(void *storage)
+    {
+	(*target(storage))();
+    }
+
+    static void relocate(void *destination, void *source) noexcept
+    {
+	new (destination) Function *(target(source));
+    }
+
+    static void destroy(void *storage) noexcept
+    {
+	delete target(storage);
+    }
+
+    static constexpr Operations operations { &invoke, &relocate, &destroy };
+};
+
+template <typename Function, typename>
+    inline netsocket::ComputePool::Task::Task(Function &&function)
+{
+    using FunctionT = std::decay_t<Function>;
+
+    if constexpr (fitsInline<FunctionT>)
+    {
+	new (storage) FunctionT(std::forward<Function>(function));
+	operations = &InlineOperations<FunctionT>::operations;
+    }
+    else
+    {
+	new (storage) FunctionT *(new FunctionT(std::forward<Function>(function)));
+	operations = &HeapOperations<FunctionT>::operations;
+    }
+}
+
+inline netsocket::ComputePool::Task::Task(Task &&other) noexcept
+    : operations(other.operations)
+{
+    if (operations)
+    {
+	operations->relocate(storage, other.storage);
+	other.operations = nullptr;
+    }
+}
+
+inline netsocket::ComputePool::Task &netsocket::ComputePool::Task::operator =(Task &&other) noexcept
+{
+    if (this != &other)
+    {
+	if (operations)
+	    operations->destroy(storage);
+
+	operations = other.operations;
+
+	if (operations)
+	{
+	    operations->relocate(storage, other.storage);
+	    other.operations = nullptr;
+	}
+    }
+
+    return *this;
+}
+
+inline netsocket::ComputePool::Task::~Task()
+{
+    if (operations)
+	operations->destroy(storage);
+}
+
+inline netsocket::ComputePool::Task::operator bool() const noexcept
+{
+    return operations != nullptr;
+}
+
+inline void netsocket::ComputePool::Task::operator ()()
+{
+    operations->invoke(storage);
+}
+
+inline netsocket::EventHandle netsocket::ComputePool::Completions::eventHandle()
+{
+    return event.handle();
+}
+
+inline netsocket::ComputePool::Completions::Completions(Library &socketLib)
+    : event(socketLib)
+{
+}
+
+inline std::size_t netsocket::ComputePool::workerCount() const noexcept
+{
+    return workers.size();
+}
+
+template <typename Work>
+    inline void netsocket::ComputePool::submit(Work &&work)
+{
+    enqueue(Task(std::forward<Work>(work)));
+}
+
+template <typename Work, typename Done>
+    inline void netsocket::ComputePool::submit(Completions &completions, Work &&work, Done &&done)
+{
+    enqueue
+	(
+	    Task
+	    (
+		[&completions, work = std::forward<Work>(work), done = std::forward<Done>(done)]() mutable
+		{
+		    using Result = std::invoke_result_t<std::decay_t<Work> &>;
+
+		    try
+		    {
+			if constexpr (std::is_void_v<Result>)
+			{
+			    work();
+			    completions.post(Task(std::move(done)));
+			}
+			else
+			    completions.post
+				(
+				    Task
+				    (
+					[done = std::move(done), result = work()]() mutable
+					{
+					    done(std::move(result));
+					}
+				    )
+				);
+		    }
+		    catch (...)
+		    {
+			completions.post
+			    (
+				Task
+				(
+				    [exception = std::current_exception()]()
+				    {
+					std::rethrow_exception(exception);
+				    }
+				)
+			    );
+		    }
+		}
+	    )
+	);
+}
+
+#endif // !defined(WINSOCK2_CXX_COMPUTE_POOL)
@@ -0,0 +1,277 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <limits>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "ConnectionPool.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::unique_ptr;
+using std::min;
+
+netsocket::ConnectionPool::Upstream::Upstream(sockaddr const *socketAddress, int socketAddressLength, Settings const &settings)
+    : addressLength(min(socketAddressLength, static_cast<int>(sizeof address))), settings(settings)
+{
+    std::memset(&address, 0, sizeof address);
+    std::memcpy(&address, socketAddress, static_cast<size_t>(addressLength));
+}
+
+netsocket::ConnectionPool::Connection::Connection(ConnectionPool &pool, Upstream &upstream)
+    : pool(pool), connectionUpstream(upstream),
+	connectionSocket(pool.socketLib, upstream.address.ss_family),
+	connectionEvent(pool.socketLib)
+{
+}
+
+bool netsocket::ConnectionPool::Connection::onEventTrigger(EventLoop &eventLoop)
+{
+    Upstream &upstream = connectionUpstream;
+
+    try
+    {
+	WSANETWORKEVENTS networkEvents = connectionSocket.networkEvents(connectionEvent.handle());
+
+	if (state == State::Connecting)
+	{
+	    if (networkEvents.lNetworkEvents & FD_CONNECT)
+	    {
+		if (networkEvents.iErrorCode[FD_CONNECT_BIT])
+		{
+		    upstream.counters.failures++;
+		    pool.evict(this);
+
+		    return false;
+		}
+
+		if (upstream.idle.count >= upstream.settings.maxIdle)
+		{
+		    upstream.counters.evictions++;
+		    pool.evict(this);
+
+		    return false;
+		}
+
+		upstream.connecting.remove(this);
+		state = State::Idle;
+		sinceTickCountMs = eventLoop.tickCountMs();
+		upstream.idle.pushFront(this);
+	    }
+	}
+
+	if (state == State::Connecting || !(networkEvents.lNetworkEvents & (FD_READ | FD_CLOSE)))
+	    return true;
+    }
+    catch (Exception const &)
+    {
+	upstream.counters.failures++;
+	pool.evict(this);
+
+	return false;
+    }
+
+    // An idle connection was closed by the server, or got unexpected data
+    upstream.counters.evictions++;
+    pool.evict(this);
+
+    return false;
+}
+
+void netsocket::ConnectionPool::Connection::onLoopQuit(EventLoop &)
+{
+    pool.evict(this);
+}
+
+netsocket::ConnectionPool::~ConnectionPool()
+{
+    for (auto &entry: upstreams)
+	for (Upstream::List *list: { &entry.second->idle, &entry.second->connecting })
+	    while (Connection *connection = list->head)
+	    {
+		list->remove(connection);
+		eventLoop.removeEventHandler(eventLoop.eventHandlerId(*connection));
+		delete connection;
+	    }
+}
+
+netsocket::ConnectionPool::Upstream &netsocket::ConnectionPool::upstream(sockaddr const *address, int addressLength)
+{
+    auto it = upstreams.find(AddressKey(address, addressLength));
+
+    return it != upstreams.end() ? *it->second : upstream(address, addressLength, Settings());
+}
+
+netsocket::ConnectionPool::Upstream &netsocket::ConnectionPool::upstream(sockaddr const *address, int addressLength, Settings const &settings)
+{
+    AddressKey key(address, addressLength);
+    auto it = upstreams.find(key);
+
+    if (it != upstreams.end())
+    {
+	it->second->settings = settings;
+	preconnect(*it->second);
+
+	return *it->second;
+    }
+
+    Upstream &newUpstream = *upstreams.emplace(key, std::make_unique<Upstream>(address, addressLength, settings)).first->second;
+
+    if (!pendingDeadline() || eventLoop.tickCountMs() + settings.sweepIntervalMs < deadlineTickCountMs)
+	eventLoop.setDeadline(*this, settings.sweepIntervalMs);
+
+    preconnect(newUpstream);
+
+    return newUpstream;
+}
+
+netsocket::ConnectionPool::Connection *netsocket::ConnectionPool::startConnect(Upstream &upstream, long networkEvents)
+{
+    unique_ptr<Connection> connection(new Connection(*this, upstream));
+
+    connection->connectionSocket.noDelay(upstream.settings.noDelay);
+    connection->connectionSocket.selectEvents(connection->connectionEvent.handle(), networkEvents);
+    connection->sinceTickCountMs = eventLoop.tickCountMs();
+
+    if (connection->connectionSocket.connect(upstream.socketAddress(), upstream.addressLength))
+	connection->state = Connection::State::Idle;
+
+    upstream.counters.connects++;
+
+    return connection.release();
+}
+
+void netsocket::ConnectionPool::preconnect(Upstream &upstream)
+{
+    while (upstream.idle.count + upstream.connecting.count < upstream.settings.minIdle && !eventLoop.full())
+    {
+	unique_ptr<Connection> connection;
+
+	try
+	{
+	    connection.reset(startConnect(upstream, FD_CONNECT | FD_READ | FD_CLOSE));
+	}
+	catch (Exception const &)
+	{
+	    upstream.counters.failures++;
+	    return;
+	}
+
+	eventLoop.addEventHandler(*connection);
+
+	if (connection->state == Connection::State::Idle)
+	    upstream.idle.pushFront(connection.get());
+	else
+	    upstream.connecting.pushFront(connection.get());
+
+	connection.release();
+    }
+}
+
+netsocket::ConnectionPool::Connection *netsocket::ConnectionPool::lease(Upstream &upstream)
+{
+    Connection *connection = upstream.idle.head;
+
+    if (connection)
+    {
+	upstream.idle.remove(connection);
+	eventLoop.removeEventHandler(eventLoop.eventHandlerId(*connection));
+	connection->state = Connection::State::Leased;
+	upstream.counters.leased++;
+	upstream.counters.reuses++;
+    }
+
+    preconnect(upstream);
+
+    return connection;
+}
+
+netsocket::ConnectionPool::Connection *netsocket::ConnectionPool::connect(Upstream &upstream)
+{
+    Connection *connection = startConnect(upstream, FD_CONNECT | FD_READ | FD_WRITE | FD_CLOSE);
+
+    connection->state = Connection::State::Leased;
+    upstream.counters.leased++;
+
+    return connection;
+}
+
+// The connection goes back to the head of the idle list, unless the server already closed it
+void netsocket::ConnectionPool::release(Connection *connection, bool reusable)
+{
+    Upstream &upstream = connection->connectionUpstream;
+    unique_ptr<Connection> owner(connection);
+
+    upstream.counters.leased--;
+
+    if (!reusable || upstream.idle.count >= upstream.settings.maxIdle || eventLoop.full())
+	return;
+
+    try
+    {
+	connection->connectionSocket.selectEvents(connection->connectionEvent.handle(), FD_READ | FD_CLOSE);
+
+	if (connection->connectionSocket.networkEvents(connection->connectionEvent.handle()).lNetworkEvents & FD_CLOSE)
+	    return;
+    }
+    catch (Exception const &)
+    {
+	return;
+    }
+
+    connection->state = Connection::State::Idle;
+    connection->sinceTickCountMs = eventLoop.tickCountMs();
+    eventLoop.addEventHandler(*connection);
+    upstream.idle.pushFront(owner.release());
+}
+
+void netsocket::ConnectionPool::evict(Connection *connection)
+{
+    Upstream &upstream = connection->connectionUpstream;
+
+    if (connection->state == Connection::State::Idle)
+	upstream.idle.remove(connection);
+    else
+	if (connection->state == Connection::State::Connecting)
+	    upstream.connecting.remove(connection);
+
+    connection->state = Connection::State::Leased;
+    eventLoop.enqueueDisposeHandler(connection);
+}
+
+// Periodic sweep: the oldest idle connections are at the tail of the idle list, and the oldest
+// connect attempts at the tail of the connecting list
+void netsocket::ConnectionPool::onDeadline(EventLoop &eventLoop)
+{
+    ULONGLONG currentTickCountMs = eventLoop.tickCountMs();
+    uint_least32_t sweepIntervalMs = std::numeric_limits<uint_least32_t>::max();
+
+    for (auto &entry: upstreams)
+    {
+	Upstream &upstream = *entry.second;
+	Settings const &settings = upstream.settings;
+
+	while (upstream.idle.count > settings.minIdle && currentTickCountMs - upstream.idle.tail->sinceTickCountMs >= settings.idleTimeoutMs)
+	{
+	    upstream.counters.evictions++;
+	    evict(upstream.idle.tail);
+	}
+
+	while (upstream.connecting.tail && currentTickCountMs - upstream.connecting.tail->sinceTickCountMs >= settings.connectTimeoutMs)
+	{
+	    upstream.counters.failures++;
+	    evict(upstream.connecting.tail);
+	}
+
+	preconnect(upstream);
+	sweepIntervalMs = min(sweepIntervalMs, settings.sweepIntervalMs);
+    }
+
+    if (!upstreams.empty())
+	eventLoop.setDeadline(*this, sweepIntervalMs);
+}
@@ -0,0 +1,282 @@
+#if !defined(WINSOCK2_CXX_CONNECTION_POOL)
+#define WINSOCK2_CXX_CONNECTION_POOL
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+
+namespace netsocket
+{
+    // Warm outbound TCP connections to upstream servers, for one event loop. Connections are
+    // grouped by the resolved upstream address, and kept in a most-recently-used idle list, so a
+    // lease takes the head of the list in constant time. Idle connections stay registered with the
+    // loop: if the server closes one or sends anything on it, it is evicted right away. A periodic
+    // loop deadline evicts connections idle for too long, or stuck connecting, and pre-connects
+    // each upstream back to its minimum idle count.
+    //
+    // A pool belongs to its loop thread and takes no locks. Every idle or connecting connection
+    // takes one of the 64 events of the loop.
+    class ConnectionPool: protected EventLoop::DeadlineHandler
+    {
+    public:
+	class Connection;
+	class Upstream;
+
+	struct Settings
+	{
+	    std::size_t minIdle = 0U;				// pre-connected and kept warm
+	    std::size_t maxIdle = 8U;
+	    std::uint_least32_t idleTimeoutMs = 60000U;		// for idle connections over minIdle
+	    std::uint_least32_t connectTimeoutMs = 5000U;
+	    std::uint_least32_t sweepIntervalMs = 1000U;
+	    bool noDelay = true;
+	};
+
+	struct Statistics
+	{
+	    std::size_t idle, connecting, leased;
+	    std::uint_least64_t connects, reuses, failures, evictions;
+	};
+
+	// The same upstream is returned for the same address and port, even if the sockaddr
+	// structures differ in padding. Settings given for an existing upstream replace its own.
+	Upstream &upstream(sockaddr const *address, int addressLength, Settings const &settings);
+	Upstream &upstream(sockaddr const *address, int addressLength);
+
+	Connection *lease(Upstream &upstream);		// idle connection, or nullptr when there is none
+	Connection *connect(Upstream &upstream);	// new connection, with the connect in progress
+	void release(Connection *connection, bool reusable = true);
+
+	ConnectionPool(Library &socketLib, EventLoop &eventLoop);
+	~ConnectionPool();
+	ConnectionPool(ConnectionPool const &other) = delete;
+	ConnectionPool &operator =(ConnectionPool const &other) = delete;
+
+    protected:
+	struct AddressKey
+	{
+	    std::uint_least16_t family = 0U, port = 0U;
+	    std::uint_least32_t scope = 0U;
+	    unsigned char address[16] { };
+
+	    AddressKey(sockaddr const *address, int addressLength);
+
+	    bool operator ==(AddressKey const &other) const noexcept;
+	};
+
+	struct AddressHash
+	{
+	    std::size_t operator ()(AddressKey const &key) const noexcept;
+	};
+
+	Library &socketLib;
+	EventLoop &eventLoop;
+	std::unordered_map<AddressKey, std::unique_ptr<Upstream>, AddressHash> upstreams;
+
+	Connection *startConnect(Upstream &upstream, long networkEvents);
+	void evict(Connection *connection);
+	void preconnect(Upstream &upstream);
+
+	virtual void onDeadline(EventLoop &eventLoop) override;
+
+	friend class Connection;
+    };
+
+    // Pooled connection. While leased, it belongs to the caller, that can select any network events
+    // on its socket with the connection event, and register its own handler for that event. Remove
+    // that handler from the loop before the connection is released, and release all leased
+    // connections before the pool is destroyed.
+    class ConnectionPool::Connection: public EventLoop::EventHandler
+    {
+    protected:
+	enum class State
+	{
+	    Connecting,
+	    Idle,
+	    Leased
+	};
+
+	ConnectionPool &pool;
+	Upstream &connectionUpstream;
+	Socket connectionSocket;
+	Event connectionEvent;
+	State state = State::Connecting;
+	ULONGLONG sinceTickCountMs = 0U;		// connect start, or the time it went idle
+	Connection *previous = nullptr, *next = nullptr;	// in the idle or connecting list
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+	virtual void onLoopQuit(EventLoop &eventLoop) override;
+
+	Connection(ConnectionPool &pool, Upstream &upstream);
+
+	friend class ConnectionPool;
+
+    public:
+	Socket &socket() noexcept;
+	Event &event() noexcept;
+	Upstream &upstream() noexcept;
+    };
+
+    class ConnectionPool::Upstream
+    {
+    protected:
+	// Intrusive list, newest connection at the head
+	struct List
+	{
+	    Connection *head = nullptr, *tail = nullptr;
+	    std::size_t count = 0U;
+
+	    void pushFront(Connection *connection) noexcept;
+	    void remove(Connection *connection) noexcept;
+	};
+
+	sockaddr_storage address;
+	int addressLength;
+	Settings settings;
+	List idle, connecting;
+	Statistics counters { };
+
+	friend class ConnectionPool;
+	friend class Connection;
+
+    public:
+	Statistics statistics() const noexcept;
+	sockaddr const *socketAddress() const noexcept;
+	int socketAddressLength() const noexcept;
+
+	Upstream(sockaddr const *address, int addressLength, Settings const &settings);
+	Upstream(Upstream const &other) = delete;
+	Upstream &operator =(Upstream const &other) = delete;
+    };
+}
+
+inline netsocket::ConnectionPool::AddressKey::AddressKey(sockaddr const *socketAddress, int)
+    : family(socketAddress->sa_family)
+{
+    if (socketAddress->sa_family == AF_INET6)
+    {
+	sockaddr_in6 const *address6 = reinterpret_cast<sockaddr_in6 const *>(socketAddress);
+
+	port = address6->sin6_port;
+	scope = address6->sin6_scope_id;
+	std::memcpy(address, &address6->sin6_addr, sizeof address6->sin6_addr);
+    }
+    else
+    {
+	sockaddr_in const *address4 = reinterpret_cast<sockaddr_in const *>(socketAddress);
+
+	port = address4->sin_port;
+	std::memcpy(address, &address4->sin_addr, sizeof address4->sin_addr);
+    }
+}
+
+inline bool netsocket::ConnectionPool::AddressKey::operator ==(AddressKey const &other) const noexcept
+{
+    return family == other.family && port == other.port && scope == other.scope && !std::memcmp(address, other.address, sizeof address);
+}
+
+inline std::size_t netsocket::ConnectionPool::AddressHash::operator ()(AddressKey const &key) const noexcept
+{
+    // FNV-1a over the key fields
+    std::uint_least64_t hash = 14695981039346656037U;
+    auto mix = [&hash](unsigned char byte) { hash = (hash ^ byte) * 1099511628211U; };
+
+    for (unsigned char byte: key.address)
+	mix(byte);
+
+    mix(static_cast<unsigned char>(key.port));
+    mix(static_cast<unsigned char>(key.port >> 8));
+    mix(static_cast<unsigned char>(key.family));
+    mix(static_cast<unsigned char>(key.scope));
+
+    return static_cast<std::size_t>(hash);
+}
+
+inline netsocket::ConnectionPool::ConnectionPool(Library &socketLib, EventLoop &eventLoop)
+    : socketLib(socketLib), eventLoop(eventLoop)
+{
+}
+
+inline netsocket::EventHandle netsocket::ConnectionPool::Connection::eventHandle()
+{
+    return connectionEvent.handle();
+}
+
+inline netsocket::Socket &netsocket::ConnectionPool::Connection::socket() noexcept
+{
+    return connectionSocket;
+}
+
+inline netsocket::Event &netsocket::ConnectionPool::Connection::event() noexcept
+{
+    return connectionEvent;
+}
+
+inline netsocket::ConnectionPool::Upstream &netsocket::ConnectionPool::Connection::upstream() noexcept
+{
+    return connectionUpstream;
+}
+
+inline void netsocket::ConnectionPool::Upstream::List::pushFront(Connection *connection) noexcept
+{
+    connection->previous = nullptr;
+    connection->next = head;
+
+    if (head)
+	head->previous = connection;
+    else
+	tail = connection;
+
+    head = connection;
+    count++;
+}
+
+inline void netsocket::ConnectionPool::Upstream::List::remove(Connection *connection) noexcept
+{
+    if (connection->previous)
+	connection->previous->next = connection->next;
+    else
+	head = connection->next;
+
+    if (connection->next)
+	connection->next->previous = connection->previous;
+    else
+	tail = connection->previous;
+
+    connection->previous = connection->next = nullptr;
+    count--;
+}
+
+inline netsocket::ConnectionPool::Statistics netsocket::ConnectionPool::Upstream::statistics() const noexcept
+{
+    Statistics result = counters;
+
+    result.idle = idle.count;
+    result.connecting = connecting.count;
+
+    return result;
+}
+
+inline sockaddr const *netsocket::ConnectionPool::Upstream::socketAddress() const noexcept
+{
+    return reinterpret_cast<sockaddr const *>(&address);
+}
+
+inline int netsocket::ConnectionPool::Upstream::socketAddressLength() const noexcept
+{
+    return addressLength;
+}
+
+#endif // !defined(WINSOCK2_CXX_CONNECTION_POOL)
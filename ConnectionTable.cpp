@@ -0,0 +1,268 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "ConnectionTable.hpp"
+
+using std::size_t;
+using std::uint_least8_t;
+using std::uint_least32_t;
+using std::unique_ptr;
+using std::min;
+
+namespace
+{
+    // Deadlines are rebased before the millisecond count from the epoch gets near the 32-bit limit
+    constexpr ULONGLONG rebaseMs = 0x40000000U;
+}
+
+netsocket::ConnectionTable::Group::Group(ConnectionTable &table, uint_least32_t firstSlot)
+    : table(table), event(table.socketLib), firstSlot(firstSlot)
+{
+}
+
+bool netsocket::ConnectionTable::Group::onEventTrigger(EventLoop &)
+{
+    table.dispatch(*this);
+
+    return true;
+}
+
+netsocket::ConnectionTable::ConnectionTable(Library &socketLib, EventLoop &eventLoop, Dispatcher &dispatcher, uint_least32_t groupSize, uint_least32_t sweepIntervalMs)
+    : socketLib(socketLib), eventLoop(eventLoop), dispatcher(dispatcher),
+	groupSize(groupSize ? groupSize : 1U), sweepIntervalMs(sweepIntervalMs),
+	epochTickCountMs(eventLoop.tickCountMs() - 1U)		// elapsed time is never 0
+{
+}
+
+netsocket::ConnectionTable::~ConnectionTable()
+{
+    for (unique_ptr<Group> &group: groups)
+	eventLoop.removeEventHandler(group->handlerId);
+
+    for (WSAPOLLFD const &entry: pollFds)
+	if (entry.fd != INVALID_SOCKET)
+	    ::closesocket(entry.fd);
+}
+
+netsocket::ConnectionTable::SlotId netsocket::ConnectionTable::add(Socket &&socket, short interest, void *context)
+{
+    uint_least32_t index = allocateSlot();
+    Group &group = *groups[index / groupSize];
+
+    if (!eventLoop.validHandler(group.handlerId))	// after the loop quit
+	group.handlerId = eventLoop.addEventHandler(group);
+
+    socket.selectEvents(group.event.handle(), selectedEvents);
+
+    pollFds[index].fd = socket.release();
+    pollFds[index].events = interest;
+    pollFds[index].revents = 0;
+    contexts[index] = context;
+    freeSlots.pop_back();
+    connectionCount++;
+
+    return SlotId { index, generations[index] };
+}
+
+netsocket::Socket netsocket::ConnectionTable::remove(SlotId slot)
+{
+    if (!valid(slot))
+	raiseError(Error::EInval);
+
+    uint_least32_t index = slot.index;
+    Socket socket(pollFds[index].fd);
+
+    pollFds[index].fd = INVALID_SOCKET;
+    pollFds[index].events = pollFds[index].revents = 0;
+
+    if (deadlines[index])
+    {
+	deadlines[index] = 0U;
+	deadlineCount--;
+    }
+
+    states[index] = 0U;
+    contexts[index] = nullptr;
+    generations[index]++;
+    freeSlots.push_back(index);			// reserved with the group
+    connectionCount--;
+
+    socket.selectEvents(groups[index / groupSize]->event.handle(), 0);
+
+    return socket;
+}
+
+// Write interest is not signaled again for a socket that was already writable, so the group is
+// scanned on the next iteration
+void netsocket::ConnectionTable::interest(SlotId slot, short interest)
+{
+    if (!valid(slot))
+	return;
+
+    short added = interest & ~pollFds[slot.index].events;
+
+    pollFds[slot.index].events = interest;
+
+    if (added & POLLWRNORM)
+	groups[slot.index / groupSize]->event.handle().set();
+}
+
+void netsocket::ConnectionTable::deadline(SlotId slot, uint_least32_t timeoutMs)
+{
+    if (!valid(slot))
+	return;
+
+    uint_least32_t currentMs = timeoutMs ? elapsedMs() : 0U;
+    uint_least32_t &target = deadlines[slot.index];
+
+    if (!timeoutMs)
+    {
+	if (target)
+	{
+	    target = 0U;
+	    deadlineCount--;
+	}
+
+	return;
+    }
+
+    if (!target)
+	deadlineCount++;
+
+    target = currentMs + min(timeoutMs, static_cast<uint_least32_t>(0xFFFFFFFFU - currentMs));
+
+    if (!pendingDeadline())
+	eventLoop.setDeadline(*this, sweepIntervalMs);
+}
+
+netsocket::ConnectionTable::Statistics netsocket::ConnectionTable::statistics() const noexcept
+{
+    Statistics result { connectionCount, pollFds.size(), groups.size(), sizeof *this };
+
+    result.bytes += pollFds.capacity() * sizeof(WSAPOLLFD);
+    result.bytes += deadlines.capacity() * sizeof(uint_least32_t);
+    result.bytes += states.capacity() * sizeof(uint_least8_t);
+    result.bytes += contexts.capacity() * sizeof(void *);
+    result.bytes += generations.capacity() * sizeof(uint_least32_t);
+    result.bytes += freeSlots.capacity() * sizeof(uint_least32_t);
+    result.bytes += groups.capacity() * sizeof(unique_ptr<Group>) + groups.size() * sizeof(Group);
+
+    return result;
+}
+
+// Returns the slot on top of the free stack, without taking it
+uint_least32_t netsocket::ConnectionTable::allocateSlot()
+{
+    if (freeSlots.empty())
+	addGroup();
+
+    return freeSlots.back();
+}
+
+// All arrays grow by one group, to the exact size, so they do not keep spare capacity
+void netsocket::ConnectionTable::addGroup()
+{
+    size_t firstSlot = pollFds.size(), capacity = firstSlot + groupSize;
+
+    pollFds.reserve(capacity);
+    deadlines.reserve(capacity);
+    states.reserve(capacity);
+    contexts.reserve(capacity);
+    generations.reserve(capacity);
+    freeSlots.reserve(capacity);
+    groups.reserve(groups.size() + 1U);
+
+    unique_ptr<Group> group(new Group(*this, static_cast<uint_least32_t>(firstSlot)));
+
+    group->handlerId = eventLoop.addEventHandler(*group);
+    groups.push_back(std::move(group));
+
+    WSAPOLLFD freeEntry { };
+
+    freeEntry.fd = INVALID_SOCKET;
+
+    pollFds.resize(capacity, freeEntry);
+    deadlines.resize(capacity, 0U);
+    states.resize(capacity, 0U);
+    contexts.resize(capacity, nullptr);
+    generations.resize(capacity, 0U);
+
+    for (size_t index = capacity; index-- > firstSlot; )
+	freeSlots.push_back(static_cast<uint_least32_t>(index));
+}
+
+// Free entries have an INVALID_SOCKET, that WSAPoll() skips. Handlers may add connections and
+// reallocate the arrays, so entries are always indexed again after a call.
+void netsocket::ConnectionTable::dispatch(Group &group)
+{
+    group.event.handle().reset();
+
+    int readyCount = wsa_call<SOCKET_ERROR>(::WSAPoll, pollFds.data() + group.firstSlot, static_cast<ULONG>(groupSize), 0);
+
+    if (!readyCount)
+	return;
+
+    group.event.handle().set();
+
+    for (uint_least32_t index = group.firstSlot; readyCount && index < group.firstSlot + groupSize; index++)
+    {
+	short readyEvents = pollFds[index].revents;
+
+	if (!readyEvents)
+	    continue;
+
+	pollFds[index].revents = 0;
+	readyCount--;
+
+	dispatcher.onReady(*this, SlotId { index, generations[index] }, readyEvents);
+    }
+}
+
+uint_least32_t netsocket::ConnectionTable::elapsedMs()
+{
+    ULONGLONG elapsed = eventLoop.tickCountMs() - epochTickCountMs;
+
+    if (elapsed >= rebaseMs)
+    {
+	rebaseDeadlines(static_cast<uint_least32_t>(elapsed - 1U));
+	epochTickCountMs += elapsed - 1U;
+	elapsed = 1U;
+    }
+
+    return static_cast<uint_least32_t>(elapsed);
+}
+
+// Expired deadlines stay expired
+void netsocket::ConnectionTable::rebaseDeadlines(uint_least32_t elapsed) noexcept
+{
+    for (uint_least32_t &target: deadlines)
+	if (target)
+	    target = target > elapsed ? target - elapsed : 1U;
+}
+
+// The next sweep is set up first, so a throwing handler does not stop the timeouts
+void netsocket::ConnectionTable::onDeadline(EventLoop &)
+{
+    if (!deadlineCount)
+	return;
+
+    eventLoop.setDeadline(*this, sweepIntervalMs);
+
+    uint_least32_t currentMs = elapsedMs();
+
+    for (uint_least32_t index = 0U; deadlineCount && index < deadlines.size(); index++)
+	if (deadlines[index] && deadlines[index] <= currentMs)
+	{
+	    deadlines[index] = 0U;
+	    deadlineCount--;
+
+	    dispatcher.onTimeout(*this, SlotId { index, generations[index] });
+	}
+}
@@ -0,0 +1,205 @@
+#if !defined(WINSOCK2_CXX_CONNECTION_TABLE)
+#define WINSOCK2_CXX_CONNECTION_TABLE
+
+#include <WinSock2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+
+namespace netsocket
+{
+    // Table of many connections for one event loop, with the per-connection state kept in arrays
+    // indexed by slot, instead of one handler object per connection. The hot arrays hold the
+    // WSAPOLLFD entry (socket, interest and ready events), the deadline and a state byte for the
+    // protocol. The context pointer and the slot generation are kept apart, and only read for
+    // connections that are ready.
+    //
+    // Slots come in groups that share one loop event, with all sockets in the group selected for
+    // network events on it, so a table of 63 groups takes the whole loop. When the group event is
+    // signaled, a WSAPoll() over the group slice of the array finds the ready connections. Ready
+    // events are level-triggered: a group with ready connections is scanned again on the next
+    // iteration, until its handlers read all the data and drop the write interest.
+    //
+    // Deadlines are checked by a periodic sweep of the deadline array, so timeouts fire up to one
+    // sweep interval late.
+    class ConnectionTable: protected EventLoop::DeadlineHandler
+    {
+    public:
+	class Dispatcher;
+
+	struct SlotId
+	{
+	    std::uint_least32_t index = 0xFFFFFFFFU;
+	    std::uint_least32_t generation = 0U;
+
+	    bool operator ==(SlotId const &other) const noexcept;
+	    bool operator !=(SlotId const &other) const noexcept;
+	};
+
+	struct Statistics
+	{
+	    std::size_t connections, capacity, groups;
+	    std::size_t bytes;					// allocated for the table
+	};
+
+	// Interest is a mask of POLLRDNORM and POLLWRNORM. Throws EventCountExceeded when a new
+	// group is needed and the loop is full.
+	SlotId add(Socket &&socket, short interest, void *context = nullptr);
+	Socket remove(SlotId slot);				// with no network events selected, EInval for a stale slot
+
+	// A stale slot, of a connection already removed, reads as a free slot, and setting its
+	// fields does nothing
+	bool valid(SlotId slot) const noexcept;
+	SOCKET socket(SlotId slot) const noexcept;
+	void *context(SlotId slot) const noexcept;
+	void context(SlotId slot, void *context) noexcept;
+	std::uint_least8_t state(SlotId slot) const noexcept;
+	void state(SlotId slot, std::uint_least8_t state) noexcept;
+	short interest(SlotId slot) const noexcept;
+	void interest(SlotId slot, short interest);
+	void deadline(SlotId slot, std::uint_least32_t timeoutMs);	// 0 for no deadline
+
+	Statistics statistics() const noexcept;
+	std::size_t bytesPerConnection() const noexcept;
+
+	ConnectionTable(Library &socketLib, EventLoop &eventLoop, Dispatcher &dispatcher, std::uint_least32_t groupSize = 1024U, std::uint_least32_t sweepIntervalMs = 1000U);
+	~ConnectionTable();
+	ConnectionTable(ConnectionTable const &other) = delete;
+	ConnectionTable &operator =(ConnectionTable const &other) = delete;
+
+    protected:
+	class Group;
+
+	static constexpr long selectedEvents = FD_READ | FD_WRITE | FD_ACCEPT | FD_CONNECT | FD_CLOSE;
+
+	Library &socketLib;
+	EventLoop &eventLoop;
+	Dispatcher &dispatcher;
+	std::uint_least32_t groupSize, sweepIntervalMs;
+
+	// Hot arrays, by slot. Deadlines count milliseconds from epochTickCountMs, with 0 for none.
+	std::vector<WSAPOLLFD> pollFds;				// fd is INVALID_SOCKET for free slots
+	std::vector<std::uint_least32_t> deadlines;
+	std::vector<std::uint_least8_t> states;
+
+	// Cold arrays
+	std::vector<void *> contexts;
+	std::vector<std::uint_least32_t> generations;
+	std::vector<std::uint_least32_t> freeSlots;		// stack, reserved for all slots
+	std::vector<std::unique_ptr<Group>> groups;
+
+	std::size_t connectionCount = 0U, deadlineCount = 0U;
+	ULONGLONG epochTickCountMs;
+
+	std::uint_least32_t allocateSlot();
+	void addGroup();
+	void dispatch(Group &group);
+	std::uint_least32_t elapsedMs();
+	void rebaseDeadlines(std::uint_least32_t elapsed) noexcept;
+
+	virtual void onDeadline(EventLoop &eventLoop) override;
+
+	friend class Group;
+    };
+
+    // Receives the events for all connections in a table. Handlers can add and remove connections,
+    // including the one being dispatched.
+    class ConnectionTable::Dispatcher
+    {
+    public:
+	// Ready events are the WSAPoll() revents, and include POLLHUP and POLLERR
+	virtual void onReady(ConnectionTable &table, SlotId slot, short readyEvents) = 0;
+
+	// The deadline is cleared before the call
+	virtual void onTimeout(ConnectionTable &table, SlotId slot) = 0;
+
+	virtual ~Dispatcher();
+    };
+
+    class ConnectionTable::Group: public EventLoop::EventHandler
+    {
+    protected:
+	ConnectionTable &table;
+	Event event;
+	std::uint_least32_t firstSlot;
+	EventLoop::HandlerId handlerId;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+
+	Group(ConnectionTable &table, std::uint_least32_t firstSlot);
+
+	friend class ConnectionTable;
+    };
+}
+
+inline bool netsocket::ConnectionTable::SlotId::operator ==(SlotId const &other) const noexcept
+{
+    return index == other.index && generation == other.generation;
+}
+
+inline bool netsocket::ConnectionTable::SlotId::operator !=(SlotId const &other) const noexcept
+{
+    return !(*this == other);
+}
+
+inline netsocket::ConnectionTable::Dispatcher::~Dispatcher()
+{
+}
+
+inline bool netsocket::ConnectionTable::valid(SlotId slot) const noexcept
+{
+    return slot.index < generations.size() && generations[slot.index] == slot.generation && pollFds[slot.index].fd != INVALID_SOCKET;
+}
+
+inline SOCKET netsocket::ConnectionTable::socket(SlotId slot) const noexcept
+{
+    return valid(slot) ? pollFds[slot.index].fd : INVALID_SOCKET;
+}
+
+inline void *netsocket::ConnectionTable::context(SlotId slot) const noexcept
+{
+    return valid(slot) ? contexts[slot.index] : nullptr;
+}
+
+inline void netsocket::ConnectionTable::context(SlotId slot, void *context) noexcept
+{
+    if (valid(slot))
+	contexts[slot.index] = context;
+}
+
+inline std::uint_least8_t netsocket::ConnectionTable::state(SlotId slot) const noexcept
+{
+    return valid(slot) ? states[slot.index] : 0U;
+}
+
+inline void netsocket::ConnectionTable::state(SlotId slot, std::uint_least8_t state) noexcept
+{
+    if (valid(slot))
+	states[slot.index] = state;
+}
+
+inline short netsocket::ConnectionTable::interest(SlotId slot) const noexcept
+{
+    return valid(slot) ? pollFds[slot.index].events : 0;
+}
+
+inline std::size_t netsocket::ConnectionTable::bytesPerConnection() const noexcept
+{
+    return connectionCount ? statistics().bytes / connectionCount : 0U;
+}
+
+inline netsocket::EventHandle netsocket::ConnectionTable::Group::eventHandle()
+{
+    return event.handle();
+}
+
+#endif // !defined(WINSOCK2_CXX_CONNECTION_TABLE)
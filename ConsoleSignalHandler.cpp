@@ -0,0 +1,180 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "ConsoleSignalHandler.hpp"
+
+using std::uint_least32_t;
+using std::uint_least64_t;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::condition_variable;
+
+namespace
+{
+    // Shared with the handler routine, on the threads started by the system. Never destroyed, as
+    // a signal can come in while the process exits.
+    struct ConsoleState
+    {
+	mutex stateMutex;
+	condition_variable handledCondition;
+	netsocket::ConsoleSignalHandler *handler = nullptr;
+	unsigned pendingSignals = 0U;			// a bit for each Signal
+	uint_least64_t raised = 0U, handled = 0U;
+    };
+
+    ConsoleState &consoleState()
+    {
+	static ConsoleState *state = new ConsoleState();
+
+	return *state;
+    }
+
+    void signalsHandled(uint_least64_t raised)
+    {
+	ConsoleState &state = consoleState();
+
+	{
+	    lock_guard<mutex> lock(state.stateMutex);
+	    state.handled = std::max(state.handled, raised);
+	}
+
+	state.handledCondition.notify_all();
+    }
+}
+
+netsocket::ConsoleSignalHandler::ConsoleSignalHandler(Library &socketLib, EventLoop &eventLoop, Settings const &settings)
+    : eventLoop(eventLoop), event(socketLib), settings(settings)
+{
+    ConsoleState &state = consoleState();
+    lock_guard<mutex> lock(state.stateMutex);
+
+    if (state.handler)
+	raiseError(Error::EAlready);
+
+    handlerId = eventLoop.addEventHandler(*this, EventLoop::Priority::Control);
+
+    if (!::SetConsoleCtrlHandler(&handlerRoutine, TRUE))
+    {
+	int error = static_cast<int>(::GetLastError());
+
+	eventLoop.removeEventHandler(handlerId);
+	raiseError(error);
+    }
+
+    state.handler = this;
+    state.pendingSignals = 0U;
+}
+
+netsocket::ConsoleSignalHandler::~ConsoleSignalHandler()
+{
+    ConsoleState &state = consoleState();
+
+    {
+	lock_guard<mutex> lock(state.stateMutex);
+	state.handler = nullptr;
+	state.pendingSignals = 0U;
+    }
+
+    // release routines still waiting for a dispatch
+    state.handledCondition.notify_all();
+    ::SetConsoleCtrlHandler(&handlerRoutine, FALSE);
+    eventLoop.removeEventHandler(handlerId);
+}
+
+bool netsocket::ConsoleSignalHandler::onEventTrigger(EventLoop &eventLoop)
+{
+    ConsoleState &state = consoleState();
+    unsigned signals;
+    uint_least64_t raised;
+
+    {
+	lock_guard<mutex> lock(state.stateMutex);
+
+	event.handle().reset();
+	signals = state.pendingSignals;
+	state.pendingSignals = 0U;
+	raised = state.raised;
+    }
+
+    try
+    {
+	for (unsigned signal = 0U; signals >> signal; signal++)
+	    if (signals >> signal & 1U)
+		onConsoleSignal(eventLoop, static_cast<Signal>(signal));
+    }
+    catch (...)
+    {
+	signalsHandled(raised);
+	throw;
+    }
+
+    signalsHandled(raised);
+
+    return true;
+}
+
+// Returns FALSE for the next handler routine, or the default one that ends the process, when no
+// handler is registered
+BOOL WINAPI netsocket::ConsoleSignalHandler::handlerRoutine(DWORD dwCtrlType)
+{
+    Signal signal;
+
+    switch (dwCtrlType)
+    {
+    case CTRL_C_EVENT:
+	signal = Signal::CtrlC;
+	break;
+    case CTRL_BREAK_EVENT:
+	signal = Signal::CtrlBreak;
+	break;
+    case CTRL_CLOSE_EVENT:
+	signal = Signal::Close;
+	break;
+    case CTRL_LOGOFF_EVENT:
+	signal = Signal::Logoff;
+	break;
+    case CTRL_SHUTDOWN_EVENT:
+	signal = Signal::Shutdown;
+	break;
+    default:
+	return FALSE;
+    }
+
+    ConsoleState &state = consoleState();
+    unique_lock<mutex> lock(state.stateMutex);
+    ConsoleSignalHandler *handler = state.handler;
+
+    if (!handler)
+	return FALSE;
+
+    state.pendingSignals |= 1U << static_cast<unsigned>(signal);
+
+    uint_least64_t raised = ++state.raised;
+    uint_least32_t closeWaitMs = handler->settings.closeWaitMs;
+
+    try
+    {
+	handler->event.handle().set();
+    }
+    catch (...)
+    {
+	return FALSE;
+    }
+
+    if (signal == Signal::Close || signal == Signal::Logoff || signal == Signal::Shutdown)
+	state.handledCondition.wait_for
+	    (
+		lock, std::chrono::milliseconds(closeWaitMs),
+		[&state, handler, raised]() { return state.handled >= raised || state.handler != handler; }
+	    );
+
+    return TRUE;
+}
@@ -0,0 +1,75 @@
+#if !defined(WINSOCK2_CXX_CONSOLE_SIGNAL_HANDLER)
+#define WINSOCK2_CXX_CONSOLE_SIGNAL_HANDLER
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstdint>
+
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    // Console control signals (Ctrl+C, Ctrl+Break, closing the console, logoff and shutdown),
+    // dispatched on the event loop like socket events, for a graceful shutdown from the loop
+    // thread. The system calls the console handler routine on a thread of its own, that only
+    // records the signal and sets the loop event. Signals that come in before the dispatch are
+    // merged, and dispatched once each, in the order of the enum.
+    //
+    // The process ends when the handler routine returns for the close, logoff and shutdown
+    // signals, so the routine waits for the loop to dispatch them, up to the close wait. There is
+    // one handler in a process at a time. It registers with the Control priority class, and stays
+    // in the loop until it is destroyed or the loop quits.
+    class ConsoleSignalHandler: public EventLoop::EventHandler
+    {
+    public:
+	enum class Signal: std::uint_least8_t
+	{
+	    CtrlC,
+	    CtrlBreak,
+	    Close,
+	    Logoff,
+	    Shutdown
+	};
+
+	struct Settings
+	{
+	    std::uint_least32_t closeWaitMs = 4000U;	// the system ends the process after 5 s on close
+	};
+
+	// Throws EAlready if the process already has a handler
+	ConsoleSignalHandler(Library &socketLib, EventLoop &eventLoop);
+	ConsoleSignalHandler(Library &socketLib, EventLoop &eventLoop, Settings const &settings);
+	~ConsoleSignalHandler();
+	ConsoleSignalHandler(ConsoleSignalHandler const &other) = delete;
+	ConsoleSignalHandler &operator =(ConsoleSignalHandler const &other) = delete;
+
+    protected:
+	EventLoop &eventLoop;
+	Event event;
+	Settings settings;
+	EventLoop::HandlerId handlerId;
+
+	virtual void onConsoleSignal(EventLoop &eventLoop, Signal signal) = 0;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+
+	static BOOL WINAPI handlerRoutine(DWORD dwCtrlType);
+    };
+}
+
+inline netsocket::ConsoleSignalHandler::ConsoleSignalHandler(Library &socketLib, EventLoop &eventLoop)
+    : ConsoleSignalHandler(socketLib, eventLoop, Settings())
+{
+}
+
+inline netsocket::EventHandle netsocket::ConsoleSignalHandler::eventHandle()
+{
+    return event.handle();
+}
+
+#endif // !defined(WINSOCK2_CXX_CONSOLE_SIGNAL_HANDLER)
@@ -0,0 +1,88 @@
+#if !defined(WINSOCK2_CXX_COUNTING_RESOURCE)
+#define WINSOCK2_CXX_COUNTING_RESOURCE
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace netsocket
+{
+    // Memory resource that passes allocations on to another one and counts them, to measure the
+    // allocator traffic of a loop. Take the statistics from an IterationHandler for the traffic of
+    // each iteration. Not thread safe, like the loop it is given to: put a synchronized resource
+    // upstream for a resource shared by several threads.
+    class CountingResource: public std::pmr::memory_resource
+    {
+    public:
+	struct Statistics
+	{
+	    std::uint_least64_t allocations, deallocations;
+	    std::uint_least64_t allocatedBytes, deallocatedBytes;
+	    std::size_t currentBytes, peakBytes;
+	};
+
+	Statistics const &statistics() const noexcept;
+	void resetStatistics() noexcept;		// keeps the current bytes, and makes them the peak
+	std::pmr::memory_resource *upstreamResource() const noexcept;
+
+	CountingResource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) noexcept;
+
+    protected:
+	std::pmr::memory_resource *upstream;
+	Statistics counters { };
+
+	virtual void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+	virtual void do_deallocate(void *memory, std::size_t bytes, std::size_t alignment) override;
+	virtual bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override;
+    };
+}
+
+inline netsocket::CountingResource::Statistics const &netsocket::CountingResource::statistics() const noexcept
+{
+    return counters;
+}
+
+inline void netsocket::CountingResource::resetStatistics() noexcept
+{
+    counters = Statistics { 0U, 0U, 0U, 0U, counters.currentBytes, counters.currentBytes };
+}
+
+inline std::pmr::memory_resource *netsocket::CountingResource::upstreamResource() const noexcept
+{
+    return upstream;
+}
+
+inline netsocket::CountingResource::CountingResource(std::pmr::memory_resource *upstream) noexcept
+    : upstream(upstream)
+{
+}
+
+inline void *netsocket::CountingResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    void *memory = upstream->allocate(bytes, alignment);
+
+    counters.allocations++;
+    counters.allocatedBytes += bytes;
+    counters.currentBytes += bytes;
+
+    if (counters.currentBytes > counters.peakBytes)
+	counters.peakBytes = counters.currentBytes;
+
+    return memory;
+}
+
+inline void netsocket::CountingResource::do_deallocate(void *memory, std::size_t bytes, std::size_t alignment)
+{
+    upstream->deallocate(memory, bytes, alignment);
+
+    counters.deallocations++;
+    counters.deallocatedBytes += bytes;
+    counters.currentBytes -= bytes;
+}
+
+inline bool netsocket::CountingResource::do_is_equal(std::pmr::memory_resource const &other) const noexcept
+{
+    return this == &other;
+}
+
+#endif // !defined(WINSOCK2_CXX_COUNTING_RESOURCE)
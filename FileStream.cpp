@@ -0,0 +1,327 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "FileStream.hpp"
+
+using std::size_t;
+
+netsocket::FileStream::FileStream(Library &socketLib, EventLoop &eventLoop, HANDLE hFile, bool owned, Settings const &settings)
+    : eventLoop(eventLoop), event(socketLib), settings(settings), hFile(hFile), owned(owned)
+{
+    try
+    {
+	if (!settings.chunkSize || settings.chunkSize > MAXDWORD || !settings.window)
+	    raiseError(Error::EInval);
+
+	// One block for the chunks, page aligned as unbuffered I/O needs
+	buffers = static_cast<char *>(::VirtualAlloc(nullptr, settings.chunkSize * settings.window, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (!buffers)
+	    raiseError(static_cast<int>(::GetLastError()));
+
+	chunks.resize(settings.window);
+
+	for (size_t index = 0U; index < chunks.size(); index++)
+	{
+	    chunks[index].data = buffers + index * settings.chunkSize;
+	    chunks[index].state = ChunkState::Free;
+	}
+    }
+    catch (...)
+    {
+	if (buffers)
+	    ::VirtualFree(buffers, 0U, MEM_RELEASE);
+
+	if (owned)
+	    ::CloseHandle(hFile);
+
+	throw;
+    }
+}
+
+netsocket::FileStream::~FileStream()
+{
+    cancelPending();
+    waitPending();
+    eventLoop.removeEventHandler(handlerId);
+    ::VirtualFree(buffers, 0U, MEM_RELEASE);
+
+    if (owned)
+	::CloseHandle(hFile);
+}
+
+HANDLE netsocket::FileStream::openFile(char const *path, DWORD dwDesiredAccess, DWORD dwCreationDisposition, DWORD dwFlags)
+{
+    HANDLE hFile = ::CreateFileA(path, dwDesiredAccess, FILE_SHARE_READ, nullptr, dwCreationDisposition, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | dwFlags, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+	raiseError(static_cast<int>(::GetLastError()));
+
+    return hFile;
+}
+
+// Starting an operation resets the shared event, that may have been set by another operation
+// completed just before, so the event is set again for those. An operation that completes after
+// the check sets the event itself.
+void netsocket::FileStream::issue(Chunk &chunk, ULONGLONG offset, DWORD length, bool write)
+{
+    if (!eventLoop.validHandler(handlerId))
+	handlerId = eventLoop.addEventHandler(*this);
+
+    chunk.overlapped = OVERLAPPED { };
+    chunk.overlapped.Offset = static_cast<DWORD>(offset);
+    chunk.overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32U);
+    chunk.overlapped.hEvent = event.handle();
+    chunk.offset = offset;
+    chunk.length = length;
+    chunk.transferred = 0U;
+    chunk.error = 0;
+    chunk.state = ChunkState::Pending;
+
+    BOOL bStarted = write
+	? ::WriteFile(hFile, chunk.data, length, nullptr, &chunk.overlapped)
+	: ::ReadFile(hFile, chunk.data, length, nullptr, &chunk.overlapped);
+
+    issued++;
+    pending++;
+
+    if (!bStarted)
+    {
+	DWORD dwError = ::GetLastError();
+
+	if (dwError != ERROR_IO_PENDING)
+	{
+	    chunk.error = dwError == ERROR_HANDLE_EOF ? 0 : static_cast<int>(dwError);
+	    chunk.state = ChunkState::Complete;
+	    pending--;
+	    event.handle().set();
+
+	    return;
+	}
+    }
+
+    for (Chunk const &other: chunks)
+	if (other.state == ChunkState::Pending && HasOverlappedIoCompleted(&other.overlapped))
+	{
+	    event.handle().set();
+	    break;
+	}
+}
+
+// The end of the file completes a read with no data and no error
+void netsocket::FileStream::complete(Chunk &chunk, BOOL bWait) noexcept
+{
+    DWORD dwTransferred = 0U;
+
+    if (::GetOverlappedResult(hFile, &chunk.overlapped, &dwTransferred, bWait))
+	chunk.error = 0;
+    else
+    {
+	DWORD dwError = ::GetLastError();
+
+	if (dwError == ERROR_IO_INCOMPLETE)
+	    return;
+
+	chunk.error = dwError == ERROR_HANDLE_EOF ? 0 : static_cast<int>(dwError);
+    }
+
+    chunk.transferred = dwTransferred;
+    chunk.state = ChunkState::Complete;
+    pending--;
+}
+
+void netsocket::FileStream::collect() noexcept
+{
+    for (Chunk &chunk: chunks)
+	if (chunk.state == ChunkState::Pending)
+	    complete(chunk, FALSE);
+}
+
+void netsocket::FileStream::cancelPending() noexcept
+{
+    for (Chunk &chunk: chunks)
+	if (chunk.state == ChunkState::Pending)
+	    ::CancelIoEx(hFile, &chunk.overlapped);
+}
+
+void netsocket::FileStream::waitPending() noexcept
+{
+    for (Chunk &chunk: chunks)
+	if (chunk.state == ChunkState::Pending)
+	    complete(chunk, TRUE);
+}
+
+// A stream with no pending operations leaves the loop. Completions are lost if the delivery
+// throws, so the stream cancels the operations left, and the loop reports the exception.
+bool netsocket::FileStream::onEventTrigger(EventLoop &eventLoop)
+{
+    event.handle().reset();
+    collect();
+
+    try
+    {
+	onChunksComplete(eventLoop);
+    }
+    catch (...)
+    {
+	cancelPending();
+	waitPending();
+	throw;
+    }
+
+    return pending != 0U;
+}
+
+// The loop is going away, so the operations are canceled and waited for
+void netsocket::FileStream::onLoopQuit(EventLoop &)
+{
+    cancelPending();
+    waitPending();
+}
+
+netsocket::FileReader::FileReader(Library &socketLib, EventLoop &eventLoop, char const *path, Settings const &settings)
+    : FileStream
+	(
+	    socketLib, eventLoop,
+	    openFile(path, GENERIC_READ, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN | (settings.unbuffered ? FILE_FLAG_NO_BUFFERING : 0U)),
+	    true, settings
+	)
+{
+}
+
+netsocket::FileReader::FileReader(Library &socketLib, EventLoop &eventLoop, HANDLE hFile, Settings const &settings)
+    : FileStream(socketLib, eventLoop, hFile, false, settings)
+{
+}
+
+void netsocket::FileReader::read(ULONGLONG offset, ULONGLONG length)
+{
+    if (pending)
+	raiseError(Error::EAlready);
+
+    for (Chunk &chunk: chunks)
+	chunk.state = ChunkState::Free;
+
+    issued = delivered = 0U;
+    nextOffset = offset;
+    endOffset = length > ~0ULL - offset ? ~0ULL : offset + length;
+    active = true;
+    held = false;
+
+    fill();
+}
+
+void netsocket::FileReader::resume()
+{
+    if (!active || !held)
+	return;
+
+    held = false;
+    onChunksComplete(eventLoop);
+}
+
+void netsocket::FileReader::stop()
+{
+    if (active)
+	end(+Error::OperationAborted);
+}
+
+// Reads past the end of the file complete with no data, so the read ahead of an open-ended
+// read stops on the first one
+void netsocket::FileReader::fill()
+{
+    while (active && !windowFull() && nextOffset < endOffset)
+    {
+	DWORD length = static_cast<DWORD>(std::min<ULONGLONG>(settings.chunkSize, endOffset - nextOffset));
+
+	issue(issueChunk(), nextOffset, length, false);
+	nextOffset += length;
+    }
+}
+
+// A short read is the end of the file
+void netsocket::FileReader::release(Chunk &chunk)
+{
+    chunk.state = ChunkState::Free;
+    delivered++;
+
+    if (chunk.transferred < chunk.length || (nextOffset >= endOffset && delivered == issued))
+	end(0);
+    else
+	fill();
+}
+
+// Operations still pending complete later, and are dropped
+void netsocket::FileReader::end(int error)
+{
+    active = false;
+    held = false;
+    cancelPending();
+    onFileEnd(eventLoop, error);
+}
+
+void netsocket::FileReader::onChunksComplete(EventLoop &eventLoop)
+{
+    while (active && !held)
+    {
+	Chunk *chunk = deliveryChunk();
+
+	if (!chunk)
+	    break;
+
+	if (chunk->error || !chunk->transferred)
+	{
+	    end(chunk->error);
+	    break;
+	}
+
+	if (!onFileData(eventLoop, chunk->offset, chunk->data, chunk->transferred))
+	{
+	    held = true;
+	    break;
+	}
+
+	if (active)
+	    release(*chunk);
+    }
+}
+
+netsocket::FileWriter::FileWriter(Library &socketLib, EventLoop &eventLoop, char const *path, Settings const &settings)
+    : FileStream(socketLib, eventLoop, openFile(path, GENERIC_WRITE, CREATE_ALWAYS, 0U), true, settings), writeOffset(0U)
+{
+}
+
+netsocket::FileWriter::FileWriter(Library &socketLib, EventLoop &eventLoop, HANDLE hFile, ULONGLONG offset, Settings const &settings)
+    : FileStream(socketLib, eventLoop, hFile, false, settings), writeOffset(offset)
+{
+}
+
+char *netsocket::FileWriter::buffer() noexcept
+{
+    return windowFull() ? nullptr : issueChunk().data;
+}
+
+void netsocket::FileWriter::commit(size_t length)
+{
+    if (!length || length > settings.chunkSize || windowFull())
+	raiseError(Error::EInval);
+
+    issue(issueChunk(), writeOffset, static_cast<DWORD>(length), true);
+    writeOffset += length;
+}
+
+// The chunk is free before the call, so the handler can write again from it
+void netsocket::FileWriter::onChunksComplete(EventLoop &eventLoop)
+{
+    while (Chunk *chunk = deliveryChunk())
+    {
+	chunk->state = ChunkState::Free;
+	delivered++;
+	onFileWritten(eventLoop, chunk->offset, chunk->transferred, chunk->error);
+    }
+}
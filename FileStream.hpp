@@ -0,0 +1,214 @@
+#if !defined(WINSOCK2_CXX_FILE_STREAM)
+#define WINSOCK2_CXX_FILE_STREAM
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SocketError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    // Overlapped reads or writes on a file, completed on the event loop, so disk I/O overlaps
+    // network I/O on the loop thread. A window of operations is kept in flight, each with its own
+    // chunk of a buffer block allocated once with VirtualAlloc(), and reused for the life of the
+    // stream. Completions are delivered in file order.
+    //
+    // All operations of the stream share one loop event. The handler is in the loop while any
+    // operation is pending.
+    class FileStream: public EventLoop::EventHandler
+    {
+    public:
+	struct Settings
+	{
+	    std::size_t chunkSize = 65536U;
+	    unsigned window = 4U;			// operations in flight
+	    bool unbuffered = false;			// FILE_FLAG_NO_BUFFERING, for a FileReader opening a path
+	};
+
+	HANDLE handle() const noexcept;
+	std::size_t chunkSize() const noexcept;
+	unsigned pendingCount() const noexcept;
+
+	~FileStream();				// cancels and waits for the pending operations
+	FileStream(FileStream const &other) = delete;
+	FileStream &operator =(FileStream const &other) = delete;
+
+    protected:
+	enum class ChunkState: std::uint_least8_t
+	{
+	    Free,
+	    Pending,
+	    Complete
+	};
+
+	struct Chunk
+	{
+	    OVERLAPPED overlapped;
+	    char *data;
+	    ULONGLONG offset;
+	    DWORD length, transferred;
+	    int error;
+	    ChunkState state;
+	};
+
+	EventLoop &eventLoop;
+	Event event;
+	Settings settings;
+	HANDLE hFile;
+	bool owned;
+	char *buffers = nullptr;
+	std::vector<Chunk> chunks;			// a ring, in the order the operations are issued
+	EventLoop::HandlerId handlerId;
+	unsigned pending = 0U;
+	std::uint_least64_t issued = 0U, delivered = 0U;
+
+	// Takes the handle, that must be opened for overlapped I/O, and closes it if owned, also
+	// when the constructor throws
+	FileStream(Library &socketLib, EventLoop &eventLoop, HANDLE hFile, bool owned, Settings const &settings);
+
+	static HANDLE openFile(char const *path, DWORD dwDesiredAccess, DWORD dwCreationDisposition, DWORD dwFlags);
+
+	bool windowFull() const noexcept;
+	Chunk &issueChunk() noexcept;			// next chunk to issue, when the window is not full
+	Chunk *deliveryChunk() noexcept;		// next chunk to deliver, if complete
+	void issue(Chunk &chunk, ULONGLONG offset, DWORD length, bool write);
+	void complete(Chunk &chunk, BOOL bWait) noexcept;
+	void collect() noexcept;
+	void cancelPending() noexcept;
+	void waitPending() noexcept;
+
+	// Called on the loop after completions came in, to deliver them with deliveryChunk()
+	virtual void onChunksComplete(EventLoop &eventLoop) = 0;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+	virtual void onLoopQuit(EventLoop &eventLoop) override;
+    };
+
+    // Streams a file, or part of it, from a read offset. Each chunk is passed to onFileData() in
+    // order, and the chunk is read again further on once the handler is done with it, so the
+    // read-ahead never passes the window. With an unbuffered file, the offset and the chunk size
+    // must be multiples of the sector size.
+    class FileReader: public FileStream
+    {
+    public:
+	// Throws EAlready while a previous read still has operations pending
+	void read(ULONGLONG offset = 0U, ULONGLONG length = ~0ULL);
+	void resume();				// after onFileData() returned false, and may call it right away
+	void stop();				// onFileEnd() gets Error::OperationAborted
+	bool reading() const noexcept;
+
+	FileReader(Library &socketLib, EventLoop &eventLoop, char const *path);
+	FileReader(Library &socketLib, EventLoop &eventLoop, char const *path, Settings const &settings);
+	FileReader(Library &socketLib, EventLoop &eventLoop, HANDLE hFile, Settings const &settings);	// not owned
+
+    protected:
+	ULONGLONG nextOffset = 0U, endOffset = 0U;
+	bool active = false, held = false;
+
+	// Return false when the data can not be taken yet, and the same chunk is passed again after
+	// resume(), for example when the socket it goes to is full
+	virtual bool onFileData(EventLoop &eventLoop, ULONGLONG offset, char const *data, std::size_t length) = 0;
+
+	// The error is 0 at the end of the file or of the length to read
+	virtual void onFileEnd(EventLoop &eventLoop, int error) = 0;
+
+	void fill();
+	void release(Chunk &chunk);
+	void end(int error);
+
+	virtual void onChunksComplete(EventLoop &eventLoop) override;
+    };
+
+    // Appends to a file from the stream buffers: the caller fills the buffer from buffer() and
+    // writes it with commit(), so the data is not copied again. Each write is reported with
+    // onFileWritten(), in order, and its buffer is free again after the call.
+    class FileWriter: public FileStream
+    {
+    public:
+	char *buffer() noexcept;		// of chunkSize() bytes, or nullptr while the window is full
+	void commit(std::size_t length);	// writes the data put in the buffer
+	ULONGLONG offset() const noexcept;	// where the next write goes
+
+	FileWriter(Library &socketLib, EventLoop &eventLoop, char const *path);		// created or truncated
+	FileWriter(Library &socketLib, EventLoop &eventLoop, char const *path, Settings const &settings);
+	FileWriter(Library &socketLib, EventLoop &eventLoop, HANDLE hFile, ULONGLONG offset, Settings const &settings);	// not owned
+
+    protected:
+	ULONGLONG writeOffset;
+
+	virtual void onFileWritten(EventLoop &eventLoop, ULONGLONG offset, std::size_t length, int error) = 0;
+
+	virtual void onChunksComplete(EventLoop &eventLoop) override;
+    };
+}
+
+inline HANDLE netsocket::FileStream::handle() const noexcept
+{
+    return hFile;
+}
+
+inline std::size_t netsocket::FileStream::chunkSize() const noexcept
+{
+    return settings.chunkSize;
+}
+
+inline unsigned netsocket::FileStream::pendingCount() const noexcept
+{
+    return pending;
+}
+
+inline bool netsocket::FileStream::windowFull() const noexcept
+{
+    return issued - delivered >= chunks.size();
+}
+
+inline netsocket::FileStream::Chunk &netsocket::FileStream::issueChunk() noexcept
+{
+    return chunks[static_cast<std::size_t>(issued % chunks.size())];
+}
+
+inline netsocket::FileStream::Chunk *netsocket::FileStream::deliveryChunk() noexcept
+{
+    if (delivered == issued)
+	return nullptr;
+
+    Chunk &chunk = chunks[static_cast<std::size_t>(delivered % chunks.size())];
+
+    return chunk.state == ChunkState::Complete ? &chunk : nullptr;
+}
+
+inline netsocket::EventHandle netsocket::FileStream::eventHandle()
+{
+    return event.handle();
+}
+
+inline bool netsocket::FileReader::reading() const noexcept
+{
+    return active;
+}
+
+inline netsocket::FileReader::FileReader(Library &socketLib, EventLoop &eventLoop, char const *path)
+    : FileReader(socketLib, eventLoop, path, Settings())
+{
+}
+
+inline ULONGLONG netsocket::FileWriter::offset() const noexcept
+{
+    return writeOffset;
+}
+
+inline netsocket::FileWriter::FileWriter(Library &socketLib, EventLoop &eventLoop, char const *path)
+    : FileWriter(socketLib, eventLoop, path, Settings())
+{
+}
+
+#endif // !defined(WINSOCK2_CXX_FILE_STREAM)
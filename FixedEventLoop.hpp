@@ -0,0 +1,70 @@
+#if !defined(WINSOCK2_CXX_FIXED_EVENT_LOOP)
+#define WINSOCK2_CXX_FIXED_EVENT_LOOP
+
+#include <WinSock2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <memory_resource>
+
+#include "SocketLibrary.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    // Event loop with its tables in arrays inside the object, sized at compile time, so adding,
+    // dispatching and removing handlers never allocates. The capacity bounds the handler slots,
+    // the pending deadlines and the iteration end requests, and the events in the wait set, up to
+    // the WinSock2 limit of 64. Going over it throws StorageExceeded, or EventCountExceeded for the
+    // events, instead of growing.
+    //
+    // Handlers are still owned by the caller. Dispose them with enqueueDisposeHandler() only if
+    // they come from allocateHandler(), that uses the memory resource, or from new.
+    template <std::size_t handlerCapacity>
+	class FixedEventLoop: public EventLoop
+    {
+    public:
+	static constexpr std::size_t eventCapacity = handlerCapacity < WSA_MAXIMUM_WAIT_EVENTS ? handlerCapacity : WSA_MAXIMUM_WAIT_EVENTS;
+
+	FixedEventLoop(Library &socketLib, std::pmr::memory_resource *memoryResource = std::pmr::get_default_resource());
+	~FixedEventLoop();				// quits the loop while the tables still exist
+	FixedEventLoop(FixedEventLoop const &other) = delete;
+	FixedEventLoop &operator =(FixedEventLoop const &other) = delete;
+
+    protected:
+	std::array<WSAEVENT, eventCapacity> eventBuffer;
+	std::array<std::uint_least32_t, eventCapacity> eventSlotBuffer;
+	std::array<HandlerSlot, handlerCapacity> handlerBuffer;
+	std::array<DeadlineHandler *, handlerCapacity> deadlineBuffer;
+	std::array<IterationEndHandler *, handlerCapacity> iterationEndBuffer;
+	std::array<HandlerId, eventCapacity> yieldBuffer;
+    };
+}
+
+template <std::size_t handlerCapacity>
+    inline netsocket::FixedEventLoop<handlerCapacity>::FixedEventLoop(Library &socketLib, std::pmr::memory_resource *memoryResource)
+	: EventLoop(socketLib, memoryResource)
+{
+    static_assert(handlerCapacity > 0U, "FixedEventLoop needs room for at least one handler");
+
+    eventLimit = static_cast<unsigned long>(eventCapacity);
+    events.attach(eventBuffer.data(), eventBuffer.size());
+    eventSlots.attach(eventSlotBuffer.data(), eventSlotBuffer.size());
+    handlers.attach(handlerBuffer.data(), handlerBuffer.size());
+    deadlines.attach(deadlineBuffer.data(), deadlineBuffer.size());
+    iterationEndHandlers.attach(iterationEndBuffer.data(), iterationEndBuffer.size());
+    yieldedHandlers.attach(yieldBuffer.data(), yieldBuffer.size());
+}
+
+// The tables are left empty, so the quit from ~EventLoop() has nothing to read in them
+template <std::size_t handlerCapacity>
+    inline netsocket::FixedEventLoop<handlerCapacity>::~FixedEventLoop()
+{
+    doQuitEvent();
+    events.clear();
+    eventSlots.clear();
+    handlers.clear();
+}
+
+#endif // !defined(WINSOCK2_CXX_FIXED_EVENT_LOOP)
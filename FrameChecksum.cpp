@@ -0,0 +1,316 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64)
+# include <intrin.h>
+#endif
+
+#include "FrameChecksum.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::uint_least64_t;
+using std::uint64_t;
+using std::memcpy;
+
+netsocket::BaseException::Tag const netsocket::frameChecksumTag { "Frame integrity check" };
+
+namespace
+{
+    uint_least32_t const CRC32C_POLYNOMIAL = 0x82F63B78U;	// bit-reflected Castagnoli polynomial
+
+    // Product of two polynomials modulo the CRC polynomial, in bit-reflected representation
+    constexpr uint_least32_t multiplyModP(uint_least32_t a, uint_least32_t b)
+    {
+	uint_least32_t mask = UINT32_C(1) << 31, product = 0U;
+
+	while (mask)
+	{
+	    if (a & mask)
+		product ^= b;
+
+	    mask >>= 1;
+	    b = b & 1U ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+	}
+
+	return product;
+    }
+
+    // x^n modulo the CRC polynomial, in bit-reflected representation
+    constexpr uint_least32_t xPowerModP(uint_least64_t n)
+    {
+	uint_least32_t result = UINT32_C(1) << 31, square = UINT32_C(1) << 30;
+
+	while (n)
+	{
+	    if (n & 1U)
+		result = multiplyModP(square, result);
+
+	    square = multiplyModP(square, square);
+	    n >>= 1;
+	}
+
+	return result;
+    }
+
+    struct SlicingTable
+    {
+	uint_least32_t entry[8][256];
+    };
+
+    constexpr SlicingTable makeSlicingTable()
+    {
+	SlicingTable table { };
+
+	for (unsigned i = 0U; i < 256U; i++)
+	{
+	    uint_least32_t crc = i;
+
+	    for (unsigned bit = 0U; bit < 8U; bit++)
+		crc = crc & 1U ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+
+	    table.entry[0][i] = crc;
+	}
+
+	for (unsigned i = 0U; i < 256U; i++)
+	    for (unsigned slice = 1U; slice < 8U; slice++)
+		table.entry[slice][i] = (table.entry[slice - 1U][i] >> 8) ^ table.entry[0][table.entry[slice - 1U][i] & 0xFFU];
+
+	return table;
+    }
+
+    constexpr SlicingTable slicingTable = makeSlicingTable();
+
+    template <bool copy>
+	inline uint64_t loadWord(unsigned char *destination, unsigned char const *source, size_t offset = 0U) noexcept
+    {
+	uint64_t word;
+	memcpy(&word, source + offset, sizeof word);
+
+	if constexpr (copy)
+	    memcpy(destination + offset, &word, sizeof word);
+
+	return word;
+    }
+
+    // Registers hold the raw (not inverted) CRC value in all kernels below
+    template <bool copy>
+	uint_least32_t portableKernel(unsigned char *destination, unsigned char const *source, size_t length, uint_least32_t crc) noexcept
+    {
+	auto const &t = slicingTable.entry;
+
+	while (length >= 8U)
+	{
+	    uint64_t word = loadWord<copy>(destination, source) ^ crc;
+
+	    crc = t[7][word & 0xFFU] ^ t[6][word >> 8 & 0xFFU] ^ t[5][word >> 16 & 0xFFU] ^ t[4][word >> 24 & 0xFFU]
+		^ t[3][word >> 32 & 0xFFU] ^ t[2][word >> 40 & 0xFFU] ^ t[1][word >> 48 & 0xFFU] ^ t[0][word >> 56];
+
+	    if constexpr (copy)
+		destination += 8U;
+
+	    source += 8U;
+	    length -= 8U;
+	}
+
+	while (length--)
+	{
+	    if constexpr (copy)
+		*destination++ = *source;
+
+	    crc = t[0][(crc ^ *source++) & 0xFFU] ^ crc >> 8;
+	}
+
+	return crc;
+    }
+
+#if defined(_M_X64)
+    template <bool copy>
+	uint_least32_t sse42Kernel(unsigned char *destination, unsigned char const *source, size_t length, uint_least32_t crc) noexcept
+    {
+	uint64_t crcWord = crc;
+
+	while (length >= 8U)
+	{
+	    crcWord = _mm_crc32_u64(crcWord, loadWord<copy>(destination, source));
+
+	    if constexpr (copy)
+		destination += 8U;
+
+	    source += 8U;
+	    length -= 8U;
+	}
+
+	crc = static_cast<uint_least32_t>(crcWord);
+
+	while (length--)
+	{
+	    if constexpr (copy)
+		*destination++ = *source;
+
+	    crc = _mm_crc32_u8(crc, *source++);
+	}
+
+	return crc;
+    }
+
+    // The crc32 instruction has a latency of 3 cycles and a throughput of 1 per cycle, so 3 independent
+    // streams over adjacent blocks keep it busy. The partial CRCs are then shifted over the following
+    // blocks and combined: multiplying by x^(8 * n - 33) and reducing with one more crc32 instruction
+    // is equivalent to appending n zero bytes.
+    template <size_t blockLength, bool copy>
+	uint_least32_t interleavedKernel(unsigned char *&destination, unsigned char const *&source, size_t &length, uint_least32_t crc) noexcept
+    {
+	static_assert(blockLength % 8U == 0U, "CRC32C block length must be a multiple of 8 bytes");
+
+	constexpr uint_least32_t
+	    shift2Blocks = xPowerModP(8U * 2U * blockLength - 33U),
+	    shift1Block  = xPowerModP(8U * blockLength - 33U);
+
+	while (length >= 3U * blockLength)
+	{
+	    uint64_t crc0 = crc, crc1 = 0U, crc2 = 0U;
+
+	    for (size_t offset = 0U; offset < blockLength; offset += 8U)
+	    {
+		crc0 = _mm_crc32_u64(crc0, loadWord<copy>(destination, source, offset));
+		crc1 = _mm_crc32_u64(crc1, loadWord<copy>(destination, source, blockLength + offset));
+		crc2 = _mm_crc32_u64(crc2, loadWord<copy>(destination, source, 2U * blockLength + offset));
+	    }
+
+	    __m128i shifted = _mm_xor_si128
+		(
+		    _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc0)), _mm_cvtsi32_si128(static_cast<int>(shift2Blocks)), 0x00),
+		    _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc1)), _mm_cvtsi32_si128(static_cast<int>(shift1Block)), 0x00)
+		);
+
+	    crc = static_cast<uint_least32_t>(_mm_crc32_u64(0U, static_cast<uint64_t>(_mm_cvtsi128_si64(shifted))) ^ crc2);
+
+	    if constexpr (copy)
+		destination += 3U * blockLength;
+
+	    source += 3U * blockLength;
+	    length -= 3U * blockLength;
+	}
+
+	return crc;
+    }
+
+    template <bool copy>
+	uint_least32_t sse42PclmulKernel(unsigned char *destination, unsigned char const *source, size_t length, uint_least32_t crc) noexcept
+    {
+	crc = interleavedKernel<8192U, copy>(destination, source, length, crc);
+	crc = interleavedKernel<256U, copy>(destination, source, length, crc);
+
+	return sse42Kernel<copy>(destination, source, length, crc);
+    }
+#endif
+
+    typedef uint_least32_t (*KernelFunction)(unsigned char *, unsigned char const *, size_t, uint_least32_t) noexcept;
+
+    struct Crc32cDispatch
+    {
+	netsocket::Crc32cKernel kernel;
+	KernelFunction checksum;
+	KernelFunction checksumCopy;
+    };
+
+    Crc32cDispatch kernelDispatch(netsocket::Crc32cKernel kernel) noexcept
+    {
+	switch (kernel)
+	{
+#if defined(_M_X64)
+	case netsocket::Crc32cKernel::SSE42_PCLMUL:
+	    return { kernel, &sse42PclmulKernel<false>, &sse42PclmulKernel<true> };
+
+	case netsocket::Crc32cKernel::SSE42:
+	    return { kernel, &sse42Kernel<false>, &sse42Kernel<true> };
+#endif
+
+	default:
+	    return { netsocket::Crc32cKernel::Portable, &portableKernel<false>, &portableKernel<true> };
+	}
+    }
+
+    Crc32cDispatch selectKernel() noexcept
+    {
+	if (netsocket::crc32cSupported(netsocket::Crc32cKernel::SSE42_PCLMUL))
+	    return kernelDispatch(netsocket::Crc32cKernel::SSE42_PCLMUL);
+
+	if (netsocket::crc32cSupported(netsocket::Crc32cKernel::SSE42))
+	    return kernelDispatch(netsocket::Crc32cKernel::SSE42);
+
+	return kernelDispatch(netsocket::Crc32cKernel::Portable);
+    }
+
+    // Applies the pre- and post-inversion around the kernel
+    uint_least32_t checksum(KernelFunction function, void *destination, void const *source, size_t length, uint_least32_t crc) noexcept
+    {
+	return ~function
+	    (
+		static_cast<unsigned char *>(destination),
+		static_cast<unsigned char const *>(source),
+		length,
+		~crc & UINT32_C(0xFFFFFFFF)
+	    )
+	    & UINT32_C(0xFFFFFFFF);
+    }
+
+    Crc32cDispatch const &dispatch() noexcept
+    {
+	static Crc32cDispatch const selectedKernel = selectKernel();
+
+	return selectedKernel;
+    }
+}
+
+netsocket::Crc32cKernel netsocket::crc32cKernel() noexcept
+{
+    return dispatch().kernel;
+}
+
+bool netsocket::crc32cSupported(Crc32cKernel kernel) noexcept
+{
+    if (kernel == Crc32cKernel::Portable)
+	return true;
+
+#if defined(_M_X64)
+    int cpuInfo[4] = { };
+
+    __cpuid(cpuInfo, 0);
+
+    if (cpuInfo[0] >= 1)
+    {
+	__cpuid(cpuInfo, 1);
+
+	bool
+	    hasSSE42  = cpuInfo[2] & (1 << 20),
+	    hasPCLMUL = cpuInfo[2] & (1 << 1);
+
+	return hasSSE42 && (hasPCLMUL || kernel == Crc32cKernel::SSE42);
+    }
+#endif
+
+    return false;
+}
+
+uint_least32_t netsocket::crc32c(void const *data, size_t length, uint_least32_t crc) noexcept
+{
+    return checksum(dispatch().checksum, nullptr, data, length, crc);
+}
+
+uint_least32_t netsocket::crc32cCopy(void *destination, void const *source, size_t length, uint_least32_t crc) noexcept
+{
+    return checksum(dispatch().checksumCopy, destination, source, length, crc);
+}
+
+uint_least32_t netsocket::crc32c(Crc32cKernel kernel, void const *data, size_t length, uint_least32_t crc) noexcept
+{
+    return checksum(kernelDispatch(kernel).checksum, nullptr, data, length, crc);
+}
+
+uint_least32_t netsocket::crc32cCopy(Crc32cKernel kernel, void *destination, void const *source, size_t length, uint_least32_t crc) noexcept
+{
+    return checksum(kernelDispatch(kernel).checksumCopy, destination, source, length, crc);
+}
@@ -0,0 +1,147 @@
+#if !defined(WINSOCK2_CXX_FRAME_CHECKSUM)
+#define WINSOCK2_CXX_FRAME_CHECKSUM
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+#include "SocketError.hpp"
+
+namespace netsocket
+{
+    enum class Crc32cKernel
+    {
+	Portable,		// slicing-by-8 tables
+	SSE42,			// crc32 instruction, single stream
+	SSE42_PCLMUL		// crc32 instruction on 3 interleaved streams, recombined with carry-less multiply
+    };
+
+    Crc32cKernel crc32cKernel() noexcept;
+
+    // CRC32C (Castagnoli) of the data, continuing from a previous crc value, with the usual
+    // pre- and post-inversion applied, so crc32c(b, n2, crc32c(a, n1)) is the CRC of a followed by b
+    std::uint_least32_t crc32c(void const *data, std::size_t length, std::uint_least32_t crc = 0U) noexcept;
+
+    // Same as crc32c(), while also copying the data to destination in the same pass
+    std::uint_least32_t crc32cCopy(void *destination, void const *source, std::size_t length, std::uint_least32_t crc = 0U) noexcept;
+
+    // With a given kernel instead of the one selected for the processor, for tests and
+    // benchmarks. The kernel must be one crc32cSupported() returns true for.
+    bool crc32cSupported(Crc32cKernel kernel) noexcept;
+    std::uint_least32_t crc32c(Crc32cKernel kernel, void const *data, std::size_t length, std::uint_least32_t crc = 0U) noexcept;
+    std::uint_least32_t crc32cCopy(Crc32cKernel kernel, void *destination, void const *source, std::size_t length, std::uint_least32_t crc = 0U) noexcept;
+
+    extern BaseException::Tag const frameChecksumTag;
+
+    class FrameChecksumMismatch: public BaseExceptionType<frameChecksumTag>, public std::exception
+    {
+    protected:
+	std::uint_least32_t expectedCrc, actualCrc;
+	char text[80];				// formatted by the constructor
+
+    public:
+	FrameChecksumMismatch(std::uint_least32_t expectedCrc, std::uint_least32_t actualCrc) noexcept;
+
+	std::uint_least32_t expected() const noexcept;
+	std::uint_least32_t actual() const noexcept;
+
+	virtual char const *what() const noexcept override;
+	virtual std::uintptr_t baseErrorCode() const noexcept override;
+    };
+
+    // Optional integrity stage for framed messages, to be owned by the event handlers that
+    // receive the frames. When verification is turned off, frames are only copied.
+    class FrameChecksum
+    {
+    protected:
+	bool verifyFrames;
+
+    public:
+	bool verifying() const noexcept;
+	void verifying(bool enable) noexcept;
+
+	bool check(void const *frame, std::size_t length, std::uint_least32_t expectedCrc) const noexcept;
+	void validate(void const *frame, std::size_t length, std::uint_least32_t expectedCrc) const;
+	void receive(void *destination, void const *frame, std::size_t length, std::uint_least32_t expectedCrc) const;
+
+	FrameChecksum(bool verifyFrames = true);
+    };
+}
+
+inline netsocket::FrameChecksumMismatch::FrameChecksumMismatch(std::uint_least32_t expectedCrc, std::uint_least32_t actualCrc) noexcept
+    : expectedCrc(expectedCrc), actualCrc(actualCrc)
+{
+    std::snprintf
+	(
+	    text, sizeof text, "Frame CRC32C mismatch, expected 0x%08lX, computed 0x%08lX",
+	    static_cast<unsigned long>(expectedCrc), static_cast<unsigned long>(actualCrc)
+	);
+}
+
+inline std::uint_least32_t netsocket::FrameChecksumMismatch::expected() const noexcept
+{
+    return expectedCrc;
+}
+
+inline std::uint_least32_t netsocket::FrameChecksumMismatch::actual() const noexcept
+{
+    return actualCrc;
+}
+
+inline char const *netsocket::FrameChecksumMismatch::what() const noexcept
+{
+    return text;
+}
+
+inline std::uintptr_t netsocket::FrameChecksumMismatch::baseErrorCode() const noexcept
+{
+    return actualCrc;
+}
+
+inline bool netsocket::FrameChecksum::verifying() const noexcept
+{
+    return verifyFrames;
+}
+
+inline void netsocket::FrameChecksum::verifying(bool enable) noexcept
+{
+    verifyFrames = enable;
+}
+
+inline bool netsocket::FrameChecksum::check(void const *frame, std::size_t length, std::uint_least32_t expectedCrc) const noexcept
+{
+    return !verifyFrames || crc32c(frame, length) == expectedCrc;
+}
+
+inline void netsocket::FrameChecksum::validate(void const *frame, std::size_t length, std::uint_least32_t expectedCrc) const
+{
+    if (verifyFrames)
+    {
+	std::uint_least32_t actualCrc = crc32c(frame, length);
+
+	if (actualCrc != expectedCrc)
+	    throw FrameChecksumMismatch(expectedCrc, actualCrc);
+    }
+}
+
+inline void netsocket::FrameChecksum::receive(void *destination, void const *frame, std::size_t length, std::uint_least32_t expectedCrc) const
+{
+    if (verifyFrames)
+    {
+	std::uint_least32_t actualCrc = crc32cCopy(destination, frame, length);
+
+	if (actualCrc != expectedCrc)
+	    throw FrameChecksumMismatch(expectedCrc, actualCrc);
+    }
+    else
+	std::memcpy(destination, frame, length);
+}
+
+inline netsocket::FrameChecksum::FrameChecksum(bool verifyFrames)
+    : verifyFrames(verifyFrames)
+{
+}
+
+#endif // !defined(WINSOCK2_CXX_FRAME_CHECKSUM)
@@ -0,0 +1,172 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SocketError.hpp"
+#include "OverlappedHandler.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+
+netsocket::OverlappedHandler::~OverlappedHandler()
+{
+    if (operationPending)
+    {
+	DWORD dwTransferred = 0U;
+
+	cancel();
+	result(dwTransferred, TRUE);
+	finish();
+    }
+}
+
+void netsocket::OverlappedHandler::receive(Socket &socket, WSABUF *buffers, DWORD bufferCount, uint_least32_t timeoutMs, CancelToken *cancelToken)
+{
+    prepare(socket, timeoutMs);
+    started(::WSARecv(hSocket, buffers, bufferCount, nullptr, &dwFlags, &overlapped, nullptr), cancelToken);
+}
+
+void netsocket::OverlappedHandler::send(Socket &socket, WSABUF *buffers, DWORD bufferCount, uint_least32_t timeoutMs, CancelToken *cancelToken)
+{
+    prepare(socket, timeoutMs);
+    started(::WSASend(hSocket, buffers, bufferCount, nullptr, 0U, &overlapped, nullptr), cancelToken);
+}
+
+// A cancel request that comes too late fails with ERROR_NOT_FOUND, and the completion reports the
+// result of the operation
+bool netsocket::OverlappedHandler::cancel() noexcept
+{
+    if (!operationPending)
+	return false;
+
+    if (cancelToken)
+	cancelToken->remove(this);
+
+    return ::CancelIoEx(reinterpret_cast<HANDLE>(hSocket), &overlapped) != FALSE;
+}
+
+// Everything that can throw is done before the operation is issued, as the buffers must not be
+// given back to the caller while the system still uses them
+void netsocket::OverlappedHandler::prepare(Socket &socket, uint_least32_t timeoutMs)
+{
+    if (operationPending)
+	raiseError(Error::EAlready);
+
+    event.handle().reset();
+    handlerId = eventLoop.addEventHandler(*this);
+
+    try
+    {
+	if (timeoutMs)
+	    eventLoop.setDeadline(*this, timeoutMs);
+    }
+    catch (...)
+    {
+	eventLoop.removeEventHandler(handlerId);
+	throw;
+    }
+
+    overlapped = WSAOVERLAPPED { };
+    overlapped.hEvent = event.handle();
+    hSocket = socket.handle();
+    dwFlags = 0U;
+    timedOut = false;
+}
+
+void netsocket::OverlappedHandler::started(int result, CancelToken *cancelToken)
+{
+    if (result == SOCKET_ERROR)
+    {
+	int wsaError = ::WSAGetLastError();
+
+	if (wsaError != WSA_IO_PENDING)
+	{
+	    if (pendingDeadline())
+		eventLoop.cancelDeadline(*this);
+
+	    eventLoop.removeEventHandler(handlerId);
+	    raiseError(wsaError);
+	}
+    }
+
+    // Completed right away or not, the event is signaled on completion
+    operationPending = true;
+
+    if (cancelToken)
+	cancelToken->add(this);
+}
+
+int netsocket::OverlappedHandler::result(DWORD &dwTransferred, BOOL bWait) noexcept
+{
+    DWORD dwResultFlags = 0U;
+
+    if (!::WSAGetOverlappedResult(hSocket, &overlapped, &dwTransferred, bWait, &dwResultFlags))
+	return ::WSAGetLastError();
+
+    return 0;
+}
+
+void netsocket::OverlappedHandler::finish() noexcept
+{
+    operationPending = false;
+
+    if (cancelToken)
+	cancelToken->remove(this);
+
+    if (pendingDeadline())
+	eventLoop.cancelDeadline(*this);
+
+    eventLoop.removeEventHandler(handlerId);
+}
+
+bool netsocket::OverlappedHandler::onEventTrigger(EventLoop &)
+{
+    DWORD dwTransferred = 0U;
+    int wsaError = result(dwTransferred, FALSE);
+
+    if (wsaError == WSA_IO_INCOMPLETE)
+	return true;
+
+    if (wsaError == WSA_OPERATION_ABORTED && timedOut)
+	wsaError = +Error::ETimedOut;
+
+    finish();
+    onOverlappedComplete(eventLoop, dwTransferred, wsaError);
+
+    return false;
+}
+
+// The loop is going away, so the operation is canceled and waited for
+void netsocket::OverlappedHandler::onLoopQuit(EventLoop &)
+{
+    if (!operationPending)
+	return;
+
+    DWORD dwTransferred = 0U;
+
+    cancel();
+
+    int wsaError = result(dwTransferred, TRUE);
+
+    finish();
+    onOverlappedComplete(eventLoop, dwTransferred, wsaError);
+}
+
+void netsocket::OverlappedHandler::onDeadline(EventLoop &)
+{
+    timedOut = true;
+    cancel();
+}
+
+size_t netsocket::CancelToken::cancel() noexcept
+{
+    size_t canceled = 0U;
+
+    while (head)
+	if (head->cancel())
+	    canceled++;
+
+    return canceled;
+}
@@ -0,0 +1,153 @@
+#if !defined(WINSOCK2_CXX_OVERLAPPED_HANDLER)
+#define WINSOCK2_CXX_OVERLAPPED_HANDLER
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SocketError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+
+namespace netsocket
+{
+    class CancelToken;
+
+    // One overlapped WSARecv() or WSASend() at a time, completed on the event loop. The handler
+    // adds itself to the loop when the operation starts, taking one loop event while the operation
+    // is pending, and removes itself before onOverlappedComplete() is called, so the completion can
+    // start the next operation.
+    //
+    // A pending operation can be canceled on its own, with an optional deadline, or together with
+    // the other operations registered on the same CancelToken. Canceling only requests CancelIoEx()
+    // from the system: the buffers stay in use until the completion comes in, and the operation
+    // may still complete normally if the request was too late.
+    class OverlappedHandler: public EventLoop::EventHandler, protected EventLoop::DeadlineHandler
+    {
+    public:
+	// Timeout of 0 for no deadline. Throws EAlready if an operation is pending, and
+	// EventCountExceeded or StorageExceeded when the loop is full. Nothing is left pending
+	// when the call throws.
+	void receive(Socket &socket, WSABUF *buffers, DWORD bufferCount, std::uint_least32_t timeoutMs = 0U, CancelToken *cancelToken = nullptr);
+	void send(Socket &socket, WSABUF *buffers, DWORD bufferCount, std::uint_least32_t timeoutMs = 0U, CancelToken *cancelToken = nullptr);
+
+	bool pending() const noexcept;
+	bool cancel() noexcept;			// false when no cancel request was made
+
+	OverlappedHandler(Library &socketLib, EventLoop &eventLoop);
+	~OverlappedHandler();			// cancels and waits for a pending operation
+	OverlappedHandler(OverlappedHandler const &other) = delete;
+	OverlappedHandler &operator =(OverlappedHandler const &other) = delete;
+
+    protected:
+	EventLoop &eventLoop;
+	Event event;
+	WSAOVERLAPPED overlapped;
+	SOCKET hSocket = INVALID_SOCKET;	// for the pending operation
+	DWORD dwFlags = 0U;
+	EventLoop::HandlerId handlerId;
+	bool operationPending = false, timedOut = false;
+	CancelToken *cancelToken = nullptr;
+	OverlappedHandler *previous = nullptr, *next = nullptr;	// in the token list
+
+	// The error is 0 on success, Error::OperationAborted after cancel(), or Error::ETimedOut
+	// when the operation was canceled by its deadline
+	virtual void onOverlappedComplete(EventLoop &eventLoop, DWORD dwTransferred, int wsaError) = 0;
+
+	void prepare(Socket &socket, std::uint_least32_t timeoutMs);
+	void started(int result, CancelToken *cancelToken);
+	int result(DWORD &dwTransferred, BOOL bWait) noexcept;
+	void finish() noexcept;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+	virtual void onLoopQuit(EventLoop &eventLoop) override;
+	virtual void onDeadline(EventLoop &eventLoop) override;
+
+	friend class CancelToken;
+    };
+
+    // Cancels a batch of overlapped operations at once, for example all reads for the clients of a
+    // listener on shutdown. Operations are kept in an intrusive list, so registering, completing
+    // and canceling each operation take constant time.
+    class CancelToken
+    {
+    public:
+	std::size_t cancel() noexcept;		// number of operations canceled
+	std::size_t pendingCount() const noexcept;
+
+	CancelToken() = default;
+	~CancelToken();
+	CancelToken(CancelToken const &other) = delete;
+	CancelToken &operator =(CancelToken const &other) = delete;
+
+    protected:
+	OverlappedHandler *head = nullptr;
+	std::size_t count = 0U;
+
+	void add(OverlappedHandler *handler) noexcept;
+	void remove(OverlappedHandler *handler) noexcept;
+
+	friend class OverlappedHandler;
+    };
+}
+
+inline bool netsocket::OverlappedHandler::pending() const noexcept
+{
+    return operationPending;
+}
+
+inline netsocket::OverlappedHandler::OverlappedHandler(Library &socketLib, EventLoop &eventLoop)
+    : eventLoop(eventLoop), event(socketLib), overlapped { }
+{
+}
+
+inline netsocket::EventHandle netsocket::OverlappedHandler::eventHandle()
+{
+    return event.handle();
+}
+
+inline std::size_t netsocket::CancelToken::pendingCount() const noexcept
+{
+    return count;
+}
+
+inline netsocket::CancelToken::~CancelToken()
+{
+    cancel();
+}
+
+inline void netsocket::CancelToken::add(OverlappedHandler *handler) noexcept
+{
+    handler->cancelToken = this;
+    handler->previous = nullptr;
+    handler->next = head;
+
+    if (head)
+	head->previous = handler;
+
+    head = handler;
+    count++;
+}
+
+inline void netsocket::CancelToken::remove(OverlappedHandler *handler) noexcept
+{
+    if (handler->previous)
+	handler->previous->next = handler->next;
+    else
+	head = handler->next;
+
+    if (handler->next)
+	handler->next->previous = handler->previous;
+
+    handler->cancelToken = nullptr;
+    handler->previous = handler->next = nullptr;
+    count--;
+}
+
+#endif // !defined(WINSOCK2_CXX_OVERLAPPED_HANDLER)
@@ -0,0 +1,238 @@
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "AddressInfoError.hpp"
+#include "ParallelConnect.hpp"
+
+using std::size_t;
+using std::vector;
+using std::unique_ptr;
+using std::min;
+
+netsocket::ParallelConnect::Attempt::Attempt(ParallelConnect &owner, size_t addressIndex)
+    : owner(owner),
+	socket(owner.socketLib, owner.addresses[addressIndex].address.ss_family),
+	event(owner.socketLib),
+	addressIndex(addressIndex)
+{
+}
+
+void netsocket::ParallelConnect::Attempt::onLoopQuit(EventLoop &)
+{
+    owner.removeAttempt(this);
+}
+
+bool netsocket::ParallelConnect::Attempt::onEventTrigger(EventLoop &)
+{
+    int wsaError;
+
+    try
+    {
+	WSANETWORKEVENTS networkEvents = socket.networkEvents(event.handle());
+
+	if (!(networkEvents.lNetworkEvents & FD_CONNECT))
+	    return true;
+
+	wsaError = networkEvents.iErrorCode[FD_CONNECT_BIT];
+    }
+    catch (Exception const &error)
+    {
+	wsaError = error.code().value();
+    }
+
+    if (wsaError)
+	owner.attemptFailed(this, wsaError);
+    else
+	owner.attemptConnected(this);
+
+    return false;
+}
+
+// Interleaves the address families, starting with the family of the first address (RFC 8305
+// section 4, with a First Address Family Count of 1)
+void netsocket::ParallelConnect::start(addrinfo const *addressList)
+{
+    cancel();
+
+    vector<Address> firstFamily, otherFamilies;
+    int family = AF_UNSPEC;
+
+    for (addrinfo const *entry = addressList; entry; entry = entry->ai_next)
+    {
+	if (entry->ai_socktype && entry->ai_socktype != SOCK_STREAM)
+	    continue;
+
+	if (entry->ai_family != AF_INET && entry->ai_family != AF_INET6)
+	    continue;
+
+	Address address { };
+
+	address.addressLength = static_cast<int>(min(static_cast<size_t>(entry->ai_addrlen), sizeof address.address));
+	std::memcpy(&address.address, entry->ai_addr, static_cast<size_t>(address.addressLength));
+
+	if (family == AF_UNSPEC)
+	    family = entry->ai_family;
+
+	(entry->ai_family == family ? firstFamily : otherFamilies).push_back(address);
+    }
+
+    if (firstFamily.empty())
+	throw AddressException(+Error::HostNotFound);
+
+    addresses.clear();
+
+    for (size_t index = 0U; index < firstFamily.size() || index < otherFamilies.size(); index++)
+    {
+	if (index < firstFamily.size())
+	    addresses.push_back(firstFamily[index]);
+
+	if (index < otherFamilies.size())
+	    addresses.push_back(otherFamilies[index]);
+    }
+
+    nextAddress = 0U;
+    lastError = 0;
+    timeoutTickCountMs = eventLoop.tickCountMs() + settings.timeoutMs;
+
+    startAttempts();
+}
+
+void netsocket::ParallelConnect::cancel() noexcept
+{
+    if (pendingDeadline())
+	eventLoop.cancelDeadline(*this);
+
+    for (Attempt *attempt: attempts)
+	eventLoop.enqueueDisposeHandler(attempt);
+
+    attempts.clear();
+}
+
+// Starts the next attempt, skipping over addresses that fail right away (for example with no
+// IPv6 stack on the host), then waits for the attempt delay, the timeout or a connect event
+void netsocket::ParallelConnect::startAttempts()
+{
+    auto dispose = [this](Attempt *attempt) { eventLoop.deallocateHandler(attempt); };
+
+    while (nextAddress < addresses.size() && !eventLoop.full())
+    {
+	unique_ptr<Attempt, decltype(dispose)> attempt(nullptr, dispose);	// until added to attempts
+	bool connected;
+
+	try
+	{
+	    size_t addressIndex = nextAddress++;	// skipped even if the attempt fails
+
+	    attempt.reset(eventLoop.allocateHandler<Attempt>(*this, addressIndex));
+
+	    attempt->socket.selectEvents(attempt->event.handle(), FD_CONNECT);
+
+	    Address const &address = addresses[attempt->addressIndex];
+
+	    attempts.reserve(attempts.size() + 1U);
+	    connected = attempt->socket.connect(reinterpret_cast<sockaddr const *>(&address.address), address.addressLength);
+
+	    if (!connected)
+		eventLoop.addEventHandler(*attempt);
+	}
+	catch (Exception const &error)
+	{
+	    lastError = error.code().value();
+
+	    continue;
+	}
+	catch (EventLoop::EventLoopException const &)
+	{
+	    lastError = +Error::EMFile;
+
+	    continue;
+	}
+
+	attempts.push_back(attempt.release());	// cannot throw, after the reserve() above
+
+	if (connected)
+	{
+	    attemptConnected(attempts.back());
+	    return;
+	}
+
+	break;
+    }
+
+    if (attempts.empty() && nextAddress >= addresses.size())
+	fail(lastError ? lastError : +Error::ETimedOut);
+    else
+    {
+	nextAttemptTickCountMs = eventLoop.tickCountMs() + settings.attemptDelayMs;
+	scheduleDeadline();
+    }
+}
+
+void netsocket::ParallelConnect::scheduleDeadline()
+{
+    ULONGLONG targetTickCountMs = timeoutTickCountMs;
+
+    if (nextAddress < addresses.size())
+	targetTickCountMs = min(targetTickCountMs, nextAttemptTickCountMs);
+
+    ULONGLONG currentTickCountMs = eventLoop.tickCountMs();
+
+    eventLoop.setDeadline(*this, targetTickCountMs > currentTickCountMs ? static_cast<std::uint_least32_t>(targetTickCountMs - currentTickCountMs) : 0U);
+}
+
+void netsocket::ParallelConnect::removeAttempt(Attempt *attempt) noexcept
+{
+    attempts.erase(std::find(attempts.begin(), attempts.end(), attempt));
+    eventLoop.enqueueDisposeHandler(attempt);
+}
+
+void netsocket::ParallelConnect::onDeadline(EventLoop &)
+{
+    if (eventLoop.tickCountMs() >= timeoutTickCountMs)
+	fail(+Error::ETimedOut);
+    else
+	if (nextAddress < addresses.size() && eventLoop.tickCountMs() >= nextAttemptTickCountMs)
+	    startAttempts();
+	else
+	    scheduleDeadline();
+}
+
+void netsocket::ParallelConnect::attemptConnected(Attempt *attempt)
+{
+    Socket socket(std::move(attempt->socket));
+    Address address = addresses[attempt->addressIndex];
+
+    socket.selectEvents(attempt->event.handle(), 0);
+    cancel();
+
+    connectHandler.onConnect(eventLoop, std::move(socket), reinterpret_cast<sockaddr const *>(&address.address), address.addressLength);
+}
+
+void netsocket::ParallelConnect::attemptFailed(Attempt *attempt, int wsaError)
+{
+    lastError = wsaError;
+    removeAttempt(attempt);
+
+    if (nextAddress < addresses.size())
+	startAttempts();
+    else
+	if (attempts.empty())
+	    fail(wsaError);
+}
+
+void netsocket::ParallelConnect::fail(int wsaError)
+{
+    cancel();
+
+    Exception error(wsaError);
+
+    connectHandler.onConnectError(eventLoop, error);
+}
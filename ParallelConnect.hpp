@@ -0,0 +1,141 @@
+#if !defined(WINSOCK2_CXX_PARALLEL_CONNECT)
+#define WINSOCK2_CXX_PARALLEL_CONNECT
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <system_error>
+
+#include "SocketError.hpp"
+#include "AddressInfoError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+
+namespace netsocket
+{
+    // Asynchronous TCP connect over all the addresses from name resolution, racing them with
+    // staggered starts as in Happy Eyeballs v2 (RFC 8305). Addresses are tried in the order from
+    // getaddrinfo(), with the address families interleaved. A new attempt starts each time the
+    // attempt delay expires, or right away when an attempt fails, while the earlier attempts keep
+    // going. The first socket to connect wins, and all other attempts are closed.
+    //
+    // Each attempt in progress takes one event in the loop.
+    class ParallelConnect: protected EventLoop::DeadlineHandler
+    {
+    public:
+	class ConnectHandler
+	{
+	public:
+	    // The socket is non-blocking, with no network events selected
+	    virtual void onConnect(EventLoop &eventLoop, Socket &&socket, sockaddr const *address, int addressLength) = 0;
+
+	    // With an Error code from the last failed attempt, or Error::ETimedOut
+	    virtual void onConnectError(EventLoop &eventLoop, std::system_error const &error) = 0;
+
+	    virtual ~ConnectHandler();
+	};
+
+	struct Settings
+	{
+	    std::uint_least32_t attemptDelayMs = 250U;		// RFC 8305 Connection Attempt Delay
+	    std::uint_least32_t timeoutMs = 30000U;		// for the whole operation
+	};
+
+	// Throws AddressException with Error::HostNotFound when the list has no stream addresses.
+	// If every address fails right away, the handler is called before start() returns.
+	void start(addrinfo const *addressList);
+	void cancel() noexcept;
+	bool running() const noexcept;
+
+	ParallelConnect(Library &socketLib, EventLoop &eventLoop, ConnectHandler &connectHandler);
+	ParallelConnect(Library &socketLib, EventLoop &eventLoop, ConnectHandler &connectHandler, Settings const &settings);
+	~ParallelConnect();
+	ParallelConnect(ParallelConnect const &other) = delete;
+	ParallelConnect &operator =(ParallelConnect const &other) = delete;
+
+    protected:
+	class Attempt;
+
+	struct Address
+	{
+	    sockaddr_storage address;
+	    int addressLength;
+	};
+
+	Library &socketLib;
+	EventLoop &eventLoop;
+	ConnectHandler &connectHandler;
+	Settings settings;
+	std::vector<Address> addresses;		// interleaved by family
+	std::size_t nextAddress = 0U;
+	std::vector<Attempt *> attempts;	// in progress
+	ULONGLONG nextAttemptTickCountMs = 0U, timeoutTickCountMs = 0U;
+	int lastError = 0;
+
+	void startAttempts();
+	void scheduleDeadline();
+	void removeAttempt(Attempt *attempt) noexcept;
+	void attemptConnected(Attempt *attempt);
+	void attemptFailed(Attempt *attempt, int wsaError);
+	void fail(int wsaError);
+
+	virtual void onDeadline(EventLoop &eventLoop) override;
+
+	friend class Attempt;
+    };
+
+    class ParallelConnect::Attempt: public EventLoop::EventHandler
+    {
+    protected:
+	ParallelConnect &owner;
+	Socket socket;
+	Event event;
+	std::size_t addressIndex;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+	virtual void onLoopQuit(EventLoop &eventLoop) override;
+
+	Attempt(ParallelConnect &owner, std::size_t addressIndex);
+
+	friend class ParallelConnect;
+	friend class EventLoop;		// for allocateHandler()
+    };
+}
+
+inline netsocket::ParallelConnect::ConnectHandler::~ConnectHandler()
+{
+}
+
+inline bool netsocket::ParallelConnect::running() const noexcept
+{
+    return !attempts.empty() || pendingDeadline();
+}
+
+inline netsocket::ParallelConnect::ParallelConnect(Library &socketLib, EventLoop &eventLoop, ConnectHandler &connectHandler)
+    : ParallelConnect(socketLib, eventLoop, connectHandler, Settings())
+{
+}
+
+inline netsocket::ParallelConnect::ParallelConnect(Library &socketLib, EventLoop &eventLoop, ConnectHandler &connectHandler, Settings const &settings)
+    : socketLib(socketLib), eventLoop(eventLoop), connectHandler(connectHandler), settings(settings)
+{
+}
+
+inline netsocket::ParallelConnect::~ParallelConnect()
+{
+    cancel();
+}
+
+inline netsocket::EventHandle netsocket::ParallelConnect::Attempt::eventHandle()
+{
+    return event.handle();
+}
+
+#endif // !defined(WINSOCK2_CXX_PARALLEL_CONNECT)
@@ -0,0 +1,53 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include "SocketError.hpp"
+#include "ProcessExitHandler.hpp"
+
+netsocket::ProcessExitHandler::ProcessExitHandler(EventLoop &eventLoop, DWORD processId)
+    : eventLoop(eventLoop), hProcess(::OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId)), dwProcessId(processId)
+{
+    if (!hProcess)
+	raiseError(static_cast<int>(::GetLastError()));
+
+    start();
+}
+
+netsocket::ProcessExitHandler::ProcessExitHandler(EventLoop &eventLoop, HANDLE hProcess)
+    : eventLoop(eventLoop), hProcess(nullptr), dwProcessId(::GetProcessId(hProcess))
+{
+    if (!::DuplicateHandle(::GetCurrentProcess(), hProcess, ::GetCurrentProcess(), &this->hProcess, 0U, FALSE, DUPLICATE_SAME_ACCESS))
+	raiseError(static_cast<int>(::GetLastError()));
+
+    start();
+}
+
+netsocket::ProcessExitHandler::~ProcessExitHandler()
+{
+    eventLoop.removeEventHandler(handlerId);
+    ::CloseHandle(hProcess);
+}
+
+void netsocket::ProcessExitHandler::start()
+{
+    try
+    {
+	handlerId = eventLoop.addEventHandler(*this);
+    }
+    catch (...)
+    {
+	::CloseHandle(hProcess);
+	throw;
+    }
+}
+
+bool netsocket::ProcessExitHandler::onEventTrigger(EventLoop &eventLoop)
+{
+    if (!::GetExitCodeProcess(hProcess, &dwExitCode))
+	raiseError(static_cast<int>(::GetLastError()));
+
+    processExited = true;
+    onProcessExit(eventLoop, dwExitCode);
+
+    return false;
+}
@@ -0,0 +1,68 @@
+#if !defined(WINSOCK2_CXX_PROCESS_EXIT_HANDLER)
+#define WINSOCK2_CXX_PROCESS_EXIT_HANDLER
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    // Exit of another process, dispatched on the event loop. The process handle is signaled when
+    // the process ends, and goes in the wait set in place of an event, so there is no thread or
+    // polling for it. The handler leaves the loop after onProcessExit(), and takes one loop event
+    // until then.
+    class ProcessExitHandler: public EventLoop::EventHandler
+    {
+    public:
+	DWORD processId() const noexcept;
+	bool exited() const noexcept;
+	DWORD exitCode() const noexcept;		// STILL_ACTIVE until the exit is dispatched
+
+	// With a process handle, like the one from CreateProcess(), that is duplicated and can be
+	// closed after the call. The handle needs SYNCHRONIZE and PROCESS_QUERY_LIMITED_INFORMATION.
+	ProcessExitHandler(EventLoop &eventLoop, DWORD processId);
+	ProcessExitHandler(EventLoop &eventLoop, HANDLE hProcess);
+	~ProcessExitHandler();
+	ProcessExitHandler(ProcessExitHandler const &other) = delete;
+	ProcessExitHandler &operator =(ProcessExitHandler const &other) = delete;
+
+    protected:
+	EventLoop &eventLoop;
+	HANDLE hProcess;
+	DWORD dwProcessId;
+	DWORD dwExitCode = STILL_ACTIVE;
+	bool processExited = false;
+	EventLoop::HandlerId handlerId;
+
+	virtual void onProcessExit(EventLoop &eventLoop, DWORD dwExitCode) = 0;
+
+	void start();
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+    };
+}
+
+inline DWORD netsocket::ProcessExitHandler::processId() const noexcept
+{
+    return dwProcessId;
+}
+
+inline bool netsocket::ProcessExitHandler::exited() const noexcept
+{
+    return processExited;
+}
+
+inline DWORD netsocket::ProcessExitHandler::exitCode() const noexcept
+{
+    return dwExitCode;
+}
+
+inline netsocket::EventHandle netsocket::ProcessExitHandler::eventHandle()
+{
+    return EventHandle(hProcess);
+}
+
+#endif // !defined(WINSOCK2_CXX_PROCESS_EXIT_HANDLER)
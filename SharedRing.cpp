@@ -0,0 +1,251 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <string>
+
+#include "SocketError.hpp"
+#include "SharedRing.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::uint_least64_t;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_seq_cst;
+using std::atomic_thread_fence;
+using std::string;
+
+void netsocket::SharedRing::open(char const *name, size_t capacity, bool create)
+{
+    size_t ringCapacity = minCapacity;
+
+    while (ringCapacity < capacity)
+	ringCapacity <<= 1;
+
+    uint_least64_t mappingSize = sizeof(Header) + static_cast<uint_least64_t>(ringCapacity);
+
+    if (create)
+	hMapping = ::CreateFileMappingA
+	    (
+		INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(mappingSize >> 32), static_cast<DWORD>(mappingSize & 0xFFFFFFFFU),
+		name
+	    );
+    else
+	hMapping = ::OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+
+    if (!hMapping)
+	raiseError(static_cast<int>(::GetLastError()));
+
+    bool initialize = create && ::GetLastError() != ERROR_ALREADY_EXISTS;
+
+    try
+    {
+	void *view = ::MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0U, 0U, 0U);
+
+	if (!view)
+	    raiseError(static_cast<int>(::GetLastError()));
+
+	header = static_cast<Header *>(view);
+
+	if (initialize)
+	{
+	    // New mappings are zero-filled, so only the constant fields need writing
+	    header->version = ringVersion;
+	    header->capacity = ringCapacity;
+	    header->magic.store(ringMagic, memory_order_release);
+	}
+	else
+	{
+	    // The creating process may still be initializing the header
+	    for (unsigned spin = 0U; header->magic.load(memory_order_acquire) != ringMagic; spin++)
+		if (spin < 1000U)
+		    ::SwitchToThread();
+		else
+		    raiseError(Error::InvalidParameter);
+
+	    ringCapacity = static_cast<size_t>(header->capacity);
+
+	    if (header->version != ringVersion || ringCapacity < minCapacity || ringCapacity & (ringCapacity - 1U))
+		raiseError(Error::InvalidParameter);
+	}
+
+	data = static_cast<unsigned char *>(view) + sizeof(Header);
+	mask = ringCapacity - 1U;
+
+	// Auto-reset, so waking the consumer also re-arms the doorbell
+	hDoorbell = ::CreateEventA(nullptr, FALSE, FALSE, (string(name) + ".doorbell").c_str());
+
+	if (!hDoorbell)
+	    raiseError(static_cast<int>(::GetLastError()));
+    }
+    catch (...)
+    {
+	if (header)
+	    ::UnmapViewOfFile(header);
+
+	::CloseHandle(hMapping);
+
+	throw;
+    }
+}
+
+netsocket::SharedRing::~SharedRing()
+{
+    ::CloseHandle(hDoorbell);
+    ::UnmapViewOfFile(header);
+    ::CloseHandle(hMapping);
+}
+
+bool netsocket::SharedRing::Producer::tryReserve(size_t length, Reservation &reservation) noexcept
+{
+    if (length > ring.maxMessageLength())
+	return false;
+
+    Header &header = *ring.header;
+    size_t size = recordSize(length), capacity = ring.capacity();
+    uint_least64_t position = header.reservePosition.load(memory_order_relaxed), end;
+    size_t contiguous;
+
+    // A message that does not fit before the end of the ring is preceded by a padding record up to
+    // the end, so every message is contiguous and can be read in place
+    do
+    {
+	contiguous = capacity - static_cast<size_t>(position & ring.mask);
+	end = position + (size <= contiguous ? size : contiguous + size);
+
+	if (end - header.readPosition.load(memory_order_acquire) > capacity)
+	    return false;
+    }
+    while (!header.reservePosition.compare_exchange_weak(position, end, memory_order_relaxed));
+
+    if (size > contiguous)
+    {
+	Record *padding = ring.recordAt(position);
+
+	padding->length = static_cast<uint_least32_t>(contiguous - sizeof(Record));
+	padding->flags.store(paddingRecord | committedRecord, memory_order_release);
+    }
+
+    Record *record = ring.recordAt(end - size);
+
+    record->length = static_cast<uint_least32_t>(length);
+
+    reservation.data = record + 1;
+    reservation.length = length;
+    reservation.position = position;
+    reservation.end = end;
+
+    return true;
+}
+
+void netsocket::SharedRing::Producer::commit(Reservation const &reservation) noexcept
+{
+    Record *record = static_cast<Record *>(reservation.data) - 1;
+
+    record->flags.store(committedRecord, memory_order_release);
+
+    // Pairs with the fence in Consumer::onEventTrigger(): either the consumer sees the committed
+    // record, or this producer sees the consumer waiting
+    atomic_thread_fence(memory_order_seq_cst);
+    ring.ringDoorbell();
+}
+
+netsocket::SharedRing::Consumer::Consumer(SharedRing &ring, unsigned dispatchBudget)
+    : ring(ring), dispatchBudget(dispatchBudget)
+{
+    readPosition = ring.header->readPosition.load(memory_order_acquire);
+
+    // First trigger drains anything already in the ring, then waits on the doorbell
+    ring.header->consumerWaiting.store(0U, memory_order_relaxed);
+    ::SetEvent(ring.hDoorbell);
+}
+
+bool netsocket::SharedRing::Consumer::front(void const *&message, size_t &length) noexcept
+{
+    for (;;)
+    {
+	Record *record = ring.recordAt(readPosition);
+	uint_least32_t flags = record->flags.load(memory_order_acquire);
+
+	if (!(flags & committedRecord))
+	    return false;
+
+	// The padding space after the header was never written
+	if (flags & paddingRecord)
+	{
+	    readPosition += sizeof(Record) + record->length;
+	    record->length = 0U;
+	    record->flags.store(0U, memory_order_relaxed);
+	    continue;
+	}
+
+	message = record + 1;
+	length = record->length;
+
+	return true;
+    }
+}
+
+// The record is zeroed, as later records may start anywhere in its space
+void netsocket::SharedRing::Consumer::pop() noexcept
+{
+    Record *record = ring.recordAt(readPosition);
+    size_t length = record->length;
+
+    std::memset(static_cast<void *>(record + 1), 0, length);
+    record->length = 0U;
+    record->flags.store(0U, memory_order_relaxed);
+
+    readPosition += recordSize(length);
+    ring.header->readPosition.store(readPosition, memory_order_release);
+}
+
+bool netsocket::SharedRing::Consumer::onEventTrigger(EventLoop &eventLoop)
+{
+    void const *message;
+    size_t length;
+
+    for (unsigned count = 0U; count < dispatchBudget; count++)
+    {
+	if (!front(message, length))
+	{
+	    ring.header->consumerWaiting.store(1U, memory_order_relaxed);
+	    atomic_thread_fence(memory_order_seq_cst);
+
+	    if (!front(message, length))
+		return true;
+
+	    ring.header->consumerWaiting.store(0U, memory_order_relaxed);
+	}
+
+	bool keepHandler;
+
+	try
+	{
+	    keepHandler = onMessage(eventLoop, message, length);
+	}
+	catch (...)
+	{
+	    pop();
+	    ::SetEvent(ring.hDoorbell);
+
+	    throw;
+	}
+
+	pop();
+
+	if (!keepHandler)
+	    return false;
+    }
+
+    // Budget used up with messages left, come back after the other handlers had their turn
+    ::SetEvent(ring.hDoorbell);
+
+    return true;
+}
@@ -0,0 +1,195 @@
+#if !defined(WINSOCK2_CXX_SHARED_RING)
+#define WINSOCK2_CXX_SHARED_RING
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+#include "SocketError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    // Message ring in named shared memory, for processes on the same host. Any number of Producer
+    // objects (in any process) append messages, and one Consumer reads them in place, as an event
+    // handler in its event loop. The doorbell event is only set when the consumer has found the ring
+    // empty and is waiting, so a busy consumer costs the producers no system calls.
+    //
+    // Each message is published with a flag in its own record, so producers never wait for each
+    // other. The consumer stops at the first message not committed yet, and zeroes the records it
+    // reads. A producer that dies between tryReserve() and commit() leaves its message uncommitted,
+    // and the other producers then find the ring full once it wraps around to it.
+    class SharedRing
+    {
+    public:
+	class Producer;
+	class Consumer;
+
+	struct Reservation
+	{
+	    void		*data;
+	    std::size_t		 length;
+	    std::uint_least64_t	 position, end;
+	};
+
+	static constexpr std::size_t minCapacity = 4096U;
+
+	std::size_t capacity() const noexcept;
+	std::size_t maxMessageLength() const noexcept;
+
+	~SharedRing();
+	SharedRing(Library &socketLib, char const *name, std::size_t capacity);		// create, or open existing
+	SharedRing(Library &socketLib, char const *name);					// open existing
+	SharedRing(SharedRing const &other) = delete;
+	SharedRing &operator =(SharedRing const &other) = delete;
+
+    protected:
+	static std::uint_least32_t const ringMagic = 0x474E5252U;	// "RRNG"
+	static std::uint_least32_t const ringVersion = 2U;
+	static std::uint_least32_t const paddingRecord = 1U;
+	static std::uint_least32_t const committedRecord = 2U;
+
+	// Positions are byte counts since the ring was created, that only ever increase
+	struct alignas(64) Header
+	{
+	    std::atomic<std::uint_least32_t> magic;
+	    std::uint_least32_t version;
+	    std::uint_least64_t capacity;
+
+	    alignas(64) std::atomic<std::uint_least64_t> reservePosition;	// producers claim space here
+	    alignas(64) std::atomic<std::uint_least64_t> readPosition;		// space before it is free again
+	    alignas(64) std::atomic<std::uint_least32_t> consumerWaiting;
+	};
+
+	// Free space is all zero, so a record is not committed until its flags are set
+	struct Record
+	{
+	    std::uint_least32_t length;
+	    std::atomic<std::uint_least32_t> flags;
+	};
+
+	HANDLE		 hMapping = nullptr;
+	HANDLE		 hDoorbell = nullptr;
+	Header		*header = nullptr;
+	unsigned char	*data = nullptr;
+	std::size_t	 mask = 0U;
+
+	static std::size_t recordSize(std::size_t length) noexcept;
+	Record *recordAt(std::uint_least64_t position) const noexcept;
+	void open(char const *name, std::size_t capacity, bool create);
+	void ringDoorbell() noexcept;
+	EventHandle doorbell() const;
+    };
+
+    class SharedRing::Producer
+    {
+    protected:
+	SharedRing &ring;
+
+    public:
+	// Reserve space for a message, to be written in place and then committed. Fails when the
+	// ring is full. Messages are read in reservation order, so a message is only seen after the
+	// ones reserved before it are committed too.
+	bool tryReserve(std::size_t length, Reservation &reservation) noexcept;
+	void commit(Reservation const &reservation) noexcept;
+
+	bool tryWrite(void const *message, std::size_t length) noexcept;
+
+	Producer(SharedRing &ring);
+    };
+
+    class SharedRing::Consumer: public EventLoop::EventHandler
+    {
+    protected:
+	SharedRing &ring;
+	std::uint_least64_t readPosition;
+	unsigned dispatchBudget;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+
+	// Called for each message, with the data still in the ring. Return false to stop
+	// consuming and remove the handler from the loop.
+	virtual bool onMessage(EventLoop &eventLoop, void const *message, std::size_t length) = 0;
+
+    public:
+	// Pull interface, for use outside onMessage(): front() skips to the next complete message, if
+	// any, and pop() releases it, after which its data may be overwritten.
+	bool front(void const *&message, std::size_t &length) noexcept;
+	void pop() noexcept;
+
+	Consumer(SharedRing &ring, unsigned dispatchBudget = 256U);
+    };
+}
+
+inline std::size_t netsocket::SharedRing::capacity() const noexcept
+{
+    return mask + 1U;
+}
+
+inline std::size_t netsocket::SharedRing::maxMessageLength() const noexcept
+{
+    return capacity() / 2U - sizeof(Record);
+}
+
+inline std::size_t netsocket::SharedRing::recordSize(std::size_t length) noexcept
+{
+    return (sizeof(Record) + length + 7U) & ~static_cast<std::size_t>(7U);
+}
+
+inline netsocket::SharedRing::Record *netsocket::SharedRing::recordAt(std::uint_least64_t position) const noexcept
+{
+    return static_cast<Record *>(static_cast<void *>(data + (position & mask)));
+}
+
+inline void netsocket::SharedRing::ringDoorbell() noexcept
+{
+    if (header->consumerWaiting.load() && header->consumerWaiting.exchange(0U))
+	::SetEvent(hDoorbell);
+}
+
+inline netsocket::EventHandle netsocket::SharedRing::doorbell() const
+{
+    return EventHandle(hDoorbell);
+}
+
+inline netsocket::SharedRing::SharedRing(Library &, char const *name, std::size_t capacity)
+{
+    open(name, capacity, true);
+}
+
+inline netsocket::SharedRing::SharedRing(Library &, char const *name)
+{
+    open(name, 0U, false);
+}
+
+inline netsocket::SharedRing::Producer::Producer(SharedRing &ring)
+    : ring(ring)
+{
+}
+
+inline bool netsocket::SharedRing::Producer::tryWrite(void const *message, std::size_t length) noexcept
+{
+    Reservation reservation;
+
+    if (!tryReserve(length, reservation))
+	return false;
+
+    std::memcpy(reservation.data, message, length);
+    commit(reservation);
+
+    return true;
+}
+
+inline netsocket::EventHandle netsocket::SharedRing::Consumer::eventHandle()
+{
+    return ring.doorbell();
+}
+
+#endif // !defined(WINSOCK2_CXX_SHARED_RING)
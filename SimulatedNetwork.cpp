@@ -0,0 +1,227 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+#include "SocketError.hpp"
+#include "SimulatedNetwork.hpp"
+
+using std::size_t;
+using std::uint_least64_t;
+using std::shared_ptr;
+using std::weak_ptr;
+using std::vector;
+using std::function;
+using std::move;
+using std::min;
+using std::max;
+
+netsocket::BaseException::Tag const netsocket::simulationTag { "Simulated network" };
+
+void netsocket::SimulatedNetwork::schedule(uint_least64_t delayUs, function<void ()> action)
+{
+    actions.push({ currentUs + delayUs, nextSequence++, move(action) });
+}
+
+void netsocket::SimulatedNetwork::runUntil(uint_least64_t timeUs)
+{
+    while (!actions.empty() && actions.top().timeUs <= timeUs)
+    {
+	function<void ()> run = move(const_cast<Action &>(actions.top()).run);
+
+	currentUs = max(currentUs, actions.top().timeUs);
+	actions.pop();
+	run();
+    }
+
+    currentUs = max(currentUs, timeUs);
+}
+
+DWORD netsocket::SimulatedNetwork::waitForEvents(DWORD eventCount, WSAEVENT const *events, DWORD dwTimeoutMs)
+{
+    uint_least64_t deadlineUs = dwTimeoutMs == WSA_INFINITE
+	? std::numeric_limits<uint_least64_t>::max()
+	: currentUs + static_cast<uint_least64_t>(dwTimeoutMs) * 1000U;
+
+    waits++;
+
+    for (;;)
+    {
+	for (DWORD index = 0U; index < eventCount; index++)
+	    if (static_cast<Event const *>(events[index])->signaled)
+		return WSA_WAIT_EVENT_0 + index;
+
+	// Nothing is ready, so skip the idle time up to the next action
+	if (actions.empty() || actions.top().timeUs > deadlineUs)
+	{
+	    if (dwTimeoutMs == WSA_INFINITE)
+		throw SimulationStalled();
+
+	    currentUs = max(currentUs, deadlineUs);
+
+	    return WSA_WAIT_TIMEOUT;
+	}
+
+	function<void ()> run = move(const_cast<Action &>(actions.top()).run);
+
+	currentUs = max(currentUs, actions.top().timeUs);
+	actions.pop();
+	run();
+    }
+}
+
+void netsocket::SimulatedNetwork::connect(Socket &first, Socket &second, LinkProfile const &profile)
+{
+    first.endpoint->peer = second.endpoint;
+    first.endpoint->profile = profile;
+    second.endpoint->peer = first.endpoint;
+    second.endpoint->profile = profile;
+
+    first.endpoint->signal(FD_WRITE);
+    second.endpoint->signal(FD_WRITE);
+}
+
+// Data leaves at the link rate, after anything still being sent, and arrives one latency later,
+// plus one retransmit delay for each loss. Arrivals never overtake earlier data on the stream.
+void netsocket::SimulatedNetwork::transmit(shared_ptr<Endpoint> const &sender, vector<unsigned char> &&data, bool finish)
+{
+    LinkProfile const &profile = sender->profile;
+    uint_least64_t departureUs = max(currentUs, sender->linkFreeUs);
+
+    if (profile.bandwidthBytesPerSec)
+	departureUs += (static_cast<uint_least64_t>(data.size()) * 1000000U + profile.bandwidthBytesPerSec - 1U) / profile.bandwidthBytesPerSec;
+
+    sender->linkFreeUs = departureUs;
+
+    uint_least64_t arrivalUs = departureUs + profile.latencyUs;
+
+    if (profile.lossRate > 0.0)
+    {
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+	while (uniform(random) < profile.lossRate)
+	    arrivalUs += profile.retransmitUs;
+    }
+
+    arrivalUs = max(arrivalUs, sender->lastArrivalUs);
+    sender->lastArrivalUs = arrivalUs;
+
+    weak_ptr<Endpoint> receiver = sender->peer;
+
+    schedule
+	(
+	    arrivalUs - currentUs,
+	    [receiver, data = move(data), finish]()
+	    {
+		shared_ptr<Endpoint> endpoint = receiver.lock();
+
+		if (!endpoint || !endpoint->open)
+		    return;
+
+		if (finish)
+		{
+		    endpoint->peerFinished = true;
+		    endpoint->signal(FD_CLOSE);
+		}
+		else
+		{
+		    endpoint->received.insert(endpoint->received.end(), data.begin(), data.end());
+		    endpoint->signal(FD_READ);
+		}
+	    }
+	);
+}
+
+int netsocket::SimulatedNetwork::Socket::send(void const *data, size_t length)
+{
+    if (endpoint->finished)
+	raiseError(Error::EShutDown);
+
+    if (!endpoint->peer.lock())
+	raiseError(Error::ENotConn);
+
+    size_t window = endpoint->profile.windowBytes - min(endpoint->inFlight, endpoint->profile.windowBytes);
+
+    if (!window)
+    {
+	endpoint->writeBlocked = true;
+	return 0;
+    }
+
+    unsigned char const *bytes = static_cast<unsigned char const *>(data);
+
+    length = min(length, window);
+    endpoint->inFlight += length;
+    network.transmit(endpoint, vector<unsigned char>(bytes, bytes + length), false);
+
+    return static_cast<int>(length);
+}
+
+int netsocket::SimulatedNetwork::Socket::receive(void *data, size_t length)
+{
+    size_t available = endpoint->received.size() - endpoint->readOffset;
+
+    if (!available)
+	return endpoint->peerFinished ? 0 : -1;
+
+    length = min(length, available);
+    std::memcpy(data, endpoint->received.data() + endpoint->readOffset, length);
+    endpoint->readOffset += length;
+
+    if (endpoint->readOffset == endpoint->received.size())
+    {
+	endpoint->received.clear();
+	endpoint->readOffset = 0U;
+    }
+    else
+	endpoint->signal(FD_READ);		// more data left, like FD_READ after a partial recv()
+
+    // The window opens on the sender side when the acknowledgment gets back
+    weak_ptr<Endpoint> sender = endpoint->peer;
+
+    network.schedule
+	(
+	    endpoint->profile.latencyUs,
+	    [sender, length]()
+	    {
+		shared_ptr<Endpoint> endpoint = sender.lock();
+
+		if (!endpoint)
+		    return;
+
+		endpoint->inFlight -= min(endpoint->inFlight, length);
+
+		if (endpoint->writeBlocked && endpoint->open)
+		{
+		    endpoint->writeBlocked = false;
+		    endpoint->signal(FD_WRITE);
+		}
+	    }
+	);
+
+    return static_cast<int>(length);
+}
+
+void netsocket::SimulatedNetwork::Socket::shutdown()
+{
+    if (endpoint->finished || !endpoint->peer.lock())
+	return;
+
+    endpoint->finished = true;
+    network.transmit(endpoint, vector<unsigned char>(), true);
+}
+
+netsocket::SimulatedNetwork::Socket::~Socket()
+{
+    shutdown();
+    endpoint->open = false;
+}
@@ -0,0 +1,256 @@
+#if !defined(WINSOCK2_CXX_SIMULATED_NETWORK)
+#define WINSOCK2_CXX_SIMULATED_NETWORK
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <stdexcept>
+
+#include "SocketError.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    extern BaseException::Tag const simulationTag;
+
+    class SimulationStalled: public BaseExceptionType<simulationTag>, public std::runtime_error
+    {
+    public:
+	SimulationStalled();
+
+	virtual char const *what() const noexcept override;
+	virtual std::uintptr_t baseErrorCode() const noexcept override;
+    };
+
+    // Event loop backend with a virtual clock and in-memory stream sockets, for deterministic
+    // performance tests. When no event in the wait set is signaled, the clock jumps straight to
+    // the next scheduled action (packet arrival, timer or traffic source), so idle time costs
+    // nothing and hours of traffic replay in seconds. Given the same seed and the same sequence of
+    // calls, every run produces the same timings.
+    //
+    // A loop using this backend may only wait on simulated events (Event and Socket objects below).
+    class SimulatedNetwork: public EventLoop::Backend
+    {
+    public:
+	class Event;
+	class Socket;
+
+	struct LinkProfile
+	{
+	    std::uint_least32_t latencyUs = 100U;		// one way
+	    std::uint_least64_t bandwidthBytesPerSec = 0U;	// 0 for unlimited
+	    double lossRate = 0.0;				// probability a send is lost and retransmitted
+	    std::uint_least32_t retransmitUs = 200000U;	// delay added for each loss
+	    std::size_t windowBytes = 65536U;			// unread plus in flight data, per direction
+	};
+
+	std::uint_least64_t nowUs() const noexcept;
+	std::uint_least64_t waitCount() const noexcept;
+	std::uint_least64_t busyUs() const noexcept;
+
+	// Runs the action at the given virtual time from now, from inside a wait or sleep
+	void schedule(std::uint_least64_t delayUs, std::function<void ()> action);
+
+	// Charges simulated CPU time to the caller, running any actions that come due meanwhile
+	void advance(std::uint_least64_t elapsedUs);
+
+	void connect(Socket &first, Socket &second, LinkProfile const &profile);
+
+	virtual ULONGLONG tickCountMs() override;
+	virtual DWORD waitForEvents(DWORD eventCount, WSAEVENT const *events, DWORD dwTimeoutMs) override;
+	virtual void sleep(DWORD dwTimeoutMs) override;
+
+	SimulatedNetwork(std::uint_least64_t seed = 1U);
+	SimulatedNetwork(SimulatedNetwork const &other) = delete;
+	SimulatedNetwork &operator =(SimulatedNetwork const &other) = delete;
+
+    protected:
+	struct Endpoint;
+
+	struct Action
+	{
+	    std::uint_least64_t timeUs;
+	    std::uint_least64_t sequence;
+	    std::function<void ()> run;
+
+	    bool operator >(Action const &other) const noexcept;
+	};
+
+	std::uint_least64_t currentUs = 0U, nextSequence = 0U, waits = 0U, chargedUs = 0U;
+	std::priority_queue<Action, std::vector<Action>, std::greater<Action>> actions;
+	std::mt19937_64 random;
+
+	void runUntil(std::uint_least64_t timeUs);
+	void transmit(std::shared_ptr<Endpoint> const &sender, std::vector<unsigned char> &&data, bool finish);
+    };
+
+    // Manual-reset event, the simulated counterpart of a WSAEVENT
+    class SimulatedNetwork::Event
+    {
+    protected:
+	bool signaled = false;
+
+	friend class SimulatedNetwork;
+
+    public:
+	EventHandle handle();
+	void set() noexcept;
+	void reset() noexcept;
+	bool isSet() const noexcept;
+
+	Event() = default;
+	Event(Event const &other) = delete;
+	Event &operator =(Event const &other) = delete;
+    };
+
+    // One end of a simulated stream connection. The calls follow netsocket::Socket, and the
+    // event is signaled with FD_READ, FD_WRITE and FD_CLOSE network events like WSAEventSelect().
+    class SimulatedNetwork::Socket
+    {
+    protected:
+	SimulatedNetwork &network;
+	std::shared_ptr<Endpoint> endpoint;
+
+	friend class SimulatedNetwork;
+
+    public:
+	EventHandle eventHandle();
+	long networkEvents() noexcept;			// also resets the event
+
+	int send(void const *data, std::size_t length);	// 0 when the window is full
+	int receive(void *data, std::size_t length);	// 0 at end of stream, -1 when no data
+	void shutdown();
+
+	Socket(SimulatedNetwork &network);
+	~Socket();
+	Socket(Socket const &other) = delete;
+	Socket &operator =(Socket const &other) = delete;
+    };
+
+    struct SimulatedNetwork::Endpoint
+    {
+	Event event;
+	long pendingEvents = 0;
+	std::vector<unsigned char> received;
+	std::size_t readOffset = 0U;
+	std::size_t inFlight = 0U;		// sent and not yet read by the peer
+	bool writeBlocked = false, finished = false, peerFinished = false, open = true;
+	std::uint_least64_t linkFreeUs = 0U, lastArrivalUs = 0U;
+	LinkProfile profile;
+	std::weak_ptr<Endpoint> peer;
+
+	void signal(long networkEvent) noexcept;
+    };
+}
+
+inline netsocket::SimulationStalled::SimulationStalled()
+    : runtime_error("Simulated network has no scheduled actions, while the event loop waits forever")
+{
+}
+
+inline char const *netsocket::SimulationStalled::what() const noexcept
+{
+    return this->runtime_error::what();
+}
+
+inline std::uintptr_t netsocket::SimulationStalled::baseErrorCode() const noexcept
+{
+    return 0U;
+}
+
+inline bool netsocket::SimulatedNetwork::Action::operator >(Action const &other) const noexcept
+{
+    return timeUs != other.timeUs ? timeUs > other.timeUs : sequence > other.sequence;
+}
+
+inline std::uint_least64_t netsocket::SimulatedNetwork::nowUs() const noexcept
+{
+    return currentUs;
+}
+
+inline std::uint_least64_t netsocket::SimulatedNetwork::waitCount() const noexcept
+{
+    return waits;
+}
+
+inline std::uint_least64_t netsocket::SimulatedNetwork::busyUs() const noexcept
+{
+    return chargedUs;
+}
+
+inline ULONGLONG netsocket::SimulatedNetwork::tickCountMs()
+{
+    return currentUs / 1000U;
+}
+
+inline void netsocket::SimulatedNetwork::sleep(DWORD dwTimeoutMs)
+{
+    runUntil(currentUs + static_cast<std::uint_least64_t>(dwTimeoutMs) * 1000U);
+}
+
+inline void netsocket::SimulatedNetwork::advance(std::uint_least64_t elapsedUs)
+{
+    chargedUs += elapsedUs;
+    runUntil(currentUs + elapsedUs);
+}
+
+inline netsocket::SimulatedNetwork::SimulatedNetwork(std::uint_least64_t seed)
+    : random(seed)
+{
+}
+
+inline netsocket::EventHandle netsocket::SimulatedNetwork::Event::handle()
+{
+    return EventHandle(static_cast<WSAEVENT>(this));
+}
+
+inline void netsocket::SimulatedNetwork::Event::set() noexcept
+{
+    signaled = true;
+}
+
+inline void netsocket::SimulatedNetwork::Event::reset() noexcept
+{
+    signaled = false;
+}
+
+inline bool netsocket::SimulatedNetwork::Event::isSet() const noexcept
+{
+    return signaled;
+}
+
+inline void netsocket::SimulatedNetwork::Endpoint::signal(long networkEvent) noexcept
+{
+    pendingEvents |= networkEvent;
+    event.set();
+}
+
+inline netsocket::EventHandle netsocket::SimulatedNetwork::Socket::eventHandle()
+{
+    return endpoint->event.handle();
+}
+
+inline long netsocket::SimulatedNetwork::Socket::networkEvents() noexcept
+{
+    long events = endpoint->pendingEvents;
+
+    endpoint->pendingEvents = 0;
+    endpoint->event.reset();
+
+    return events;
+}
+
+inline netsocket::SimulatedNetwork::Socket::Socket(SimulatedNetwork &network)
+    : network(network), endpoint(std::make_shared<Endpoint>())
+{
+}
+
+#endif // !defined(WINSOCK2_CXX_SIMULATED_NETWORK)
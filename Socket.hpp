@@ -0,0 +1,225 @@
+#if !defined(WINSOCK2_CXX_SOCKET)
+#define WINSOCK2_CXX_SOCKET
+
+#include <WinSock2.h>
+
+#include <cstddef>
+
+#include "SocketError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEventHandle.hpp"
+
+namespace netsocket
+{
+    // Owning wrapper for a SOCKET handle. Sockets selected for network events with selectEvents()
+    // are non-blocking, so the operations that would block report it in their return value.
+    class Socket
+    {
+    protected:
+	SOCKET hSocket = INVALID_SOCKET;
+
+    public:
+	SOCKET handle() const noexcept;
+	explicit operator bool() const noexcept;
+	SOCKET release() noexcept;
+	void close();
+
+	void bind(sockaddr const *address, int addressLength);
+	void listen(int backlog = SOMAXCONN);
+	Socket accept();						// empty socket when none is pending
+	bool connect(sockaddr const *address, int addressLength);	// false while in progress
+	int send(void const *data, std::size_t length);			// 0 when it would block
+	DWORD send(WSABUF *buffers, DWORD bufferCount);			// gathered send, 0 when it would block
+	int receive(void *data, std::size_t length);			// 0 at end of stream, -1 when it would block
+	void shutdown(int how = SD_SEND);
+
+	void noDelay(bool enable);
+	int localAddress(sockaddr_storage &address) const;
+
+	void selectEvents(EventHandle eventHandle, long networkEvents);
+	WSANETWORKEVENTS networkEvents(EventHandle eventHandle);	// also resets the event
+
+	~Socket();
+	Socket() noexcept = default;
+	Socket(Library &socketLib, int addressFamily, int type = SOCK_STREAM, int protocol = IPPROTO_TCP);
+	explicit Socket(SOCKET hSocket) noexcept;
+	Socket(Socket &&other) noexcept;
+	Socket &operator =(Socket &&other) noexcept;
+	Socket(Socket const &other) = delete;
+	Socket &operator =(Socket const &other) = delete;
+    };
+}
+
+inline SOCKET netsocket::Socket::handle() const noexcept
+{
+    return hSocket;
+}
+
+inline netsocket::Socket::operator bool() const noexcept
+{
+    return hSocket != INVALID_SOCKET;
+}
+
+inline SOCKET netsocket::Socket::release() noexcept
+{
+    SOCKET hReleased = hSocket;
+    hSocket = INVALID_SOCKET;
+
+    return hReleased;
+}
+
+inline void netsocket::Socket::close()
+{
+    if (hSocket != INVALID_SOCKET)
+	wsa_call<SOCKET_ERROR>(::closesocket, release());
+}
+
+inline void netsocket::Socket::bind(sockaddr const *address, int addressLength)
+{
+    wsa_call<SOCKET_ERROR>(::bind, hSocket, address, addressLength);
+}
+
+inline void netsocket::Socket::listen(int backlog)
+{
+    wsa_call<SOCKET_ERROR>(::listen, hSocket, backlog);
+}
+
+inline netsocket::Socket netsocket::Socket::accept()
+{
+    SOCKET hAccepted = wsa_fn_call<INVALID_SOCKET>(::accept, hSocket, static_cast<sockaddr *>(nullptr), static_cast<int *>(nullptr));
+
+    if (hAccepted == INVALID_SOCKET && ::WSAGetLastError() != WSAEWOULDBLOCK)
+	raiseError();
+
+    return Socket(hAccepted);
+}
+
+inline bool netsocket::Socket::connect(sockaddr const *address, int addressLength)
+{
+    if (wsa_fn_call<SOCKET_ERROR>(::connect, hSocket, address, addressLength) == SOCKET_ERROR)
+    {
+	if (::WSAGetLastError() != WSAEWOULDBLOCK)
+	    raiseError();
+
+	return false;
+    }
+
+    return true;
+}
+
+inline int netsocket::Socket::send(void const *data, std::size_t length)
+{
+    int result = ::send(hSocket, static_cast<char const *>(data), static_cast<int>(length), 0);
+
+    if (result == SOCKET_ERROR)
+    {
+	if (::WSAGetLastError() != WSAEWOULDBLOCK)
+	    raiseError();
+
+	return 0;
+    }
+
+    return result;
+}
+
+inline DWORD netsocket::Socket::send(WSABUF *buffers, DWORD bufferCount)
+{
+    DWORD dwSent = 0U;
+
+    if (::WSASend(hSocket, buffers, bufferCount, &dwSent, 0U, nullptr, nullptr) == SOCKET_ERROR)
+    {
+	if (::WSAGetLastError() != WSAEWOULDBLOCK)
+	    raiseError();
+
+	return 0U;
+    }
+
+    return dwSent;
+}
+
+inline int netsocket::Socket::receive(void *data, std::size_t length)
+{
+    int result = ::recv(hSocket, static_cast<char *>(data), static_cast<int>(length), 0);
+
+    if (result == SOCKET_ERROR)
+    {
+	if (::WSAGetLastError() != WSAEWOULDBLOCK)
+	    raiseError();
+
+	return -1;
+    }
+
+    return result;
+}
+
+inline void netsocket::Socket::shutdown(int how)
+{
+    wsa_call<SOCKET_ERROR>(::shutdown, hSocket, how);
+}
+
+inline void netsocket::Socket::noDelay(bool enable)
+{
+    BOOL bNoDelay = enable;
+
+    wsa_call<SOCKET_ERROR>(::setsockopt, hSocket, IPPROTO_TCP, TCP_NODELAY, static_cast<char const *>(static_cast<void const *>(&bNoDelay)), static_cast<int>(sizeof bNoDelay));
+}
+
+inline int netsocket::Socket::localAddress(sockaddr_storage &address) const
+{
+    int addressLength = static_cast<int>(sizeof address);
+
+    wsa_call<SOCKET_ERROR>(::getsockname, hSocket, static_cast<sockaddr *>(static_cast<void *>(&address)), &addressLength);
+
+    return addressLength;
+}
+
+inline void netsocket::Socket::selectEvents(EventHandle eventHandle, long networkEvents)
+{
+    wsa_call<SOCKET_ERROR>(::WSAEventSelect, hSocket, static_cast<WSAEVENT>(eventHandle), networkEvents);
+}
+
+inline WSANETWORKEVENTS netsocket::Socket::networkEvents(EventHandle eventHandle)
+{
+    WSANETWORKEVENTS events;
+
+    wsa_call<SOCKET_ERROR>(::WSAEnumNetworkEvents, hSocket, static_cast<WSAEVENT>(eventHandle), &events);
+
+    return events;
+}
+
+// Use close() to have errors reported
+inline netsocket::Socket::~Socket()
+{
+    if (hSocket != INVALID_SOCKET)
+	::closesocket(hSocket);
+}
+
+inline netsocket::Socket::Socket(Library &, int addressFamily, int type, int protocol)
+    : hSocket(wsa_call<INVALID_SOCKET>(::WSASocketW, addressFamily, type, protocol, static_cast<LPWSAPROTOCOL_INFOW>(nullptr), 0U, static_cast<DWORD>(WSA_FLAG_OVERLAPPED)))
+{
+}
+
+inline netsocket::Socket::Socket(SOCKET hSocket) noexcept
+    : hSocket(hSocket)
+{
+}
+
+inline netsocket::Socket::Socket(Socket &&other) noexcept
+    : hSocket(other.release())
+{
+}
+
+inline netsocket::Socket &netsocket::Socket::operator =(Socket &&other) noexcept
+{
+    if (this != &other)
+    {
+	if (hSocket != INVALID_SOCKET)
+	    ::closesocket(hSocket);
+
+	hSocket = other.release();
+    }
+
+    return *this;
+}
+
+#endif // !defined(WINSOCK2_CXX_SOCKET)
@@ -1,15 +1,25 @@
 #include <WinSock2.h>
 #include <Windows.h>
 
+#include <cstddef>
+#include <cstdio>
+#include <iterator>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <map>
 #include <utility>
 #include <string>
 #include <system_error>
 
 #include "SocketError.hpp"
 
-using std::move;
+using std::size_t;
 using std::string;
-using std::to_string;
+using std::atomic;
+using std::mutex;
+using std::lock_guard;
+using std::map;
 using std::errc;
 using std::error_category;
 using std::error_condition;
@@ -17,223 +27,253 @@ using std::generic_category;
 
 netsocket::BaseException::Tag const netsocket::socketExceptionTag { "WinSock2 API error" };
 
-error_condition netsocket::ErrorCategory::default_error_condition(int ev) const noexcept
+namespace
 {
-    errc code = errc::is_a_directory;
+    using netsocket::Error;
+
+    // No portable condition for the error, that is then its own condition in the WinSock2 category
+    constexpr errc noCondition = static_cast<errc>(0);
+
+    struct ErrorMapping
+    {
+	Error error;
+	errc condition;
+    };
+
+    // Every Error value, sorted, for a binary search. The position also indexes the interned messages.
+    constexpr ErrorMapping errorMappings[] =
+    {
+	{ Error::InvalidHandle,		errc::invalid_argument },	// errc::bad_file_descriptor
+	{ Error::NotEnoughMemory,	errc::not_enough_memory },
+	{ Error::InvalidParameter,	errc::invalid_argument },
+	{ Error::OperationAborted,	errc::operation_canceled },
+	{ Error::IOIncomplete,		errc::resource_unavailable_try_again },
+	{ Error::IOPending,		errc::operation_in_progress },
+	{ Error::EIntr,			errc::interrupted },
+	{ Error::BadF,			errc::bad_file_descriptor },
+	{ Error::EAccess,		errc::permission_denied },
+	{ Error::EFault,		errc::bad_address },
+	{ Error::EInval,		errc::invalid_argument },
+	{ Error::EMFile,		errc::too_many_files_open },
+	{ Error::EWouldBlock,		errc::operation_would_block },
+	{ Error::EInProgress,		errc::operation_in_progress },
+	{ Error::EAlready,		errc::connection_already_in_progress },
+	{ Error::ENotSock,		errc::not_a_socket },
+	{ Error::EDestAddrReq,		errc::destination_address_required },
+	{ Error::EMsgSize,		errc::message_size },
+	{ Error::EProtoType,		errc::wrong_protocol_type },
+	{ Error::EProtoOpt,		errc::no_protocol_option },
+	{ Error::EProtoNoSupport,	errc::protocol_not_supported },
+	{ Error::ESockTNoSupprot,	errc::not_supported },
+	{ Error::EOpNotSupp,		errc::operation_not_supported },
+	{ Error::EPFNoSupport,		errc::address_family_not_supported },
+	{ Error::EAFNoSupport,		errc::address_family_not_supported },
+	{ Error::EAddrInUse,		errc::address_in_use },
+	{ Error::EAddrNotAvail,		errc::address_not_available },
+	{ Error::ENetDown,		errc::network_down },
+	{ Error::ENetUnreach,		errc::network_unreachable },
+	{ Error::ENetReset,		errc::network_reset },
+	{ Error::EConnAborted,		errc::connection_aborted },
+	{ Error::EConnReset,		errc::connection_reset },
+	{ Error::ENoBufS,		errc::no_buffer_space },
+	{ Error::EIsConn,		errc::already_connected },
+	{ Error::ENotConn,		errc::not_connected },
+	{ Error::EShutDown,		errc::broken_pipe },
+	{ Error::ETooManyRefs,		errc::too_many_links },
+	{ Error::ETimedOut,		errc::timed_out },
+	{ Error::EConnRefused,		errc::connection_refused },
+	{ Error::ELoop,			errc::too_many_symbolic_link_levels },
+	{ Error::ENameTooLong,		errc::filename_too_long },
+	{ Error::EHostDown,		errc::host_unreachable },
+	{ Error::EHostUnreach,		errc::host_unreachable },
+	{ Error::ENotEmpty,		errc::directory_not_empty },
+	{ Error::EProcLim,		noCondition },
+	{ Error::EUsers,		noCondition },
+	{ Error::EDQuot,		errc::no_space_on_device },
+	{ Error::EStale,		noCondition },
+	{ Error::ERemote,		noCondition },
+	{ Error::SysNotReady,		noCondition },
+	{ Error::VerNotSupported,	noCondition },
+	{ Error::NotInitialized,	noCondition },
+	{ Error::EDiscon,		errc::not_connected },
+	{ Error::ENoMore,		errc::no_such_file_or_directory },
+	{ Error::ECancelled,		errc::operation_canceled },
+	{ Error::EInvalidProcTable,	noCondition },
+	{ Error::EInvalidProvider,	noCondition },
+	{ Error::EProviderFailedInit,	noCondition },
+	{ Error::SysCallFailure,	noCondition },
+	{ Error::ServiceNotFound,	noCondition },
+	{ Error::TypeNotFound,		noCondition },
+	{ Error::E_No_More,		errc::no_such_file_or_directory },
+	{ Error::E_Cancelled,		errc::operation_canceled },
+	{ Error::ERefused,		errc::connection_refused },
+	{ Error::HostNotFound,		errc::no_such_device_or_address },
+	{ Error::TryAgain,		errc::resource_unavailable_try_again },
+	{ Error::NoRecovery,		errc::state_not_recoverable },
+	{ Error::NoData,		errc::no_message_available },
+	{ Error::QoSReceivers,		noCondition },
+	{ Error::QoSSenders,		noCondition },
+	{ Error::QoSNoSenders,		noCondition },
+	{ Error::QoSNoReceivers,	noCondition },
+	{ Error::QoSRequestConfirmed,	noCondition },
+	{ Error::QoSAdmissionFailure,	noCondition },
+	{ Error::QoSPolicyFailure,	noCondition },
+	{ Error::QoSBadStyle,		noCondition },
+	{ Error::QoSBadObject,		noCondition },
+	{ Error::QoSTrafficCtrlError,	noCondition },
+	{ Error::QoSGenericError,	noCondition },
+	{ Error::QoSEServiceType,	noCondition },
+	{ Error::QoSEFlowSpec,		noCondition },
+	{ Error::QoSEProvSpecBuf,	noCondition },
+	{ Error::QoSEFilterStyle,	noCondition },
+	{ Error::QoSEFilterType,	noCondition },
+	{ Error::QosSEFilterCount,	noCondition },
+	{ Error::QoSEObjLength,		noCondition },
+	{ Error::QoSEFlowCount,		noCondition },
+	{ Error::QoSEUnknownPSObj,	noCondition },
+	{ Error::QoSEPolicyObj,		noCondition },
+	{ Error::QoSEFlowDesc,		noCondition },
+	{ Error::QoSEPSFlowSpec,	noCondition },
+	{ Error::QoSEPSFilterSpec,	noCondition },
+	{ Error::QoSESDModeObj,		noCondition },
+	{ Error::QoSEShapeRateObj,	noCondition },
+	{ Error::QoSReservedPEType,	noCondition }
+    };
+
+    constexpr size_t errorCount = std::size(errorMappings);
 
-    switch (ev)
+    constexpr bool sortedMappings() noexcept
     {
-    case +Error::InvalidHandle:
-	code = errc::invalid_argument;	    // errc::bad_file_descriptor
-	break;
-    case +Error::NotEnoughMemory:
-	code = errc::not_enough_memory;
-	break;
-    case +Error::InvalidParameter:
-	code = errc::invalid_argument;
-	break;
-    case +Error::OperationAborted:
-	code = errc::operation_canceled;
-	break;
-    case +Error::IOIncomplete:
-	code = errc::resource_unavailable_try_again;
-	break;
-    case +Error::IOPending:
-	code = errc::operation_in_progress;
-	break;
-    case +Error::EIntr:
-	code = errc::interrupted;
-	break;
-    case +Error::BadF:
-	code = errc::bad_file_descriptor;
-	break;
-    case +Error::EAccess:
-	code = errc::permission_denied;
-	break;
-    case +Error::EFault:
-	code = errc::bad_address;
-	break;
-    case +Error::EInval:
-	code = errc::invalid_argument;
-	break;
-    case +Error::EMFile:
-	code = errc::too_many_files_open;
-	break;
-    case +Error::EWouldBlock:
-	code = errc::operation_would_block;
-	break;
-    case +Error::EInProgress:
-	code = errc::operation_in_progress;
-	break;
-    case +Error::EAlready:
-	code = errc::connection_already_in_progress;
-	break;
-    case +Error::ENotSock:
-	code = errc::not_a_socket;
-	break;
-    case +Error::EDestAddrReq:
-	code = errc::destination_address_required;
-	break;
-    case +Error::EMsgSize:
-	code = errc::message_size;
-	break;
-    case +Error::EProtoType:
-	code = errc::wrong_protocol_type;
-	break;
-    case +Error::EProtoOpt:
-	code = errc::no_protocol_option;
-	break;
-    case +Error::EProtoNoSupport:
-	code = errc::protocol_not_supported;
-	break;
-    case +Error::ESockTNoSupprot:
-	code = errc::not_supported;
-	break;
-    case +Error::EOpNotSupp:
-	code = errc::operation_not_supported;
-	break;
-    case +Error::EPFNoSupport:
-	code = errc::address_family_not_supported;
-	break;
-    case +Error::EAFNoSupport:
-	code = errc::address_family_not_supported;
-	break;
-    case +Error::EAddrInUse:
-	code = errc::address_in_use;
-	break;
-    case +Error::EAddrNotAvail:
-	code = errc::address_not_available;
-	break;
-    case +Error::ENetDown:
-	code = errc::network_down;
-	break;
-    case +Error::ENetUnreach:
-	code = errc::network_unreachable;
-	break;
-    case +Error::ENetReset:
-	code = errc::network_reset;
-	break;
-    case +Error::EConnAborted:
-	code = errc::connection_aborted;
-	break;
-    case +Error::EConnReset:
-	code = errc::connection_reset;
-	break;
-    case +Error::ENoBufS:
-	code = errc::no_buffer_space;
-	break;
-    case +Error::EIsConn:
-	code = errc::already_connected;
-	break;
-    case +Error::ENotConn:
-	code = errc::not_connected;
-	break;
-    case +Error::EShutDown:
-	code = errc::broken_pipe;
-	break;
-    case +Error::ETooManyRefs:
-	code = errc::too_many_links;
-	break;
-    case +Error::ETimedOut:
-	code = errc::timed_out;
-	break;
-    case +Error::EConnRefused:
-	code = errc::connection_refused;
-	break;
-    case +Error::ELoop:
-	code = errc::too_many_symbolic_link_levels;
-	break;
-    case +Error::ENameTooLong:
-	code = errc::filename_too_long;
-	break;
-    case +Error::EHostDown:
-	code = errc::host_unreachable;
-	break;
-    case +Error::EHostUnreach:
-	code = errc::host_unreachable;
-	break;
-    case +Error::ENotEmpty:
-	code = errc::directory_not_empty;
-	break;
-    case +Error::EDQuot:
-	code = errc::no_space_on_device;
-	break;
-    case +Error::ENoMore:
-	code = errc::no_such_file_or_directory;
-	break;
-    case +Error::ECancelled:
-	code = errc::operation_canceled;
-	break;
-    case +Error::EDiscon:
-	code = errc::not_connected;
-	break;
-    case +Error::E_No_More:
-	code = errc::no_such_file_or_directory;
-	break;
-    case +Error::E_Cancelled:
-	code = errc::operation_canceled;
-	break;
-    case +Error::ERefused:
-	code = errc::connection_refused;
-	break;
-    case +Error::HostNotFound:
-	code = errc::no_such_device_or_address;
-	break;
-    case +Error::TryAgain:
-	code = errc::resource_unavailable_try_again;
-	break;
-    case +Error::NoRecovery:
-	code = errc::state_not_recoverable;
-	break;
-    case +Error::NoData:
-	code = errc::no_message_available;
-	break;
+	for (size_t position = 1U; position < errorCount; position++)
+	    if (+errorMappings[position - 1U].error >= +errorMappings[position].error)
+		return false;
+
+	return true;
     }
 
-    if (code == errc::is_a_directory)
-	return move(error_condition(ev, system_category()));
+    static_assert(sortedMappings(), "WinSock2 error mappings must be sorted by error value");
 
-    return move(make_error_condition(code));
-}
+    constexpr size_t noMapping = errorCount;
 
-string netsocket::ErrorCategory::message(int ev) const
-{
-    class LocalMemory
+    size_t findMapping(int ev) noexcept
     {
-    protected:
-	void *memory;
-    public:
-	void *&getPtr()
-	{
-	    return memory;
-	}
+	ErrorMapping const *mapping = std::lower_bound
+	    (
+		std::begin(errorMappings), std::end(errorMappings), ev,
+		[](ErrorMapping const &entry, int value) { return +entry.error < value; }
+	    );
+
+	if (mapping != std::end(errorMappings) && +mapping->error == ev)
+	    return static_cast<size_t>(mapping - errorMappings);
 
-	~LocalMemory()
+	return noMapping;
+    }
+
+    // Messages are formatted once, on first use, and kept for the life of the process, so error
+    // reporting does not call into the system each time. Known errors are then found without a lock.
+    atomic<char const *> knownMessages[errorCount];
+
+    string formatMessage(int ev)
+    {
+	class LocalMemory
 	{
-	    if (memory)
+	protected:
+	    void *memory = nullptr;
+	public:
+	    void *&getPtr()
+	    {
+		return memory;
+	    }
+
+	    ~LocalMemory()
 	    {
-		LocalFree(memory);
-		memory = nullptr;
+		if (memory)
+		{
+		    LocalFree(memory);
+		    memory = nullptr;
+		}
 	    }
 	}
+	    localMemory;
+
+	DWORD dwMsgLength = ::FormatMessageA
+	    (
+		FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+		nullptr,
+		ev,
+		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+		static_cast<LPSTR>(static_cast<void *>(&localMemory.getPtr())),
+		0,
+		nullptr
+	    );
+
+	char const *text = static_cast<char const *>(localMemory.getPtr());
+
+	while (dwMsgLength && (text[dwMsgLength - 1U] == '\n' || text[dwMsgLength - 1U] == '\r' || text[dwMsgLength - 1U] == ' '))
+	    dwMsgLength--;
+
+	if (dwMsgLength)
+	    return string(text, text + dwMsgLength);
+
+	char fallback[48];
+
+	std::snprintf(fallback, sizeof fallback, "Windows Sockets error: %d", ev);
+
+	return string(fallback);
     }
-	localMemory;
-
-    DWORD dwMsgLength = ::FormatMessageA
-	(
-	    FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-	    nullptr,
-	    ev,
-	    MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-	    static_cast<LPSTR>(static_cast<void *>(&localMemory.getPtr())),
-	    0,
-	    nullptr
-	);
-
-    if (dwMsgLength)
-	return move(string(static_cast<char *>(localMemory.getPtr()), static_cast<char*>(localMemory.getPtr()) + dwMsgLength));
-
-    return move(string("Windows Sockets error: " + to_string(ev)));
+
+    // The map is never destroyed, as exceptions may still be reported during static destruction
+    char const *internMessage(int ev)
+    {
+	static mutex internMutex;
+	static map<int, string> &interned = *new map<int, string>();
+
+	lock_guard<mutex> lock(internMutex);
+	auto it = interned.find(ev);
+
+	if (it == interned.end())
+	    it = interned.emplace(ev, formatMessage(ev)).first;
+
+	return it->second.c_str();
+    }
+}
+
+char const *netsocket::errorMessage(int wsaError) noexcept
+try
+{
+    size_t position = findMapping(wsaError);
+
+    if (position == noMapping)
+	return internMessage(wsaError);
+
+    char const *text = knownMessages[position].load(std::memory_order_acquire);
+
+    if (!text)
+    {
+	text = internMessage(wsaError);
+	knownMessages[position].store(text, std::memory_order_release);
+    }
+
+    return text;
+}
+catch (...)
+{
+    return "Windows Sockets error";
+}
+
+error_condition netsocket::ErrorCategory::default_error_condition(int ev) const noexcept
+{
+    size_t position = findMapping(ev);
+
+    if (position == noMapping || errorMappings[position].condition == noCondition)
+	return error_condition(ev, system_category());
+
+    return make_error_condition(errorMappings[position].condition);
+}
+
+string netsocket::ErrorCategory::message(int ev) const
+{
+    return string(errorMessage(ev));
 }
 
 error_category &netsocket::system_category()
@@ -122,6 +122,9 @@ namespace netsocket
 
     std::error_category &system_category();
 
+    // System message for the error, formatted on first use and kept for the life of the process
+    char const *errorMessage(int wsaError) noexcept;
+
     class BaseException
     {
     public:
@@ -146,7 +149,7 @@ namespace netsocket
 	Tag const &tag;
     };
 
-    template <BaseException::Tag const &tag>
+    template <BaseException::Tag const &typeTag>
 	class BaseExceptionType: public BaseException
     {
     public:
@@ -223,9 +226,10 @@ inline netsocket::BaseException::Tag const &netsocket::BaseException::exceptionT
     return tag;
 }
 
-template <netsocket::BaseException::Tag const &tag>
-    inline netsocket::BaseExceptionType<tag>::BaseExceptionType()
-	: BaseException(tag)
+// The parameter is not named tag, that would find the BaseException::tag member instead
+template <netsocket::BaseException::Tag const &typeTag>
+    inline netsocket::BaseExceptionType<typeTag>::BaseExceptionType()
+	: BaseException(typeTag)
 {
 }
 
@@ -12,7 +12,12 @@ namespace netsocket
 	friend class Library;
 	friend class EventLoop;
 	friend class Event;
+	friend class FileStream;
 	friend class OverlappedHandler;
+	friend class ProcessExitHandler;
+	friend class SharedRing;
+	friend class Socket;
+	friend class SimulatedNetwork;
 
     protected:
 	WSAEVENT hEvent;
@@ -4,42 +4,39 @@
 #include <cstdint>
 #include <string>
 #include <utility>
+#include <algorithm>
 #include <exception>
-#include <stdexcept>
 #include <system_error>
 
 #include "SocketError.hpp"
 #include "SocketEventLoop.hpp"
+#include "SocketEventTrace.hpp"
 
 using std::uint_least32_t;
-using std::move;
-using std::string;
 using std::exception;
-using std::runtime_error;
 
 netsocket::BaseException::Tag const
     netsocket::EventLoop::multipleHandlersTag	    { "Multiple handlers in event loop" },
     netsocket::EventLoop::eventCountExceededTag	    { "WinSock2 limit" },
+    netsocket::EventLoop::storageExceededTag	    { "Fixed event loop" },
     netsocket::EventLoop::invalidApiReturnValueTag  { "WinSock2 API" },
     netsocket::EventLoop::quitLoopTag		    { "WinSock2 event loop" };
 
-string netsocket::EventLoop::MultipleHandlers::handlerTypeString(HandlerType handlerType)
+char const *netsocket::EventLoop::MultipleHandlers::handlerTypeMessage(HandlerType handlerType) noexcept
 {
-    using namespace std::literals::string_literals;
-
     switch (handlerType)
     {
     case HandlerType::Event:
-	return "event"s;
+	return "Multiple event handlers registered for socket event loop.";
     case HandlerType::Timer:
-	return "timer"s;
+	return "Multiple timer handlers registered for socket event loop.";
     case HandlerType::Exception:
-	return "exception"s;
+	return "Multiple exception handlers registered for socket event loop.";
     case HandlerType::Iteration:
-	return "iteration"s;
+	return "Multiple iteration handlers registered for socket event loop.";
     }
 
-    return move(string());
+    return "Multiple handlers registered for socket event loop.";
 }
 
 void netsocket::EventLoop::doTimerEvent()
@@ -47,14 +44,19 @@ void netsocket::EventLoop::doTimerEvent()
     bool keepTimer = false;
     TimerHandler *currentTimer = timer;
     timer = nullptr;
+    dispatchHandler = currentTimer;
+
+    markDispatch(EventTrace::Kind::TimerEvent, currentTimer);
 
     try
     {
+	EventTrace::Span span(trace, EventTrace::Kind::TimerEvent, currentTimer);
 	keepTimer = currentTimer->onTimerTrigger(*this);
     }
     catch (QuitLoop const &)
     {
 	loopRunning = false;
+	quitDispatched = true;
     }
     catch (...)
     {
@@ -62,19 +64,73 @@ void netsocket::EventLoop::doTimerEvent()
 	    exceptionHandler->onException(*this);
     }
 
-    if (keepTimer && currentTimer != freeList)
+    // dispatchHandler is cleared if the timer was disposed during the call
+    if (keepTimer && dispatchHandler == currentTimer)
+    {
+	dispatchHandler = nullptr;
 	addTimerHandler(*currentTimer);
+    }
+    else
+	dispatchHandler = nullptr;
+}
+
+// Runs the deadlines that are due. Deadlines set again from onDeadline() wait for the next
+// call, even with no delay, so a handler can not keep the loop here.
+void netsocket::EventLoop::doDeadlineEvents()
+{
+    if (deadlines.empty())
+	return;
+
+    ULONGLONG currentTickCountMs = tickCountMs();
+
+    for (std::size_t count = deadlines.size(); count && !deadlines.empty() && deadlines.front()->deadlineTickCountMs <= currentTickCountMs; count--)
+    {
+	DeadlineHandler *handler = deadlines.front();
+
+	removeDeadline(0U);
+	markDispatch(EventTrace::Kind::TimerEvent, handler);
+
+	try
+	{
+	    EventTrace::Span span(trace, EventTrace::Kind::TimerEvent, handler);
+	    handler->onDeadline(*this);
+	}
+	catch (QuitLoop const &)
+	{
+	    loopRunning = false;
+	    quitDispatched = true;
+	}
+	catch (...)
+	{
+	    if (exceptionHandler)
+		exceptionHandler->onException(*this);
+	}
+    }
+}
+
+void netsocket::EventLoop::doExpiredTimers()
+{
+    if (timer && tickCountMs() >= timerTargetTickCountMs)
+	doTimerEvent();
+
+    doDeadlineEvents();
 }
 
 void netsocket::EventLoop::doIterationStartEvent()
 try
 {
     if (iterationHandler)
+    {
+	markDispatch(EventTrace::Kind::IterationStart, iterationHandler);
+
+	EventTrace::Span span(trace, EventTrace::Kind::IterationStart, iterationHandler);
 	iterationHandler->onNextIteration(*this);
+    }
 }
 catch (QuitLoop const&)
 {
     loopRunning = false;
+    quitDispatched = true;
 }
 catch (...)
 {
@@ -82,22 +138,107 @@ catch (...)
 	exceptionHandler->onException(*this);
 }
 
+// Only the handlers requested when the pass starts are called. Handlers that request the
+// iteration end again from onIterationEnd(), or new ones, are moved to the front of the list
+// for the next iteration.
+void netsocket::EventLoop::doIterationEndEvent()
+{
+    if (iterationEndHandlers.empty())
+	return;
+
+    EventTrace::Span span(trace, EventTrace::Kind::IterationEnd);
+
+    iterationEndPassEnd = iterationEndHandlers.size();
+
+    for (std::size_t position = 0U; position < iterationEndPassEnd; position++)
+    {
+	IterationEndHandler *handler = iterationEndHandlers[position];
+
+	if (!handler)
+	    continue;
+
+	iterationEndHandlers[position] = nullptr;
+	handler->iterationEndPosition = noSlot;
+	markDispatch(EventTrace::Kind::IterationEnd, handler);
+
+	try
+	{
+	    handler->onIterationEnd(*this);
+	}
+	catch (QuitLoop const &)
+	{
+	    loopRunning = false;
+	    quitDispatched = true;
+	}
+	catch (...)
+	{
+	    if (exceptionHandler)
+		exceptionHandler->onException(*this);
+	}
+    }
+
+    std::size_t deferredCount = iterationEndHandlers.size() - iterationEndPassEnd;
+
+    for (std::size_t position = 0U; position < deferredCount; position++)
+    {
+	IterationEndHandler *handler = iterationEndHandlers[iterationEndPassEnd + position];
+
+	iterationEndHandlers[position] = handler;
+	handler->iterationEndPosition = static_cast<std::uint_least32_t>(position);
+    }
+
+    while (iterationEndHandlers.size() > deferredCount)
+	iterationEndHandlers.pop_back();
+
+    iterationEndPassEnd = 0U;
+}
+
+// Passes the exception being handled to the exception handler, the same way as for exceptions
+// from handlers dispatched by the loop. Only call it from a catch block.
+void netsocket::EventLoop::doExceptionEvent()
+{
+    try
+    {
+	throw;
+    }
+    catch (QuitLoop const &)
+    {
+	loopRunning = false;
+	quitDispatched = true;
+    }
+    catch (...)
+    {
+	if (exceptionHandler)
+	    exceptionHandler->onException(*this);
+    }
+}
+
 void netsocket::EventLoop::doSocketEvent(unsigned idx)
 {
     bool keepHandler = false;
-    EventHandler
-	*&handler     = handlers[events[idx]],
-	* baseHandler = handler;
-   
-    handler = nullptr;
+    std::uint_least32_t slotIndex = eventSlots[idx], generation = handlers[slotIndex].generation;
+    EventHandler *handler = handlers[slotIndex].handler;
+
+    handlers[slotIndex].dispatchIteration = iterationCount;
+    dispatchSlot = slotIndex;
+    dispatchSlotReplaced = false;
+    dispatchYielded = false;
+    budgetState.workUsed = 0U;
+
+    if (budgetState.dispatchTicks)
+	budgetState.dispatchStartTicks = performanceTicks();
+
+    markDispatch(EventTrace::Kind::SocketEvent, handler);
 
     try
     {
-	keepHandler = baseHandler->onEventTrigger(*this);
+	EventTrace::Span span(trace, EventTrace::Kind::SocketEvent, handler);
+	keepHandler = handler->onEventTrigger(*this);
     }
     catch (QuitLoop const &)
     {
 	loopRunning = false;
+	quitDispatched = true;
     }
     catch (...)
     {
@@ -105,43 +246,249 @@ void netsocket::EventLoop::doSocketEvent(unsigned idx)
 	    exceptionHandler->onException(*this);
     }
 
-    if (keepHandler && freeList != baseHandler)
-	if (handler)
-	{
-	    WSAEVENT wsaEvent = events[idx];
-	    events.erase(events.begin() + idx);
+    dispatchSlot = noSlot;
 
+    // The slot (and any position in events) may have changed during the call, if the
+    // handler was removed, disposed, disarmed, or if other handlers were added or removed
+    if (handlers[slotIndex].generation != generation)
+	return;
+
+    if (dispatchSlotReplaced)
+    {
+	WSAEVENT wsaEvent = handler->eventHandle();
+	releaseSlot(slotIndex);
+
+	if (keepHandler)
 	    throw MultipleHandlers(wsaEvent);
-	}
-	else
-	    handler = baseHandler;
+    }
     else
+	if (!keepHandler)
+	    releaseSlot(slotIndex);
+	else
+	    if (dispatchYielded)
+		queueYielded(HandlerId { slotIndex, generation });
+	    else
+		dropYielded(slotIndex);
+}
+
+// Only armed handlers are queued, once, so a fixed loop has room for them, and a handler that
+// yields again keeps its place in the queue. The event also moves to the end of its class in the
+// wait set, as the wait reports the first signaled event, so the other handlers are not kept
+// waiting by a busy one.
+void netsocket::EventLoop::queueYielded(HandlerId id)
+{
+    std::uint_least32_t position = handlers[id.index].position;
+
+    if (position == noSlot)				// disarmed during the call
+	return;
+
+    std::uint_least32_t last = priorityEnd[static_cast<std::size_t>(handlers[id.index].priority)] - 1U;
+
+    if (position != last)
     {
-	if (!handler)
-	    handlers.erase(events[idx]);
+	std::swap(events[position], events[last]);
+	std::swap(eventSlots[position], eventSlots[last]);
+	handlers[eventSlots[position]].position = position;
+	handlers[id.index].position = last;
+    }
+
+    if (handlers[id.index].yieldedPosition != noSlot)
+	return;
+
+    yieldedHandlers.push_back(id);
+    handlers[id.index].yieldedPosition = static_cast<std::uint_least32_t>(yieldedHandlers.size() - 1U);
+}
+
+// Runs the first count handlers in the queue, that yielded before this iteration. A handler the
+// wait already dispatched in this iteration is not run again. Each handler keeps its one entry
+// while it yields again, and the entries passed move behind the others, for the next iteration.
+// When the iteration budget runs out, or a handler quits the loop, the remaining handlers keep
+// their place in front.
+void netsocket::EventLoop::doYieldedEvents(std::size_t count)
+{
+    std::size_t position = 0U;
+
+    count = std::min(count, yieldedHandlers.size());	// the wait may have dropped entries
+    yieldedPassActive = true;
+
+    while (position < count && !quitDispatched && !iterationBudgetSpent())
+    {
+	HandlerId id = yieldedHandlers[position++];
+
+	if (id.index == noSlot || handlers[id.index].dispatchIteration == iterationCount)
+	    continue;
+
+	if (handlers[id.index].position != noSlot)	// not disarmed
+	    doSocketEvent(handlers[id.index].position);
+	else
+	    dropYielded(id.index);
+    }
+
+    yieldedPassActive = false;
+    std::rotate(yieldedHandlers.begin(), yieldedHandlers.begin() + position, yieldedHandlers.end());
+
+    std::size_t kept = 0U;
+
+    for (position = 0U; position < yieldedHandlers.size(); position++)
+	if (yieldedHandlers[position].index != noSlot)
+	{
+	    yieldedHandlers[kept] = yieldedHandlers[position];
+	    handlers[yieldedHandlers[kept].index].yieldedPosition = static_cast<std::uint_least32_t>(kept);
+	    kept++;
+	}
+
+    while (yieldedHandlers.size() > kept)
+	yieldedHandlers.pop_back();
+}
+
+// Zero timeout wait on part of the wait set, without running APCs, that wait for the next wait
+DWORD netsocket::EventLoop::pollEvents(std::uint_least32_t position, std::uint_least32_t count)
+{
+    if (backend)
+	return backend->waitForEvents(count, events.data() + position, 0U);
+
+    return ::WSAWaitForMultipleEvents(count, events.data() + position, false, 0U, false);
+}
+
+// Dispatches the event reported by the wait, then polls for the other ready events, class by
+// class, up to the quantum of each class. The wait reported the first signaled event, so the
+// classes before it have none. Positions after a dispatch may be off if handlers were added or
+// removed, and then an event can wait for the next iteration. A handler that yields, or leaves
+// the wait set, moves another event into its position, that is polled next. The yielded handler
+// moves to the end of its class, and is not dispatched again when the poll reaches it there.
+void netsocket::EventLoop::doReadyEvents(unsigned idx)
+{
+    std::uint_least32_t slotIndex = eventSlots[idx];
+    std::size_t priority = static_cast<std::size_t>(handlers[slotIndex].priority);
+    std::uint_least32_t next = static_cast<std::uint_least32_t>(idx) + 1U, dispatches = 1U;
+
+    doSocketEvent(idx);
+
+    if (idx < events.size() && eventSlots[idx] != slotIndex)
+	next = static_cast<std::uint_least32_t>(idx);
+
+    while (!quitDispatched)				// until a handler quits the loop
+    {
+	if (dispatches >= priorityQuanta[priority] || next >= priorityEnd[priority])
+	{
+	    if (++priority == priorityClasses)
+		break;
+
+	    next = priorityEnd[priority - 1U];
+	    dispatches = 0U;
+
+	    continue;
+	}
+
+	if (iterationBudgetSpent())
+	    break;
+
+	DWORD dwWait = pollEvents(next, priorityEnd[priority] - next);
+
+	if (WSA_WAIT_EVENT_0 <= dwWait && dwWait < WSA_WAIT_EVENT_0 + (priorityEnd[priority] - next))
+	{
+	    std::uint_least32_t position = next + static_cast<std::uint_least32_t>(dwWait - WSA_WAIT_EVENT_0);
+
+	    slotIndex = eventSlots[position];
+	    next = position + 1U;
 
-	events.erase(events.begin() + idx);
+	    if (handlers[slotIndex].dispatchIteration != iterationCount)
+	    {
+		doSocketEvent(position);
+		dispatches++;
+
+		if (position < events.size() && eventSlots[position] != slotIndex)
+		    next = position;
+	    }
+	}
+	else
+	    next = priorityEnd[priority];
     }
 }
 
 DWORD netsocket::EventLoop::doProcessElapsedTime()
 {
+    DWORD dwTimeoutMs = WSA_INFINITE;
+
     if (timer)
     {
-	ULONGLONG currentTickCountMs = GetTickCount64();
+	ULONGLONG currentTickCountMs = tickCountMs();
 
 	if (currentTickCountMs >= timerTargetTickCountMs)
 	{
 	    doTimerEvent();
 
 	    if (timer)
-		return timer->timerIntervalMs();
+		dwTimeoutMs = timer->timerIntervalMs();
 	}
 	else
-	    return static_cast<DWORD>(timerTargetTickCountMs - currentTickCountMs);
+	    dwTimeoutMs = static_cast<DWORD>(timerTargetTickCountMs - currentTickCountMs);
     }
 
-    return WSA_INFINITE;
+    if (!deadlines.empty())
+    {
+	doDeadlineEvents();
+
+	if (!deadlines.empty())
+	{
+	    ULONGLONG currentTickCountMs = tickCountMs(), targetTickCountMs = deadlines.front()->deadlineTickCountMs;
+	    DWORD dwDeadlineMs = targetTickCountMs > currentTickCountMs ? static_cast<DWORD>(targetTickCountMs - currentTickCountMs) : 0U;
+
+	    if (dwDeadlineMs < dwTimeoutMs)
+		dwTimeoutMs = dwDeadlineMs;
+	}
+    }
+
+    return dwTimeoutMs;
+}
+
+DWORD netsocket::EventLoop::doBusyPollWait(DWORD dwTimeoutMs)
+{
+    LARGE_INTEGER startTicks, currentTicks;
+    LONGLONG spinTicks = busyPollState.budgetTicks;
+    DWORD eventCount = static_cast<DWORD>(events.size());
+    DWORD dwWait;
+
+    ::QueryPerformanceCounter(&startTicks);
+
+    if (dwTimeoutMs != WSA_INFINITE && spinTicks > static_cast<LONGLONG>(dwTimeoutMs) * busyPollState.ticksPerMs)
+	spinTicks = static_cast<LONGLONG>(dwTimeoutMs) * busyPollState.ticksPerMs;
+
+    do
+    {
+	dwWait = ::WSAWaitForMultipleEvents(eventCount, events.data(), false, 0U, true);
+	::QueryPerformanceCounter(&currentTicks);
+
+	if (dwWait != WSA_WAIT_TIMEOUT)
+	{
+	    if (WSA_WAIT_EVENT_0 <= dwWait && dwWait < WSA_WAIT_EVENT_0 + eventCount)
+	    {
+		busyPollState.hits++;
+		adaptBusyPoll(currentTicks.QuadPart - startTicks.QuadPart);
+	    }
+
+	    return dwWait;
+	}
+
+	::YieldProcessor();
+    }
+    while (currentTicks.QuadPart - startTicks.QuadPart < spinTicks);
+
+    busyPollState.misses++;
+
+    if (dwTimeoutMs != WSA_INFINITE)
+    {
+	DWORD dwSpinMs = static_cast<DWORD>((currentTicks.QuadPart - startTicks.QuadPart) / busyPollState.ticksPerMs);
+	dwTimeoutMs = dwSpinMs < dwTimeoutMs ? dwTimeoutMs - dwSpinMs : 0U;
+    }
+
+    dwWait = ::WSAWaitForMultipleEvents(eventCount, events.data(), false, dwTimeoutMs, true);
+    ::QueryPerformanceCounter(&currentTicks);
+
+    if (dwWait != WSA_WAIT_IO_COMPLETION)
+	adaptBusyPoll(currentTicks.QuadPart - startTicks.QuadPart);
+
+    return dwWait;
 }
 
 void netsocket::EventLoop::doWaitForSocketEvent()
@@ -149,15 +496,35 @@ void netsocket::EventLoop::doWaitForSocketEvent()
     while (true)
     {
 	DWORD dwTimeoutMs = doProcessElapsedTime();
+	DWORD dwWait;
+
+	if (!yieldedHandlers.empty() || !iterationEndHandlers.empty())
+	    dwTimeoutMs = 0U;
+
+	markDispatch(EventTrace::Kind::Wait, nullptr);
 
-	switch (DWORD dwWait = ::WSAWaitForMultipleEvents(static_cast<DWORD>(events.size()), events.data(), false, dwTimeoutMs, true))
+	{
+	    EventTrace::Span span(trace, EventTrace::Kind::Wait);
+
+	    if (backend)
+		dwWait = backend->waitForEvents(static_cast<DWORD>(events.size()), events.data(), dwTimeoutMs);
+	    else
+		if (busyPollState.maxTicks && dwTimeoutMs)	// a poll with no timeout has nothing to spin for
+		    dwWait = doBusyPollWait(dwTimeoutMs);
+		else
+		    dwWait = ::WSAWaitForMultipleEvents(static_cast<DWORD>(events.size()), events.data(), false, dwTimeoutMs, true);
+	}
+
+	if (budgetState.iterationTicks)
+	    budgetState.iterationStartTicks = performanceTicks();
+
+	switch (dwWait)
 	{
 	case WSA_WAIT_IO_COMPLETION:
 	    continue;
 
 	case WSA_WAIT_TIMEOUT:
-	    if (timer)
-		doTimerEvent();
+	    doExpiredTimers();
 	    break;
 
 	case WSA_WAIT_FAILED:
@@ -172,10 +539,8 @@ void netsocket::EventLoop::doWaitForSocketEvent()
 	default:
 	    if (WSA_WAIT_EVENT_0 <= dwWait && dwWait < WSA_WAIT_EVENT_0 + events.size())
 	    {
-		doSocketEvent(dwWait - WSA_WAIT_EVENT_0);
-
-		if (timer && ::GetTickCount64() >= timerTargetTickCountMs)
-		    doTimerEvent();
+		doReadyEvents(dwWait - WSA_WAIT_EVENT_0);
+		doExpiredTimers();
 	    }
 	    else
 		throw InvalidAPIFunctionReturn(dwWait, "WSAWaitForMultipleEvents");
@@ -189,48 +554,94 @@ void netsocket::EventLoop::doWaitForSocketEvent()
 
 void netsocket::EventLoop::doDisposeFreeList()
 {
+    if (!freeList)
+	return;
+
+    markDispatch(EventTrace::Kind::Dispose, nullptr);
+
+    EventTrace::Span span(trace, EventTrace::Kind::Dispose);
     BaseHandler *handler;
 
     while (freeList)
     {
 	handler = freeList->next;
-	delete freeList;
+	deallocateHandler(freeList);
 	freeList = handler;
     }
 }
 
 void netsocket::EventLoop::triggerNextEvent()
 {
-    if (events.empty() && !timer)
+    if (events.empty() && !timer && deadlines.empty())
     {
 	loopRunning = false;
 	return;
     }
 
+    quitDispatched = false;
+    yieldedPassActive = false;
+    iterationCount++;
     doIterationStartEvent();
     doDisposeFreeList();
 
     if (events.empty())
     {
-	::Sleep(timer->timerIntervalMs());
-	doTimerEvent();
+	DWORD dwTimeoutMs = doProcessElapsedTime();
+
+	if (!iterationEndHandlers.empty())
+	    dwTimeoutMs = 0U;
+
+	if (dwTimeoutMs == WSA_INFINITE)
+	{
+	    doIterationEndEvent();
+	    markDispatch(EventTrace::Kind::Wait, nullptr);
+	    return;
+	}
+
+	markDispatch(EventTrace::Kind::Wait, nullptr);
+
+	{
+	    EventTrace::Span span(trace, EventTrace::Kind::Wait);
+	    if (backend)
+		backend->sleep(dwTimeoutMs);
+	    else
+		::Sleep(dwTimeoutMs);
+	}
+
+	doExpiredTimers();
     }
     else
+    {
+	std::size_t yieldedCount = yieldedHandlers.size();	// from the previous iterations
+
 	doWaitForSocketEvent();
+
+	if (yieldedCount)
+	    doYieldedEvents(yieldedCount);
+    }
+
+    doIterationEndEvent();
+    markDispatch(EventTrace::Kind::Wait, nullptr);
 }
 
 void netsocket::EventLoop::doQuitEvent()
 {
-    for (auto &handler: handlers)
-	try
-	{
-	    handler.second->onLoopQuit(*this);
-	}
-	catch (...)
-	{
-	    if (exceptionHandler)
-		exceptionHandler->onException(*this);
-	}
+    doIterationEndEvent();
+    markDispatch(EventTrace::Kind::Quit, nullptr);
+
+    EventTrace::Span span(trace, EventTrace::Kind::Quit);
+
+    for (std::size_t slotIndex = 0U; slotIndex < handlers.size(); slotIndex++)
+	if (handlers[slotIndex].handler)
+	    try
+	    {
+		handlers[slotIndex].handler->onLoopQuit(*this);
+	    }
+	    catch (...)
+	    {
+		if (exceptionHandler)
+		    exceptionHandler->onException(*this);
+	    }
 
     if (timer)
 	try
@@ -266,9 +677,25 @@ void netsocket::EventLoop::doQuitEvent()
 
     doDisposeFreeList();
 
-    handlers.clear();
-    events.clear();
+    for (std::size_t slotIndex = 0U; slotIndex < handlers.size(); slotIndex++)
+	if (handlers[slotIndex].handler)
+	    releaseSlot(static_cast<std::uint_least32_t>(slotIndex));
+
+    for (DeadlineHandler *handler: deadlines)
+	handler->deadlinePosition = noSlot;
+
+    deadlines.clear();
+
+    for (IterationEndHandler *handler: iterationEndHandlers)
+	if (handler)
+	    handler->iterationEndPosition = noSlot;
+
+    iterationEndHandlers.clear();
+    yieldedHandlers.clear();
+
     timer = nullptr;
     iterationHandler = nullptr;
     exceptionHandler = nullptr;
+
+    markDispatch(EventTrace::Kind::Wait, nullptr);
 }
@@ -2,16 +2,23 @@
 #define WINSOCK2_CXX_SOCKET_EVENT_LOOP
 
 #include <WinSock2.h>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <utility>
 #include <string>
-#include <stdexcept>
-#include <vector>
-#include <map>
+#include <exception>
+#include <new>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <algorithm>
 
 #include "SocketError.hpp"
 #include "SocketLibrary.hpp"
 #include "SocketEventHandle.hpp"
+#include "SocketEventTrace.hpp"
 
 namespace netsocket
 {
@@ -23,24 +30,143 @@ namespace netsocket
 	class TimerHandler;
 	class ExceptionHandler;
 	class IterationHandler;
+	class DeadlineHandler;
+	class IterationEndHandler;
+	class Backend;
+	struct HandlerId;
 
 	void  doTimerEvent();
+	void  doDeadlineEvents();
+	void  doExpiredTimers();
 	DWORD doProcessElapsedTime();
 	void  doSocketEvent(unsigned idx);
 	void  doQuitEvent();
 	void  doWaitForSocketEvent();
+	DWORD doBusyPollWait(DWORD dwTimeoutMs);
 	void  doIterationStartEvent();
+	void  doIterationEndEvent();
+	void  doReadyEvents(unsigned idx);
+	void  doYieldedEvents(std::size_t count);
 	void  doDisposeFreeList();
+	void  doExceptionEvent();
+
+	// Class of an event handler, that orders the wait set, see setPriorityQuantum()
+	enum class Priority: std::uint_least8_t
+	{
+	    Control,
+	    Latency,
+	    Normal,
+	    Bulk
+	};
+
+	static constexpr std::size_t priorityClasses = 4U;
 
     protected:
+	static constexpr std::uint_least32_t noSlot = 0xFFFFFFFFU;
+
+	// Event handlers live in slots, that are reused after the handler is removed. The generation
+	// count changes each time the slot is released, so a HandlerId for a removed handler no longer
+	// matches the slot. Armed handlers have their event in the wait set (events and eventSlots
+	// at the same position), that is kept sorted on the priority class.
+	struct HandlerSlot
+	{
+	    EventHandler *handler;
+	    std::uint_least32_t generation;
+	    std::uint_least32_t position;		// in events for armed handlers, next free slot for free slots
+	    Priority priority;
+	    std::uint_least32_t yieldedPosition;	// in yieldedHandlers, or noSlot
+	    std::uint_least32_t dispatchIteration;	// iterationCount at the last dispatch
+	};
+
+	// Busy polling spins on zero-timeout waits before blocking. The spin budget follows twice the
+	// recent average time to the next event, and drops to the minimum when events come in slower
+	// than the maximum budget, so idle loops stop burning CPU. Waits with no timeout, while
+	// yielded or iteration end handlers are queued, do not spin and are not counted.
+	struct BusyPollState
+	{
+	    LONGLONG minTicks = 0, maxTicks = 0, budgetTicks = 0, averageArrivalTicks = 0;
+	    LONGLONG ticksPerMs = 0, ticksPerUs = 0;
+	    std::uint_least64_t hits = 0U, misses = 0U;
+	};
+
+	// Array for the loop tables, that grows in the loop memory resource, or uses a fixed buffer
+	// given by FixedEventLoop, and then throws StorageExceeded when it is full
+	template <typename T>
+	    class Storage
+	{
+	protected:
+	    static_assert(std::is_trivially_copyable_v<T>, "Loop tables hold plain values");
+
+	    T *items = nullptr;
+	    std::size_t count = 0U, limit = 0U;
+	    std::pmr::memory_resource *resource;
+	    bool fixed = false;
+
+	    void release() noexcept;
+
+	public:
+	    std::size_t size() const noexcept;
+	    bool empty() const noexcept;
+	    T *data() noexcept;
+	    T &operator [](std::size_t position) noexcept;
+	    T const &operator [](std::size_t position) const noexcept;
+	    T &front() noexcept;
+	    T &back() noexcept;
+	    T *begin() noexcept;
+	    T *end() noexcept;
+
+	    void push_back(T const &item);
+	    void pop_back() noexcept;
+	    void clear() noexcept;
+	    void attach(T *buffer, std::size_t capacity) noexcept;
+
+	    Storage(std::pmr::memory_resource *memoryResource) noexcept;
+	    ~Storage();
+	    Storage(Storage const &other) = delete;
+	    Storage &operator =(Storage const &other) = delete;
+	};
+
 	bool loopRunning = false;
+	bool quitDispatched = false;			// a handler quit the loop during this iteration
+	std::uint_least32_t iterationCount = 0U;
 	ULONGLONG timerTargetTickCountMs = 0U;
-	std::vector<WSAEVENT> events;
-	std::map<WSAEVENT, EventHandler *> handlers;
+	BusyPollState busyPollState;
+	unsigned long eventLimit = WSA_MAXIMUM_WAIT_EVENTS;
+	std::pmr::memory_resource *loopResource;
+	Storage<WSAEVENT> events;
+	Storage<std::uint_least32_t> eventSlots;
+	Storage<HandlerSlot> handlers;
+	std::uint_least32_t freeSlot = noSlot;
+	std::uint_least32_t dispatchSlot = noSlot;
+	bool dispatchSlotReplaced = false;
+	std::uint_least32_t priorityEnd[priorityClasses] = { };		// end of each class in events
+	std::uint_least32_t priorityQuanta[priorityClasses] = { 1U, 1U, 1U, 1U };
+	BaseHandler *dispatchHandler = nullptr;
 	BaseHandler *freeList = nullptr;
 	TimerHandler *timer = nullptr;
 	ExceptionHandler *exceptionHandler = nullptr;
 	IterationHandler *iterationHandler = nullptr;
+	EventTrace *trace = nullptr;
+	Backend *backend = nullptr;
+	Storage<DeadlineHandler *> deadlines;		// binary min-heap on the deadline
+	Storage<IterationEndHandler *> iterationEndHandlers;
+	std::size_t iterationEndPassEnd = 0U;		// entries called by the running pass, 0 between passes
+	std::atomic<std::uint_least64_t> dispatchWord { 0U };	// read by other threads, see dispatchState()
+	std::uint_least64_t dispatchSequence = 0U;
+
+	bool registeredHandler(BaseHandler const *handler) const noexcept;
+	HandlerSlot *handlerSlot(HandlerId id) noexcept;
+	HandlerSlot const *handlerSlot(HandlerId id) const noexcept;
+	void checkDuplicateEvent(WSAEVENT wsaEvent);
+	void placeEvent(std::uint_least32_t position, WSAEVENT wsaEvent, std::uint_least32_t slotIndex) noexcept;
+	void armSlot(std::uint_least32_t slotIndex, WSAEVENT wsaEvent);
+	void disarmSlot(std::uint_least32_t slotIndex) noexcept;
+	void releaseSlot(std::uint_least32_t slotIndex) noexcept;
+	void adaptBusyPoll(LONGLONG arrivalTicks) noexcept;
+	void placeDeadline(std::size_t position, DeadlineHandler *handler) noexcept;
+	void siftDeadline(std::size_t position) noexcept;
+	void removeDeadline(std::size_t position) noexcept;
+	void markDispatch(EventTrace::Kind kind, void const *handler) noexcept;
 
     public:
 	class BaseHandler
@@ -49,6 +175,8 @@ namespace netsocket
 
 	protected:
 	    BaseHandler *next = nullptr;
+	    std::uint_least32_t slot = noSlot;
+	    std::uint_least32_t allocationSize = 0U;	// from allocateHandler(), 0 for new
 
 	    virtual void onLoopQuit(EventLoop &eventLoop);
 
@@ -90,6 +218,111 @@ namespace netsocket
 	    virtual void onNextIteration(EventLoop &eventLoop) = 0;
 	};
 
+	// One-shot deadline, that any number of objects can set on the loop, unlike the single
+	// TimerHandler. Set it again from onDeadline() for a periodic timer. It is not owned or
+	// disposed by the loop, and a pending deadline is cancelled when the handler is destroyed.
+	class DeadlineHandler
+	{
+	    friend class EventLoop;
+
+	protected:
+	    EventLoop *deadlineLoop = nullptr;
+	    ULONGLONG deadlineTickCountMs = 0U;
+	    std::uint_least32_t deadlinePosition = noSlot;
+
+	    virtual void onDeadline(EventLoop &eventLoop) = 0;
+
+	public:
+	    bool pendingDeadline() const noexcept;
+
+	    virtual ~DeadlineHandler();
+	};
+
+	// Called once at the end of the loop iteration in which it was requested, after the event
+	// dispatch, for example to flush output batched up by the handlers. Any number of objects can
+	// request it, unlike the single IterationHandler. A request made from onIterationEnd() is for
+	// the next iteration, that does not block in the wait while iteration end requests are pending.
+	class IterationEndHandler
+	{
+	    friend class EventLoop;
+
+	protected:
+	    EventLoop *iterationEndLoop = nullptr;
+	    std::uint_least32_t iterationEndPosition = noSlot;
+
+	    virtual void onIterationEnd(EventLoop &eventLoop) = 0;
+
+	public:
+	    bool pendingIterationEnd() const noexcept;
+
+	    virtual ~IterationEndHandler();
+	};
+
+	// Source of time and event waits for the loop, in place of the system clock and
+	// WSAWaitForMultipleEvents(), for example to run the loop against a simulated network
+	class Backend
+	{
+	public:
+	    virtual ULONGLONG tickCountMs() = 0;
+	    virtual DWORD waitForEvents(DWORD eventCount, WSAEVENT const *events, DWORD dwTimeoutMs) = 0;
+	    virtual void sleep(DWORD dwTimeoutMs) = 0;
+
+	    virtual ~Backend();
+	};
+
+	// What the loop thread is running, for a watchdog on another thread. The kind is Wait while
+	// the loop is not in a handler. The sequence changes with each dispatch, and wraps around.
+	struct DispatchState
+	{
+	    EventTrace::Kind kind;
+	    void const *handler;
+	    std::uint_least32_t sequence;
+
+	    bool operator ==(DispatchState const &other) const noexcept;
+	    bool operator !=(DispatchState const &other) const noexcept;
+	};
+
+	// Compact reference to a registered event handler, that can be checked for validity
+	struct HandlerId
+	{
+	    std::uint_least32_t index = noSlot;
+	    std::uint_least32_t generation = 0U;
+
+	    bool operator ==(HandlerId const &other) const noexcept;
+	    bool operator !=(HandlerId const &other) const noexcept;
+	};
+
+	// Limits for one dispatch, that a handler draining a lot of input checks with
+	// budgetExhausted(), and then yields. Zero is no limit. The iteration time counts from the
+	// end of the wait, for all handlers dispatched after it.
+	struct Budget
+	{
+	    std::uint_least32_t dispatchUs = 0U;
+	    std::uint_least32_t iterationUs = 0U;
+	    std::size_t dispatchWork = 0U;		// units counted with consumeWork(), like messages or bytes
+	};
+
+    protected:
+	struct BudgetState
+	{
+	    Budget limits;
+	    LONGLONG dispatchTicks = 0, iterationTicks = 0;	// the limits, in performance counter ticks
+	    LONGLONG dispatchStartTicks = 0, iterationStartTicks = 0;
+	    std::size_t workUsed = 0U;
+	};
+
+	BudgetState budgetState;
+	bool dispatchYielded = false, yieldedPassActive = false;
+	Storage<HandlerId> yieldedHandlers;		// run again in the next iteration
+
+	static LONGLONG performanceTicks() noexcept;
+	bool iterationBudgetSpent() const noexcept;
+	DWORD pollEvents(std::uint_least32_t position, std::uint_least32_t count);
+	void queueYielded(HandlerId id);
+	void dropYielded(std::uint_least32_t slotIndex) noexcept;
+
+    public:
+
 	enum class HandlerType
 	{
 	    Event,
@@ -99,17 +332,18 @@ namespace netsocket
 	};
 
 	static BaseException::Tag const
-	    multipleHandlersTag, eventCountExceededTag, invalidApiReturnValueTag;
+	    multipleHandlersTag, eventCountExceededTag, storageExceededTag, invalidApiReturnValueTag;
 
-	class EventLoopException: BaseException, public std::runtime_error
+	// Loop errors keep their code and a static message, and are thrown without allocating,
+	// like QuitLoop on each loop exit
+	class EventLoopException: BaseException, public std::exception
 	{
 	protected:
 	    std::uintptr_t errorCode;
+	    char const *errorMessage;
 
 	public:
-	    EventLoopException(BaseException::Tag const &tag, std::uintptr_t errorCode, char const *errorMessage);
-	    EventLoopException(BaseException::Tag const &tag, std::uintptr_t errorCode, std::string const &errorMessage);
-	    EventLoopException(BaseException::Tag const &tag, std::uintptr_t errorCode, std::string &&errorMessage);
+	    EventLoopException(BaseException::Tag const &tag, std::uintptr_t errorCode, char const *errorMessage) noexcept;	// not copied
 
 	    virtual char const *what() const noexcept override;
 	    virtual std::uintptr_t baseErrorCode() const noexcept override;
@@ -121,11 +355,17 @@ namespace netsocket
 	    EventCountExceeded();
 	};
 
+	class StorageExceeded: public EventLoopException
+	{
+	public:
+	    StorageExceeded();
+	};
+
 	class MultipleHandlers: public EventLoopException
 	{
 	protected:
 	    WSAEVENT wsaEvent;
-	    static std::string handlerTypeString(HandlerType handlerType);
+	    static char const *handlerTypeMessage(HandlerType handlerType) noexcept;
 
 	public:
 	    MultipleHandlers(EventHandle eventHandle);
@@ -136,8 +376,16 @@ namespace netsocket
 
 	class InvalidAPIFunctionReturn: public EventLoopException
 	{
+	protected:
+	    char const *functionName;
+	    char text[96];				// formatted by the constructor
+
 	public:
-	    InvalidAPIFunctionReturn(std::uintptr_t, char const *apiFunctionName);
+	    InvalidAPIFunctionReturn(std::uintptr_t, char const *apiFunctionName) noexcept;	// name not copied
+
+	    char const *apiFunction() const noexcept;
+
+	    virtual char const *what() const noexcept override;
 	};
 
 	static BaseException::Tag const quitLoopTag;
@@ -154,22 +402,80 @@ namespace netsocket
 	unsigned long available() const noexcept;
 	bool	      full()      const noexcept;
 
-	void addEventHandler(EventHandler &handler);
+	HandlerId addEventHandler(EventHandler &handler, Priority priority = Priority::Normal);
 	void addTimerHandler(TimerHandler &handler);
 	void addExceptionHandler(ExceptionHandler &handler);
 	void addIterationHandler(IterationHandler &handler);
 
-	template <typename HandlerT>
-	    HandlerT *allocateHandler();
+	void setDeadline(DeadlineHandler &handler, std::uint_least32_t delayMs);	// moves a pending deadline
+	bool cancelDeadline(DeadlineHandler &handler) noexcept;
+
+	void requestIterationEnd(IterationEndHandler &handler);			// no-op when already requested
+	bool cancelIterationEnd(IterationEndHandler &handler) noexcept;
+
+	bool validHandler(HandlerId id) const noexcept;
+	bool armedHandler(HandlerId id) const noexcept;
+	EventHandler *eventHandler(HandlerId id) const noexcept;
+	HandlerId eventHandlerId(EventHandler const &handler) const noexcept;
+	bool removeEventHandler(HandlerId id);
+	bool disarmEventHandler(HandlerId id);
+	bool rearmEventHandler(HandlerId id);
+
+	// After a wait, ready events are dispatched class by class, Control first, up to the quantum
+	// of each class, before the loop waits again. Within a class the events after the one just
+	// dispatched are polled, so they take turns. Quanta on the lower classes bound the time
+	// before a new Control event is seen, and quanta on the higher classes guarantee the lower
+	// ones a share of each iteration. The default quantum is 1, and the iteration budget also
+	// ends the pass.
+	void setPriorityQuantum(Priority priority, std::uint_least32_t dispatches) noexcept;	// at least 1
+	std::uint_least32_t priorityQuantum(Priority priority) const noexcept;
+	bool setHandlerPriority(HandlerId id, Priority priority);
+	Priority handlerPriority(HandlerId id) const noexcept;	// Normal for an invalid id
+
+	// A handler that yields from onEventTrigger(), and returns true, is dispatched again in the
+	// next iteration, after the events reported by the wait, even if its event is not signaled.
+	// The wait does not block while yielded handlers are queued. Its event goes to the end of the
+	// wait set, so other signaled handlers are dispatched first, between its budgets. Yielded
+	// handlers left when the iteration budget is spent keep their place for the iteration after.
+	void setBudget(Budget const &dispatchBudget) noexcept;
+	Budget const &budget() const noexcept;
+	bool budgetExhausted() const noexcept;
+	std::size_t workRemaining() const noexcept;	// SIZE_MAX with no work limit
+	void consumeWork(std::size_t units) noexcept;
+	bool yieldDispatch() noexcept;			// false outside onEventTrigger()
+
+	// Handlers from allocateHandler() live in the loop memory resource, constructed from the given
+	// arguments. The loop also takes handlers allocated with new for enqueueDisposeHandler().
+	template <typename HandlerT, typename... Args>
+	    HandlerT *allocateHandler(Args &&... args);
 	void deallocateHandler(BaseHandler *handler);
+	std::pmr::memory_resource *memoryResource() const noexcept;
 	void enqueueDisposeHandler(BaseHandler *handler);
 
+	void busyPoll(std::uint_least32_t maxSpinUs, std::uint_least32_t minSpinUs = 0U);
+	std::uint_least32_t busyPollBudgetUs() const noexcept;
+	std::uint_least64_t busyPollHits() const noexcept;
+	std::uint_least64_t busyPollMisses() const noexcept;
+
+	void attachTrace(EventTrace *eventTrace) noexcept;
+	EventTrace *attachedTrace() const noexcept;
+
+	DispatchState dispatchState() const noexcept;	// from any thread
+
+	// Attach before adding a timer handler. Busy polling is not used with a backend.
+	void attachBackend(Backend *loopBackend) noexcept;
+	Backend *attachedBackend() const noexcept;
+	ULONGLONG tickCountMs() const;			// loop clock, from the backend if attached
+
 	void postQuitRequest();
 	bool quitRequestPending();
 	void triggerNextEvent();
 	void runLoop(ExceptionHandler *handler = nullptr);
 
-	EventLoop(Library &);
+	// The tables and the handlers from allocateHandler() are allocated from the memory resource,
+	// that must outlive the loop and is only used from the loop thread. Use a CountingResource
+	// to measure the allocations.
+	EventLoop(Library &, std::pmr::memory_resource *memoryResource = std::pmr::get_default_resource());
     };
 }
 
@@ -181,34 +487,497 @@ inline void netsocket::EventLoop::BaseHandler::onLoopQuit(EventLoop &)
 {
 }
 
-inline void netsocket::EventLoop::postQuitRequest()
+inline bool netsocket::EventLoop::DeadlineHandler::pendingDeadline() const noexcept
 {
-    loopRunning = false;
+    return deadlinePosition != noSlot;
 }
 
-inline bool netsocket::EventLoop::quitRequestPending()
+inline netsocket::EventLoop::DeadlineHandler::~DeadlineHandler()
 {
-    return !loopRunning;
+    if (deadlinePosition != noSlot)
+	deadlineLoop->cancelDeadline(*this);
+}
+
+inline bool netsocket::EventLoop::IterationEndHandler::pendingIterationEnd() const noexcept
+{
+    return iterationEndPosition != noSlot;
+}
+
+inline netsocket::EventLoop::IterationEndHandler::~IterationEndHandler()
+{
+    if (iterationEndPosition != noSlot)
+	iterationEndLoop->cancelIterationEnd(*this);
+}
+
+inline netsocket::EventLoop::Backend::~Backend()
+{
+}
+
+template <typename T>
+    inline std::size_t netsocket::EventLoop::Storage<T>::size() const noexcept
+{
+    return count;
+}
+
+template <typename T>
+    inline bool netsocket::EventLoop::Storage<T>::empty() const noexcept
+{
+    return !count;
+}
+
+template <typename T>
+    inline T *netsocket::EventLoop::Storage<T>::data() noexcept
+{
+    return items;
+}
+
+template <typename T>
+    inline T &netsocket::EventLoop::Storage<T>::operator [](std::size_t position) noexcept
+{
+    return items[position];
+}
+
+template <typename T>
+    inline T const &netsocket::EventLoop::Storage<T>::operator [](std::size_t position) const noexcept
+{
+    return items[position];
+}
+
+template <typename T>
+    inline T &netsocket::EventLoop::Storage<T>::front() noexcept
+{
+    return items[0U];
 }
 
-inline netsocket::EventLoop::EventLoopException::EventLoopException(BaseException::Tag const& tag, std::uintptr_t errorCode, char const* errorMessage)
-    : BaseException(tag), runtime_error(errorMessage), errorCode(errorCode)
+template <typename T>
+    inline T &netsocket::EventLoop::Storage<T>::back() noexcept
 {
+    return items[count - 1U];
 }
 
-inline netsocket::EventLoop::EventLoopException::EventLoopException(BaseException::Tag const& tag, std::uintptr_t errorCode, std::string const &errorMessage)
-    : BaseException(tag), runtime_error(errorMessage), errorCode(errorCode)
+template <typename T>
+    inline T *netsocket::EventLoop::Storage<T>::begin() noexcept
 {
+    return items;
 }
 
-inline netsocket::EventLoop::EventLoopException::EventLoopException(BaseException::Tag const& tag, std::uintptr_t errorCode, std::string &&errorMessage)
-    : BaseException(tag), runtime_error(errorMessage), errorCode(errorCode)
+template <typename T>
+    inline T *netsocket::EventLoop::Storage<T>::end() noexcept
+{
+    return items + count;
+}
+
+template <typename T>
+    inline void netsocket::EventLoop::Storage<T>::push_back(T const &item)
+{
+    if (count == limit)
+    {
+	if (fixed)
+	    throw StorageExceeded();
+
+	T copy = item;
+	std::size_t newLimit = limit ? limit * 2U : 8U;
+	T *newItems = static_cast<T *>(resource->allocate(newLimit * sizeof(T), alignof(T)));
+
+	std::uninitialized_copy(items, items + count, newItems);
+	release();
+	items = newItems;
+	limit = newLimit;
+	items[count++] = copy;
+
+	return;
+    }
+
+    items[count++] = item;
+}
+
+template <typename T>
+    inline void netsocket::EventLoop::Storage<T>::pop_back() noexcept
+{
+    count--;
+}
+
+template <typename T>
+    inline void netsocket::EventLoop::Storage<T>::clear() noexcept
+{
+    count = 0U;
+}
+
+// Only for an empty array
+template <typename T>
+    inline void netsocket::EventLoop::Storage<T>::attach(T *buffer, std::size_t capacity) noexcept
+{
+    release();
+    items = buffer;
+    limit = capacity;
+    fixed = true;
+}
+
+template <typename T>
+    inline void netsocket::EventLoop::Storage<T>::release() noexcept
+{
+    if (items && !fixed)
+	resource->deallocate(items, limit * sizeof(T), alignof(T));
+}
+
+template <typename T>
+    inline netsocket::EventLoop::Storage<T>::Storage(std::pmr::memory_resource *memoryResource) noexcept
+	: resource(memoryResource)
+{
+}
+
+template <typename T>
+    inline netsocket::EventLoop::Storage<T>::~Storage()
+{
+    release();
+}
+
+inline bool netsocket::EventLoop::DispatchState::operator ==(DispatchState const &other) const noexcept
+{
+    return kind == other.kind && handler == other.handler && sequence == other.sequence;
+}
+
+inline bool netsocket::EventLoop::DispatchState::operator !=(DispatchState const &other) const noexcept
+{
+    return !(*this == other);
+}
+
+inline bool netsocket::EventLoop::HandlerId::operator ==(HandlerId const &other) const noexcept
+{
+    return index == other.index && generation == other.generation;
+}
+
+inline bool netsocket::EventLoop::HandlerId::operator !=(HandlerId const &other) const noexcept
+{
+    return !(*this == other);
+}
+
+inline bool netsocket::EventLoop::registeredHandler(BaseHandler const *handler) const noexcept
+{
+    return handler->slot < handlers.size() && handlers[handler->slot].handler == handler;
+}
+
+inline netsocket::EventLoop::HandlerSlot *netsocket::EventLoop::handlerSlot(HandlerId id) noexcept
+{
+    if (id.index < handlers.size() && handlers[id.index].generation == id.generation && handlers[id.index].handler)
+	return &handlers[id.index];
+
+    return nullptr;
+}
+
+inline netsocket::EventLoop::HandlerSlot const *netsocket::EventLoop::handlerSlot(HandlerId id) const noexcept
+{
+    if (id.index < handlers.size() && handlers[id.index].generation == id.generation && handlers[id.index].handler)
+	return &handlers[id.index];
+
+    return nullptr;
+}
+
+inline void netsocket::EventLoop::checkDuplicateEvent(WSAEVENT wsaEvent)
+{
+    for (std::size_t position = 0U; position < events.size(); position++)
+	if (events[position] == wsaEvent)
+	    if (eventSlots[position] == dispatchSlot)
+		dispatchSlotReplaced = true;	// the handler being dispatched will give up the event
+	    else
+		throw MultipleHandlers(wsaEvent);
+}
+
+inline void netsocket::EventLoop::placeEvent(std::uint_least32_t position, WSAEVENT wsaEvent, std::uint_least32_t slotIndex) noexcept
+{
+    events[position] = wsaEvent;
+    eventSlots[position] = slotIndex;
+    handlers[slotIndex].position = position;
+}
+
+// The event goes at the end of its class. The first event of each lower class moves to the end
+// of that class, to make room, instead of shifting all of them. Nothing changes if it throws.
+inline void netsocket::EventLoop::armSlot(std::uint_least32_t slotIndex, WSAEVENT wsaEvent)
+{
+    if (events.size() >= eventLimit)
+	throw EventCountExceeded();
+
+    std::size_t priority = static_cast<std::size_t>(handlers[slotIndex].priority);
+    std::uint_least32_t hole = static_cast<std::uint_least32_t>(events.size());
+
+    events.push_back(wsaEvent);
+
+    try
+    {
+	eventSlots.push_back(slotIndex);
+    }
+    catch (...)
+    {
+	events.pop_back();
+	throw;
+    }
+
+    for (std::size_t lowerClass = priorityClasses - 1U; lowerClass > priority; lowerClass--)
+    {
+	std::uint_least32_t first = priorityEnd[lowerClass - 1U];
+
+	if (first != hole)
+	    placeEvent(hole, events[first], eventSlots[first]);
+
+	hole = first;
+	priorityEnd[lowerClass]++;
+    }
+
+    priorityEnd[priority]++;
+    placeEvent(hole, wsaEvent, slotIndex);
+}
+
+inline void netsocket::EventLoop::disarmSlot(std::uint_least32_t slotIndex) noexcept
+{
+    std::uint_least32_t position = handlers[slotIndex].position;
+
+    if (position == noSlot)
+	return;
+
+    // Move the last event of the class into the released position, instead of shifting the ones
+    // after it, and the same for the hole left in each lower class
+    for (std::size_t priority = static_cast<std::size_t>(handlers[slotIndex].priority); priority < priorityClasses; priority++)
+    {
+	std::uint_least32_t last = --priorityEnd[priority];
+
+	if (position != last)
+	    placeEvent(position, events[last], eventSlots[last]);
+
+	position = last;
+    }
+
+    events.pop_back();
+    eventSlots.pop_back();
+    handlers[slotIndex].position = noSlot;
+}
+
+inline void netsocket::EventLoop::dropYielded(std::uint_least32_t slotIndex) noexcept
+{
+    HandlerSlot &slot = handlers[slotIndex];
+    std::uint_least32_t position = slot.yieldedPosition;
+
+    if (position == noSlot)
+	return;
+
+    slot.yieldedPosition = noSlot;
+
+    // doYieldedEvents() compacts the queue after its pass
+    if (yieldedPassActive)
+    {
+	yieldedHandlers[position] = HandlerId { };
+	return;
+    }
+
+    HandlerId last = yieldedHandlers.back();
+
+    yieldedHandlers.pop_back();
+
+    if (position < yieldedHandlers.size() && last.index != noSlot)
+    {
+	yieldedHandlers[position] = last;
+	handlers[last.index].yieldedPosition = position;
+    }
+}
+
+inline void netsocket::EventLoop::releaseSlot(std::uint_least32_t slotIndex) noexcept
+{
+    disarmSlot(slotIndex);
+
+    HandlerSlot &slot = handlers[slotIndex];
+
+    dropYielded(slotIndex);
+    slot.handler = nullptr;
+    slot.generation++;
+    slot.position = freeSlot;
+    freeSlot = slotIndex;
+}
+
+inline void netsocket::EventLoop::adaptBusyPoll(LONGLONG arrivalTicks) noexcept
+{
+    BusyPollState &state = busyPollState;
+
+    // long idle periods count as 4 times the maximum budget, so the average recovers quickly
+    if (arrivalTicks > 4 * state.maxTicks)
+	arrivalTicks = 4 * state.maxTicks;
+
+    state.averageArrivalTicks += (arrivalTicks - state.averageArrivalTicks) / 8;
+
+    if (2 * state.averageArrivalTicks <= state.maxTicks)
+	state.budgetTicks = 2 * state.averageArrivalTicks < state.minTicks ? state.minTicks : 2 * state.averageArrivalTicks;
+    else
+	state.budgetTicks = state.minTicks;
+}
+
+inline void netsocket::EventLoop::busyPoll(std::uint_least32_t maxSpinUs, std::uint_least32_t minSpinUs)
+{
+    LARGE_INTEGER frequency;
+    ::QueryPerformanceFrequency(&frequency);
+
+    if (minSpinUs > maxSpinUs)
+	minSpinUs = maxSpinUs;
+
+    BusyPollState &state = busyPollState;
+
+    state.ticksPerMs = frequency.QuadPart / 1000;
+    state.ticksPerUs = frequency.QuadPart / 1000000 ? frequency.QuadPart / 1000000 : 1;
+    state.minTicks = static_cast<LONGLONG>(minSpinUs) * frequency.QuadPart / 1000000;
+    state.maxTicks = static_cast<LONGLONG>(maxSpinUs) * frequency.QuadPart / 1000000;
+    state.budgetTicks = state.maxTicks;
+    state.averageArrivalTicks = state.maxTicks / 2;
+}
+
+inline void netsocket::EventLoop::setBudget(Budget const &dispatchBudget) noexcept
+{
+    LARGE_INTEGER frequency;
+    ::QueryPerformanceFrequency(&frequency);
+
+    budgetState.limits = dispatchBudget;
+    budgetState.dispatchTicks = static_cast<LONGLONG>(dispatchBudget.dispatchUs) * frequency.QuadPart / 1000000;
+    budgetState.iterationTicks = static_cast<LONGLONG>(dispatchBudget.iterationUs) * frequency.QuadPart / 1000000;
+}
+
+inline netsocket::EventLoop::Budget const &netsocket::EventLoop::budget() const noexcept
+{
+    return budgetState.limits;
+}
+
+inline LONGLONG netsocket::EventLoop::performanceTicks() noexcept
+{
+    LARGE_INTEGER counter;
+    ::QueryPerformanceCounter(&counter);
+
+    return counter.QuadPart;
+}
+
+inline bool netsocket::EventLoop::budgetExhausted() const noexcept
+{
+    BudgetState const &state = budgetState;
+
+    if (state.limits.dispatchWork && state.workUsed >= state.limits.dispatchWork)
+	return true;
+
+    if (!state.dispatchTicks && !state.iterationTicks)
+	return false;
+
+    LONGLONG currentTicks = performanceTicks();
+
+    return (state.dispatchTicks && currentTicks - state.dispatchStartTicks >= state.dispatchTicks)
+	|| (state.iterationTicks && currentTicks - state.iterationStartTicks >= state.iterationTicks);
+}
+
+inline std::size_t netsocket::EventLoop::workRemaining() const noexcept
+{
+    if (!budgetState.limits.dispatchWork)
+	return SIZE_MAX;
+
+    return budgetState.workUsed < budgetState.limits.dispatchWork ? budgetState.limits.dispatchWork - budgetState.workUsed : 0U;
+}
+
+inline void netsocket::EventLoop::consumeWork(std::size_t units) noexcept
+{
+    budgetState.workUsed += units;
+}
+
+inline bool netsocket::EventLoop::iterationBudgetSpent() const noexcept
+{
+    return budgetState.iterationTicks && performanceTicks() - budgetState.iterationStartTicks >= budgetState.iterationTicks;
+}
+
+inline bool netsocket::EventLoop::yieldDispatch() noexcept
+{
+    if (dispatchSlot == noSlot)
+	return false;
+
+    dispatchYielded = true;
+
+    return true;
+}
+
+inline std::uint_least32_t netsocket::EventLoop::busyPollBudgetUs() const noexcept
+{
+    return busyPollState.ticksPerUs ? static_cast<std::uint_least32_t>(busyPollState.budgetTicks / busyPollState.ticksPerUs) : 0U;
+}
+
+inline std::uint_least64_t netsocket::EventLoop::busyPollHits() const noexcept
+{
+    return busyPollState.hits;
+}
+
+inline std::uint_least64_t netsocket::EventLoop::busyPollMisses() const noexcept
+{
+    return busyPollState.misses;
+}
+
+inline void netsocket::EventLoop::attachTrace(EventTrace *eventTrace) noexcept
+{
+    trace = eventTrace;
+}
+
+inline netsocket::EventTrace *netsocket::EventLoop::attachedTrace() const noexcept
+{
+    return trace;
+}
+
+// The loop thread pays a single relaxed store for each dispatch: 13 bits of sequence, 3 bits
+// for the kind and 48 bits for the handler address, enough for user mode pointers
+inline void netsocket::EventLoop::markDispatch(EventTrace::Kind kind, void const *handler) noexcept
+{
+    static_assert(static_cast<std::uint_least64_t>(EventTrace::Kind::Quit) < 8U, "Dispatch kind takes 3 bits");
+
+    dispatchSequence++;
+    dispatchWord.store
+	(
+	    dispatchSequence << 51U | static_cast<std::uint_least64_t>(kind) << 48U | (static_cast<std::uint_least64_t>(reinterpret_cast<std::uintptr_t>(handler)) & 0xFFFFFFFFFFFFU),
+	    std::memory_order_relaxed
+	);
+}
+
+inline netsocket::EventLoop::DispatchState netsocket::EventLoop::dispatchState() const noexcept
+{
+    std::uint_least64_t word = dispatchWord.load(std::memory_order_relaxed);
+
+    return DispatchState
+    {
+	static_cast<EventTrace::Kind>(word >> 48U & 0x7U),
+	reinterpret_cast<void const *>(static_cast<std::uintptr_t>(word & 0xFFFFFFFFFFFFU)),
+	static_cast<std::uint_least32_t>(word >> 51U)
+    };
+}
+
+inline void netsocket::EventLoop::attachBackend(Backend *loopBackend) noexcept
+{
+    backend = loopBackend;
+}
+
+inline netsocket::EventLoop::Backend *netsocket::EventLoop::attachedBackend() const noexcept
+{
+    return backend;
+}
+
+inline ULONGLONG netsocket::EventLoop::tickCountMs() const
+{
+    return backend ? backend->tickCountMs() : ::GetTickCount64();
+}
+
+inline void netsocket::EventLoop::postQuitRequest()
+{
+    loopRunning = false;
+    quitDispatched = true;
+}
+
+inline bool netsocket::EventLoop::quitRequestPending()
+{
+    return !loopRunning;
+}
+
+inline netsocket::EventLoop::EventLoopException::EventLoopException(BaseException::Tag const& tag, std::uintptr_t errorCode, char const* errorMessage) noexcept
+    : BaseException(tag), errorCode(errorCode), errorMessage(errorMessage)
 {
 }
 
 inline char const* netsocket::EventLoop::EventLoopException::what() const noexcept
 {
-    return this->runtime_error::what();
+    return errorMessage;
 }
 
 inline std::uintptr_t netsocket::EventLoop::EventLoopException::baseErrorCode() const noexcept
@@ -221,6 +990,11 @@ inline netsocket::EventLoop::EventCountExceeded::EventCountExceeded()
 {
 }
 
+inline netsocket::EventLoop::StorageExceeded::StorageExceeded()
+    : EventLoopException(storageExceededTag, 0U, "Handler capacity of the fixed event loop was exceeded")
+{
+}
+
 inline netsocket::EventLoop::MultipleHandlers::MultipleHandlers(EventHandle wsaEvent)
     : EventLoopException(multipleHandlersTag, static_cast<std::uintptr_t>(HandlerType::Event), "Multiple handlers registered in event loop for WSA event"),
 	wsaEvent(wsaEvent)
@@ -228,12 +1002,7 @@ inline netsocket::EventLoop::MultipleHandlers::MultipleHandlers(EventHandle wsaE
 }
 
 inline netsocket::EventLoop::MultipleHandlers::MultipleHandlers(HandlerType handlerType)
-    : EventLoopException
-	(
-	    multipleHandlersTag,
-	    static_cast<std::uintptr_t>(handlerType),
-	    "Multiple " + handlerTypeString(handlerType) + " handlers registered for socket event loop."
-	)
+    : EventLoopException(multipleHandlersTag, static_cast<std::uintptr_t>(handlerType), handlerTypeMessage(handlerType))
 {
 }
 
@@ -242,9 +1011,25 @@ inline netsocket::EventHandle netsocket::EventLoop::MultipleHandlers::event()
     return std::move(EventHandle(wsaEvent));
 }
 
-inline netsocket::EventLoop::InvalidAPIFunctionReturn::InvalidAPIFunctionReturn(std::uintptr_t returnValue, char const *apiFunctionName)
-    : EventLoopException(invalidApiReturnValueTag, returnValue, "Invalid return value " + std::to_string(returnValue) + " from WinSock2 API function " + apiFunctionName)
+inline netsocket::EventLoop::InvalidAPIFunctionReturn::InvalidAPIFunctionReturn(std::uintptr_t returnValue, char const *apiFunctionName) noexcept
+    : EventLoopException(invalidApiReturnValueTag, returnValue, "Invalid return value from WinSock2 API function"),
+	functionName(apiFunctionName)
 {
+    std::snprintf
+	(
+	    text, sizeof text, "Invalid return value %llu from WinSock2 API function %s",
+	    static_cast<unsigned long long>(returnValue), apiFunctionName
+	);
+}
+
+inline char const *netsocket::EventLoop::InvalidAPIFunctionReturn::apiFunction() const noexcept
+{
+    return functionName;
+}
+
+inline char const *netsocket::EventLoop::InvalidAPIFunctionReturn::what() const noexcept
+{
+    return text;
 }
 
 
@@ -260,12 +1045,12 @@ inline netsocket::EventLoop::~EventLoop()
 
 inline unsigned long netsocket::EventLoop::capacity() const noexcept
 {
-    return WSA_MAXIMUM_WAIT_EVENTS;
+    return eventLimit;
 }
 
 inline unsigned long netsocket::EventLoop::available() const noexcept
 {
-    return WSA_MAXIMUM_WAIT_EVENTS - events.size();
+    return eventLimit - events.size();
 }
 
 inline bool netsocket::EventLoop::full() const noexcept
@@ -273,19 +1058,41 @@ inline bool netsocket::EventLoop::full() const noexcept
     return !available();
 }
 
-inline void netsocket::EventLoop::addEventHandler(EventHandler &handler)
+inline netsocket::EventLoop::HandlerId netsocket::EventLoop::addEventHandler(EventHandler &handler, Priority priority)
 {
     WSAEVENT wsaEvent = handler.eventHandle();
-    EventHandler *&handlerPtr = handlers[wsaEvent];
-
-    if (handlerPtr)
-	throw MultipleHandlers(wsaEvent);
 
-    if (events.size() >= WSA_MAXIMUM_WAIT_EVENTS)
+    if (events.size() >= eventLimit)
 	throw EventCountExceeded();
 
-    events.push_back(wsaEvent);
-    handlerPtr = &handler;
+    checkDuplicateEvent(wsaEvent);
+
+    std::uint_least32_t slotIndex = freeSlot;
+
+    if (slotIndex == noSlot)
+    {
+	slotIndex = static_cast<std::uint_least32_t>(handlers.size());
+	handlers.push_back({ nullptr, 0U, noSlot, Priority::Normal, noSlot, 0U });
+    }
+    else
+	freeSlot = handlers[slotIndex].position;
+
+    handlers[slotIndex].handler = &handler;
+    handlers[slotIndex].position = noSlot;
+    handlers[slotIndex].priority = priority;
+    handler.slot = slotIndex;
+
+    try
+    {
+	armSlot(slotIndex, wsaEvent);
+    }
+    catch (...)
+    {
+	releaseSlot(slotIndex);
+	throw;
+    }
+
+    return { slotIndex, handlers[slotIndex].generation };
 }
 
 inline void netsocket::EventLoop::addTimerHandler(TimerHandler &handler)
@@ -294,7 +1101,7 @@ inline void netsocket::EventLoop::addTimerHandler(TimerHandler &handler)
 	throw MultipleHandlers(HandlerType::Timer);
 
     timer = &handler;
-    timerTargetTickCountMs = ::GetTickCount64() + timer->timerIntervalMs();
+    timerTargetTickCountMs = tickCountMs() + timer->timerIntervalMs();
 }
 
 inline void netsocket::EventLoop::addExceptionHandler(ExceptionHandler &handler)
@@ -313,19 +1120,281 @@ inline void netsocket::EventLoop::addIterationHandler(IterationHandler &handler)
     iterationHandler = &handler;
 }
 
-template <typename HandlerT>
-    inline HandlerT *netsocket::EventLoop::allocateHandler()
+inline void netsocket::EventLoop::placeDeadline(std::size_t position, DeadlineHandler *handler) noexcept
 {
-    return new HandlerT();
+    deadlines[position] = handler;
+    handler->deadlinePosition = static_cast<std::uint_least32_t>(position);
+}
+
+// Moves the deadline at the given position up or down the heap, to its place
+inline void netsocket::EventLoop::siftDeadline(std::size_t position) noexcept
+{
+    DeadlineHandler *handler = deadlines[position];
+
+    while (position && deadlines[(position - 1U) / 2U]->deadlineTickCountMs > handler->deadlineTickCountMs)
+    {
+	placeDeadline(position, deadlines[(position - 1U) / 2U]);
+	position = (position - 1U) / 2U;
+    }
+
+    for (std::size_t child = position * 2U + 1U; child < deadlines.size(); child = position * 2U + 1U)
+    {
+	if (child + 1U < deadlines.size() && deadlines[child + 1U]->deadlineTickCountMs < deadlines[child]->deadlineTickCountMs)
+	    child++;
+
+	if (deadlines[child]->deadlineTickCountMs >= handler->deadlineTickCountMs)
+	    break;
+
+	placeDeadline(position, deadlines[child]);
+	position = child;
+    }
+
+    placeDeadline(position, handler);
+}
+
+inline void netsocket::EventLoop::removeDeadline(std::size_t position) noexcept
+{
+    deadlines[position]->deadlinePosition = noSlot;
+
+    DeadlineHandler *last = deadlines.back();
+    deadlines.pop_back();
+
+    if (position < deadlines.size())
+    {
+	placeDeadline(position, last);
+	siftDeadline(position);
+    }
+}
+
+inline void netsocket::EventLoop::setDeadline(DeadlineHandler &handler, std::uint_least32_t delayMs)
+{
+    if (handler.deadlinePosition != noSlot && handler.deadlineLoop != this)
+	handler.deadlineLoop->cancelDeadline(handler);
+
+    handler.deadlineTickCountMs = tickCountMs() + delayMs;
+    handler.deadlineLoop = this;
+
+    if (handler.deadlinePosition == noSlot)
+    {
+	deadlines.push_back(&handler);
+	handler.deadlinePosition = static_cast<std::uint_least32_t>(deadlines.size() - 1U);
+    }
+
+    siftDeadline(handler.deadlinePosition);
+}
+
+inline bool netsocket::EventLoop::cancelDeadline(DeadlineHandler &handler) noexcept
+{
+    if (handler.deadlinePosition == noSlot || handler.deadlineLoop != this)
+	return false;
+
+    removeDeadline(handler.deadlinePosition);
+
+    return true;
+}
+
+inline void netsocket::EventLoop::requestIterationEnd(IterationEndHandler &handler)
+{
+    if (handler.iterationEndPosition != noSlot)
+	return;
+
+    iterationEndHandlers.push_back(&handler);
+    handler.iterationEndLoop = this;
+    handler.iterationEndPosition = static_cast<std::uint_least32_t>(iterationEndHandlers.size() - 1U);
+}
+
+// Entries the running pass still walks over are only cleared, so they do not shift. The others
+// are replaced with the last entry, so the list only holds the live requests.
+inline bool netsocket::EventLoop::cancelIterationEnd(IterationEndHandler &handler) noexcept
+{
+    if (handler.iterationEndPosition == noSlot || handler.iterationEndLoop != this)
+	return false;
+
+    std::uint_least32_t position = handler.iterationEndPosition;
+
+    if (position < iterationEndPassEnd)
+	iterationEndHandlers[position] = nullptr;
+    else
+    {
+	IterationEndHandler *last = iterationEndHandlers.back();
+
+	iterationEndHandlers[position] = last;
+	last->iterationEndPosition = position;
+	iterationEndHandlers.pop_back();
+    }
+
+    handler.iterationEndPosition = noSlot;
+
+    return true;
+}
+
+inline bool netsocket::EventLoop::validHandler(HandlerId id) const noexcept
+{
+    return handlerSlot(id) != nullptr;
+}
+
+inline bool netsocket::EventLoop::armedHandler(HandlerId id) const noexcept
+{
+    HandlerSlot const *slot = handlerSlot(id);
+
+    return slot && slot->position != noSlot;
+}
+
+inline netsocket::EventLoop::EventHandler *netsocket::EventLoop::eventHandler(HandlerId id) const noexcept
+{
+    HandlerSlot const *slot = handlerSlot(id);
+
+    return slot ? slot->handler : nullptr;
+}
+
+inline netsocket::EventLoop::HandlerId netsocket::EventLoop::eventHandlerId(EventHandler const &handler) const noexcept
+{
+    if (registeredHandler(&handler))
+	return { handler.slot, handlers[handler.slot].generation };
+
+    return { };
+}
+
+inline bool netsocket::EventLoop::removeEventHandler(HandlerId id)
+{
+    if (!handlerSlot(id))
+	return false;
+
+    releaseSlot(id.index);
+
+    return true;
+}
+
+inline bool netsocket::EventLoop::disarmEventHandler(HandlerId id)
+{
+    if (!handlerSlot(id))
+	return false;
+
+    disarmSlot(id.index);
+
+    return true;
+}
+
+inline bool netsocket::EventLoop::rearmEventHandler(HandlerId id)
+{
+    HandlerSlot *slot = handlerSlot(id);
+
+    if (!slot)
+	return false;
+
+    if (slot->position == noSlot)
+    {
+	WSAEVENT wsaEvent = slot->handler->eventHandle();
+
+	checkDuplicateEvent(wsaEvent);
+	armSlot(id.index, wsaEvent);
+    }
+
+    return true;
+}
+
+inline void netsocket::EventLoop::setPriorityQuantum(Priority priority, std::uint_least32_t dispatches) noexcept
+{
+    priorityQuanta[static_cast<std::size_t>(priority)] = dispatches ? dispatches : 1U;
+}
+
+inline std::uint_least32_t netsocket::EventLoop::priorityQuantum(Priority priority) const noexcept
+{
+    return priorityQuanta[static_cast<std::size_t>(priority)];
+}
+
+// An armed handler moves to the end of its new class, which can not fail as it frees its own
+// place first
+inline bool netsocket::EventLoop::setHandlerPriority(HandlerId id, Priority priority)
+{
+    HandlerSlot *slot = handlerSlot(id);
+
+    if (!slot)
+	return false;
+
+    if (slot->priority != priority)
+	if (slot->position == noSlot)
+	    slot->priority = priority;
+	else
+	{
+	    WSAEVENT wsaEvent = events[slot->position];
+
+	    disarmSlot(id.index);
+	    slot->priority = priority;
+	    armSlot(id.index, wsaEvent);
+	}
+
+    return true;
+}
+
+inline netsocket::EventLoop::Priority netsocket::EventLoop::handlerPriority(HandlerId id) const noexcept
+{
+    HandlerSlot const *slot = handlerSlot(id);
+
+    return slot ? slot->priority : Priority::Normal;
+}
+
+template <typename HandlerT, typename... Args>
+    inline HandlerT *netsocket::EventLoop::allocateHandler(Args &&... args)
+{
+    static_assert(alignof(HandlerT) <= alignof(std::max_align_t), "Over-aligned handler type");
+
+    void *memory = loopResource->allocate(sizeof(HandlerT), alignof(std::max_align_t));
+    HandlerT *handler;
+
+    try
+    {
+	handler = new (memory) HandlerT(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+	loopResource->deallocate(memory, sizeof(HandlerT), alignof(std::max_align_t));
+	throw;
+    }
+
+    static_cast<BaseHandler *>(handler)->allocationSize = static_cast<std::uint_least32_t>(sizeof(HandlerT));
+
+    return handler;
 }
 
 inline void netsocket::EventLoop::deallocateHandler(BaseHandler *handler)
 {
-    delete handler;
+    std::size_t size = handler->allocationSize;
+
+    if (!size)
+    {
+	delete handler;
+	return;
+    }
+
+    void *memory = dynamic_cast<void *>(handler);
+
+    handler->~BaseHandler();
+    loopResource->deallocate(memory, size, alignof(std::max_align_t));
+}
+
+inline std::pmr::memory_resource *netsocket::EventLoop::memoryResource() const noexcept
+{
+    return loopResource;
 }
 
 inline void netsocket::EventLoop::enqueueDisposeHandler(BaseHandler *handler)
 {
+    if (registeredHandler(handler))
+	releaseSlot(handler->slot);
+
+    if (handler == timer)
+	timer = nullptr;
+
+    if (handler == iterationHandler)
+	iterationHandler = nullptr;
+
+    if (handler == exceptionHandler)
+	exceptionHandler = nullptr;
+
+    if (handler == dispatchHandler)
+	dispatchHandler = nullptr;
+
     handler->next = freeList;
     freeList = handler;
 }
@@ -343,7 +1412,9 @@ inline void netsocket::EventLoop::runLoop(ExceptionHandler *handler)
     doQuitEvent();
 }
 
-inline netsocket::EventLoop::EventLoop(Library &)
+inline netsocket::EventLoop::EventLoop(Library &, std::pmr::memory_resource *memoryResource)
+    : loopResource(memoryResource), events(memoryResource), eventSlots(memoryResource), handlers(memoryResource),
+	deadlines(memoryResource), iterationEndHandlers(memoryResource), yieldedHandlers(memoryResource)
 {
 }
 
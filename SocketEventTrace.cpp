@@ -0,0 +1,148 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <typeinfo>
+
+#include "SocketEventTrace.hpp"
+
+using std::size_t;
+using std::int_least64_t;
+using std::uint_least64_t;
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::atomic_thread_fence;
+using std::type_info;
+using std::string;
+using std::ostream;
+using std::ostringstream;
+
+char const *netsocket::EventTrace::kindName(Kind kind) noexcept
+{
+    switch (kind)
+    {
+    case Kind::Wait:
+	return "wait";
+    case Kind::SocketEvent:
+	return "socket event";
+    case Kind::TimerEvent:
+	return "timer event";
+    case Kind::IterationStart:
+	return "iteration start";
+    case Kind::IterationEnd:
+	return "iteration end";
+    case Kind::Dispose:
+	return "dispose";
+    case Kind::Quit:
+	return "quit";
+    }
+
+    return "unknown";
+}
+
+void netsocket::EventTrace::dump(ostream &os) const
+{
+    uint_least64_t
+	end   = head.load(memory_order_acquire),
+	begin = end > capacity() ? end - capacity() : 0U;
+
+    unsigned long tid = threadId.load(memory_order_relaxed);
+    double microsecondsPerTick = 1e6 / static_cast<double>(ticksPerSecond);
+    char timing[96];
+    bool first = true;
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    for (uint_least64_t index = begin; index < end; index++)
+    {
+	Slot const &slot = slots[index & slotMask];
+	uint_least64_t sequence = slot.sequence.load(memory_order_acquire);
+
+	if (sequence != index + 1U)
+	    continue;
+
+	int_least64_t	 startTicks    = slot.startTicks.load(memory_order_relaxed);
+	int_least64_t	 durationTicks = slot.durationTicks.load(memory_order_relaxed);
+	void const	*handler       = slot.handler.load(memory_order_relaxed);
+	type_info const *handlerType   = slot.handlerType.load(memory_order_relaxed);
+	Kind		 kind	       = slot.kind.load(memory_order_relaxed);
+
+	atomic_thread_fence(memory_order_acquire);
+
+	if (slot.sequence.load(memory_order_relaxed) != sequence)
+	    continue;		// overwritten by the loop thread while reading
+
+	std::snprintf
+	    (
+		timing, sizeof timing,
+		"\"ts\":%.3f,\"dur\":%.3f",
+		static_cast<double>(startTicks - originTicks) * microsecondsPerTick,
+		static_cast<double>(durationTicks) * microsecondsPerTick
+	    );
+
+	os << (first ? "" : ",") << "\n{\"name\":\"" << kindName(kind) << "\",\"cat\":\"netsocket\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid << ',' << timing;
+
+	if (handler)
+	{
+	    char address[2U * sizeof(void *) + 3U];
+	    std::snprintf(address, sizeof address, "%p", handler);
+
+	    os << ",\"args\":{\"handler\":\"" << address << '"';
+
+	    if (handlerType)
+	    {
+		os << ",\"type\":\"";
+
+		for (char const *name = handlerType->name(); *name; name++)
+		    if (*name == '"' || *name == '\\')
+			os << '\\' << *name;
+		    else
+			os << *name;
+
+		os << '"';
+	    }
+
+	    os << '}';
+	}
+
+	os << '}';
+	first = false;
+    }
+
+    os << "\n]}\n";
+}
+
+string netsocket::EventTrace::json() const
+{
+    ostringstream os;
+    dump(os);
+
+    return os.str();
+}
+
+netsocket::EventTrace::EventTrace(size_t capacity)
+{
+    size_t slotCount = 1U;
+
+    while (slotCount < capacity)
+	slotCount <<= 1;
+
+    slots.reset(new Slot[slotCount]);
+    slotMask = slotCount - 1U;
+
+    for (size_t index = 0U; index < slotCount; index++)
+	slots[index].sequence.store(0U, memory_order_relaxed);
+
+    LARGE_INTEGER frequency;
+    ::QueryPerformanceFrequency(&frequency);
+
+    ticksPerSecond = frequency.QuadPart;
+    originTicks = ticks();
+}
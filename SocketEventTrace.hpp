@@ -0,0 +1,161 @@
+#if !defined(WINSOCK2_CXX_SOCKET_EVENT_TRACE)
+#define WINSOCK2_CXX_SOCKET_EVENT_TRACE
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <ostream>
+#include <typeinfo>
+
+namespace netsocket
+{
+    // Flight recorder for event loop activity. A fixed-size ring of the most recent records, written
+    // without locks by the loop thread, and readable at any time from any thread, as Chrome trace-event
+    // JSON (chrome://tracing, ui.perfetto.dev). Attach it with EventLoop::attachTrace(), and keep it
+    // alive until it is detached or the loop is destroyed.
+    class EventTrace
+    {
+    public:
+	enum class Kind: std::uint_least32_t
+	{
+	    Wait,
+	    SocketEvent,
+	    TimerEvent,
+	    IterationStart,
+	    IterationEnd,
+	    Dispose,
+	    Quit
+	};
+
+	class Span;
+
+    protected:
+	struct Slot
+	{
+	    std::atomic<std::uint_least64_t>	sequence;
+	    std::atomic<std::int_least64_t>	startTicks;
+	    std::atomic<std::int_least64_t>	durationTicks;
+	    std::atomic<void const *>		handler;
+	    std::atomic<std::type_info const *>	handlerType;
+	    std::atomic<Kind>			kind;
+	};
+
+	std::unique_ptr<Slot[]>		  slots;
+	std::size_t			  slotMask;
+	std::atomic<std::uint_least64_t>  head { 0U };
+	std::atomic<DWORD>		  threadId { 0U };
+	std::int_least64_t		  originTicks;
+	std::int_least64_t		  ticksPerSecond;
+
+	static std::int_least64_t ticks() noexcept;
+	static char const *kindName(Kind kind) noexcept;
+
+    public:
+	void record(Kind kind, std::int_least64_t startTicks, std::int_least64_t endTicks, void const *handler, std::type_info const *handlerType) noexcept;
+
+	std::size_t capacity() const noexcept;
+	std::uint_least64_t recorded() const noexcept;
+
+	void dump(std::ostream &os) const;
+	std::string json() const;
+
+	EventTrace(std::size_t capacity = 65536U);
+	EventTrace(EventTrace const &other) = delete;
+	EventTrace &operator =(EventTrace const &other) = delete;
+    };
+
+    // Records the time from construction to destruction, when a trace is attached
+    class EventTrace::Span
+    {
+    protected:
+	EventTrace		*trace;
+	Kind			 kind;
+	void const		*handler = nullptr;
+	std::type_info const	*handlerType = nullptr;
+	std::int_least64_t	 startTicks = 0;
+
+    public:
+	Span(EventTrace *trace, Kind kind);
+
+	template <typename HandlerT>
+	    Span(EventTrace *trace, Kind kind, HandlerT *handler);
+
+	~Span();
+
+	Span(Span const &other) = delete;
+	Span &operator =(Span const &other) = delete;
+    };
+}
+
+inline std::int_least64_t netsocket::EventTrace::ticks() noexcept
+{
+    LARGE_INTEGER counter;
+    ::QueryPerformanceCounter(&counter);
+
+    return counter.QuadPart;
+}
+
+inline void netsocket::EventTrace::record(Kind kind, std::int_least64_t startTicks, std::int_least64_t endTicks, void const *handler, std::type_info const *handlerType) noexcept
+{
+    // Only the loop thread writes, so head needs no read-modify-write. Each slot is a small seqlock
+    // so a concurrent dump() can detect and skip records that are being overwritten.
+    std::uint_least64_t index = head.load(std::memory_order_relaxed);
+    Slot &slot = slots[index & slotMask];
+
+    slot.sequence.store(0U, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.startTicks.store(startTicks, std::memory_order_relaxed);
+    slot.durationTicks.store(endTicks - startTicks, std::memory_order_relaxed);
+    slot.handler.store(handler, std::memory_order_relaxed);
+    slot.handlerType.store(handlerType, std::memory_order_relaxed);
+    slot.kind.store(kind, std::memory_order_relaxed);
+
+    slot.sequence.store(index + 1U, std::memory_order_release);
+    head.store(index + 1U, std::memory_order_release);
+
+    if (kind == Kind::Wait)
+	threadId.store(::GetCurrentThreadId(), std::memory_order_relaxed);
+}
+
+inline std::size_t netsocket::EventTrace::capacity() const noexcept
+{
+    return slotMask + 1U;
+}
+
+inline std::uint_least64_t netsocket::EventTrace::recorded() const noexcept
+{
+    return head.load(std::memory_order_acquire);
+}
+
+inline netsocket::EventTrace::Span::Span(EventTrace *trace, Kind kind)
+    : trace(trace), kind(kind)
+{
+    if (trace)
+	startTicks = EventTrace::ticks();
+}
+
+template <typename HandlerT>
+    inline netsocket::EventTrace::Span::Span(EventTrace *trace, Kind kind, HandlerT *handler)
+	: trace(trace), kind(kind)
+{
+    if (trace)
+    {
+	this->handler = handler;
+	handlerType = handler ? &typeid(*handler) : nullptr;
+	startTicks = EventTrace::ticks();
+    }
+}
+
+inline netsocket::EventTrace::Span::~Span()
+{
+    if (trace)
+	trace->record(kind, startTicks, EventTrace::ticks(), handler, handlerType);
+}
+
+#endif // !defined(WINSOCK2_CXX_SOCKET_EVENT_TRACE)
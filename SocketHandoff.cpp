@@ -0,0 +1,361 @@
+#include <WinSock2.h>
+#include <Windows.h>
+#include <afunix.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SocketError.hpp"
+#include "SocketHandoff.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::vector;
+
+namespace
+{
+    // Both sides are builds of the same program on the same host, so the messages are sent in
+    // native byte order
+    constexpr uint_least32_t handoffMagic = 0x6F68736EU;		// "nsho"
+    constexpr uint_least32_t handoffVersion = 2U;
+
+    struct HandoffRequest
+    {
+	uint_least32_t magic, version, processId;
+    };
+
+    struct HandoffReply
+    {
+	uint_least32_t magic, version, count;
+    };
+
+    // Followed by the buffered data
+    struct HandoffEntry
+    {
+	uint_least32_t tag, listening, bufferedLength;
+	WSAPROTOCOL_INFOW protocolInfo;
+    };
+
+    sockaddr_un socketPath(std::string const &path)
+    {
+	sockaddr_un address { };
+
+	if (path.empty() || path.size() >= sizeof address.sun_path)
+	    netsocket::raiseError(netsocket::Error::EInval);
+
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path, path.c_str(), path.size());
+
+	return address;
+    }
+}
+
+netsocket::HandoffSource::HandoffSource(Library &socketLib, EventLoop &eventLoop, Provider &provider, char const *path)
+    : socketLib(socketLib), eventLoop(eventLoop), provider(provider), path(path), acceptEvent(socketLib),
+	session(new Session(*this)), peerEvent(socketLib)
+{
+    listen();
+}
+
+netsocket::HandoffSource::~HandoffSource()
+{
+    if (stage != Stage::Idle)
+	endHandoff();
+
+    if (listener)
+	closeListener();
+}
+
+// A socket file left behind by a process that did not exit cleanly would fail the bind
+void netsocket::HandoffSource::listen()
+{
+    sockaddr_un address = socketPath(path);
+
+    listener = Socket(socketLib, AF_UNIX, SOCK_STREAM, 0);
+    ::DeleteFileA(path.c_str());
+    listener.bind(static_cast<sockaddr const *>(static_cast<void const *>(&address)), static_cast<int>(sizeof address));
+    listener.listen(1);
+    listener.selectEvents(acceptEvent.handle(), FD_ACCEPT);
+    handlerId = eventLoop.addEventHandler(*this);
+}
+
+void netsocket::HandoffSource::closeListener() noexcept
+{
+    eventLoop.removeEventHandler(handlerId);
+    listener = Socket();
+    ::DeleteFileA(path.c_str());
+}
+
+// Connections that come in while a handoff runs are closed
+bool netsocket::HandoffSource::onEventTrigger(EventLoop &)
+{
+    listener.networkEvents(acceptEvent.handle());
+
+    while (Socket accepted = listener.accept())
+	if (stage == Stage::Idle)
+	{
+	    peer = std::move(accepted);
+	    peer.selectEvents(peerEvent.handle(), FD_READ | FD_WRITE | FD_CLOSE);
+	    peerHandlerId = eventLoop.addEventHandler(*session);
+
+	    stage = Stage::Request;
+	    message.assign(sizeof(HandoffRequest), 0);
+	    messageOffset = 0U;
+
+	    closeListener();
+
+	    return false;
+	}
+
+    return true;
+}
+
+void netsocket::HandoffSource::pump()
+{
+    if (stage == Stage::Request)
+    {
+	while (messageOffset < message.size())
+	{
+	    int received = peer.receive(message.data() + messageOffset, message.size() - messageOffset);
+
+	    if (received < 0)
+		return;
+
+	    if (!received)
+		raiseError(Error::EConnReset);
+
+	    messageOffset += static_cast<size_t>(received);
+	}
+
+	HandoffRequest request;
+
+	std::memcpy(&request, message.data(), sizeof request);
+
+	if (request.magic != handoffMagic || request.version != handoffVersion)
+	    raiseError(Error::EProtoNoSupport);
+
+	// The sockets are only duplicated for the process at the other end of the connection
+	ULONG peerProcessId = 0U;
+	DWORD dwBytesReturned = 0U;
+
+	wsa_call<SOCKET_ERROR>(::WSAIoctl, peer.handle(), SIO_AF_UNIX_GETPEERPID, nullptr, 0U, &peerProcessId, static_cast<DWORD>(sizeof peerProcessId), &dwBytesReturned, nullptr, nullptr);
+
+	if (request.processId != peerProcessId)
+	    raiseError(Error::EAccess);
+
+	processId = static_cast<DWORD>(peerProcessId);
+	message.assign(sizeof(HandoffReply), 0);
+	messageOffset = 0U;
+	entryCount = 0U;
+	stage = Stage::Reply;
+
+	offering = true;
+	provider.onHandoffRequest(*this);
+	offering = false;
+
+	HandoffReply reply { handoffMagic, handoffVersion, entryCount };
+
+	std::memcpy(message.data(), &reply, sizeof reply);
+    }
+
+    if (stage == Stage::Reply)
+    {
+	while (messageOffset < message.size())
+	{
+	    int sent = peer.send(message.data() + messageOffset, message.size() - messageOffset);
+
+	    if (!sent)
+		return;
+
+	    messageOffset += static_cast<size_t>(sent);
+	}
+
+	stage = Stage::Confirm;
+    }
+
+    char confirmed;
+    int received = peer.receive(&confirmed, sizeof confirmed);
+
+    if (received < 0)
+	return;
+
+    if (!received)
+	raiseError(Error::EConnReset);
+
+    endHandoff();
+    provider.onHandoffComplete(eventLoop);
+}
+
+void netsocket::HandoffSource::endHandoff() noexcept
+{
+    eventLoop.removeEventHandler(peerHandlerId);
+    peer = Socket();
+    message.clear();
+    stage = Stage::Idle;
+    offering = false;
+}
+
+void netsocket::HandoffSource::fail(int wsaError)
+{
+    endHandoff();
+    listen();
+    provider.onHandoffFailed(eventLoop, wsaError);
+}
+
+void netsocket::HandoffSource::offer(Socket const &socket, uint_least32_t tag, bool listening, void const *buffered, size_t length)
+{
+    if (!offering)
+	raiseError(Error::EInval);
+
+    // processId was checked against the peer of the connection in pump()
+
+    HandoffEntry entry { };
+
+    entry.tag = tag;
+    entry.listening = listening ? 1U : 0U;
+    entry.bufferedLength = static_cast<uint_least32_t>(length);
+    wsa_call<SOCKET_ERROR>(::WSADuplicateSocketW, socket.handle(), processId, &entry.protocolInfo);
+
+    size_t position = message.size();
+
+    message.resize(position + sizeof entry + length);
+    std::memcpy(message.data() + position, &entry, sizeof entry);
+
+    if (length)
+	std::memcpy(message.data() + position + sizeof entry, buffered, length);
+
+    entryCount++;
+}
+
+netsocket::HandoffSource::Session::Session(HandoffSource &source)
+    : source(source)
+{
+}
+
+netsocket::EventHandle netsocket::HandoffSource::Session::eventHandle()
+{
+    return source.peerEvent.handle();
+}
+
+// Any error fails the handoff, and the source keeps its sockets and listens again
+bool netsocket::HandoffSource::Session::onEventTrigger(EventLoop &)
+{
+    try
+    {
+	source.peer.networkEvents(source.peerEvent.handle());
+	source.pump();
+    }
+    catch (Exception const &error)
+    {
+	source.fail(error.code().value());
+
+	return false;
+    }
+    catch (...)
+    {
+	source.fail(+Error::EConnAborted);
+
+	throw;
+    }
+
+    return source.stage != Stage::Idle;
+}
+
+void netsocket::HandoffSource::Session::onLoopQuit(EventLoop &)
+{
+    source.endHandoff();
+}
+
+vector<netsocket::HandedSocket> netsocket::HandoffReceiver::receive()
+{
+    sockaddr_un address = socketPath(path);
+    DWORD dwTimeoutMs = static_cast<DWORD>(timeoutMs);
+
+    socket = Socket(socketLib, AF_UNIX, SOCK_STREAM, 0);
+    wsa_call<SOCKET_ERROR>(::setsockopt, socket.handle(), SOL_SOCKET, SO_RCVTIMEO, static_cast<char const *>(static_cast<void const *>(&dwTimeoutMs)), static_cast<int>(sizeof dwTimeoutMs));
+    wsa_call<SOCKET_ERROR>(::setsockopt, socket.handle(), SOL_SOCKET, SO_SNDTIMEO, static_cast<char const *>(static_cast<void const *>(&dwTimeoutMs)), static_cast<int>(sizeof dwTimeoutMs));
+    socket.connect(static_cast<sockaddr const *>(static_cast<void const *>(&address)), static_cast<int>(sizeof address));
+
+    HandoffRequest request { handoffMagic, handoffVersion, static_cast<uint_least32_t>(::GetCurrentProcessId()) };
+    HandoffReply reply;
+
+    sendAll(&request, sizeof request);
+    receiveAll(&reply, sizeof reply);
+
+    if (reply.magic != handoffMagic || reply.version != handoffVersion)
+	raiseError(Error::EProtoNoSupport);
+
+    vector<HandedSocket> sockets;
+
+    sockets.reserve(reply.count);
+
+    for (uint_least32_t index = 0U; index < reply.count; index++)
+    {
+	HandoffEntry entry;
+
+	receiveAll(&entry, sizeof entry);
+
+	HandedSocket handed
+	{
+	    Socket(wsa_call<INVALID_SOCKET>(::WSASocketW, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, &entry.protocolInfo, 0U, static_cast<DWORD>(WSA_FLAG_OVERLAPPED))),
+	    entry.tag,
+	    entry.listening != 0U,
+	    vector<char>(entry.bufferedLength)
+	};
+
+	if (entry.bufferedLength)
+	    receiveAll(handed.buffered.data(), handed.buffered.size());
+
+	sockets.push_back(std::move(handed));
+    }
+
+    return sockets;
+}
+
+void netsocket::HandoffReceiver::confirm()
+{
+    char confirmed = 1;
+
+    sendAll(&confirmed, sizeof confirmed);
+    socket.close();
+}
+
+// The socket is blocking, so an incomplete transfer means the timeout expired
+void netsocket::HandoffReceiver::receiveAll(void *data, size_t length)
+{
+    char *buffer = static_cast<char *>(data);
+
+    while (length)
+    {
+	int received = socket.receive(buffer, length);
+
+	if (!received)
+	    raiseError(Error::EConnReset);
+
+	if (received < 0)
+	    raiseError(Error::ETimedOut);
+
+	buffer += received;
+	length -= static_cast<size_t>(received);
+    }
+}
+
+void netsocket::HandoffReceiver::sendAll(void const *data, size_t length)
+{
+    char const *buffer = static_cast<char const *>(data);
+
+    while (length)
+    {
+	int sent = socket.send(buffer, length);
+
+	if (!sent)
+	    raiseError(Error::ETimedOut);
+
+	buffer += sent;
+	length -= static_cast<size_t>(sent);
+    }
+}
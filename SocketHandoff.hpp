@@ -0,0 +1,191 @@
+#if !defined(WINSOCK2_CXX_SOCKET_HANDOFF)
+#define WINSOCK2_CXX_SOCKET_HANDOFF
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SocketError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+
+namespace netsocket
+{
+    // Socket received from the process being replaced, with the tag it was offered with. For a
+    // connection, buffered holds the data the old process had already read but not processed.
+    struct HandedSocket
+    {
+	Socket socket;
+	std::uint_least32_t tag;
+	bool listening;
+	std::vector<char> buffered;
+    };
+
+    // Hands the listeners of a running process, and optionally its established connections, to the
+    // process replacing it, for restarts without refused connections. The running process keeps
+    // a HandoffSource listening on an AF_UNIX socket path. The new process connects with a
+    // HandoffReceiver and sends its process id, and the source replies with the sockets offered by
+    // its Provider, duplicated with WSADuplicateSocketW() for the new process. A request whose
+    // process id is not the one of the connected peer fails the handoff with EAccess.
+    //
+    // The new process adds the sockets to its own loop before it confirms the handoff, and only
+    // then the old process is told to quit, so the listeners never stop accepting. Until the old
+    // process closes them, both processes hold the same sockets: the old one should stop reading
+    // the connections it offered. AF_UNIX sockets need Windows 10 version 1803 or later.
+    class HandoffSource: public EventLoop::EventHandler
+    {
+    public:
+	class Provider
+	{
+	public:
+	    // Offer the sockets from here. Nothing is sent if the handler throws.
+	    virtual void onHandoffRequest(HandoffSource &source) = 0;
+
+	    // The new process has the sockets. Usually posts the quit request, so the loop drains
+	    // in doQuitEvent().
+	    virtual void onHandoffComplete(EventLoop &eventLoop) = 0;
+
+	    // The new process went away before it confirmed, and the source listens again. The
+	    // sockets were not taken over.
+	    virtual void onHandoffFailed(EventLoop &eventLoop, int wsaError);
+
+	    virtual ~Provider();
+	};
+
+	// Only from Provider::onHandoffRequest(), throws EInval otherwise
+	void offerListener(Socket const &socket, std::uint_least32_t tag);
+	void offerConnection(Socket const &socket, std::uint_least32_t tag, void const *buffered = nullptr, std::size_t length = 0U);
+
+	bool busy() const noexcept;			// a handoff is in progress
+
+	HandoffSource(Library &socketLib, EventLoop &eventLoop, Provider &provider, char const *path);
+	~HandoffSource();				// removes the socket file while listening
+	HandoffSource(HandoffSource const &other) = delete;
+	HandoffSource &operator =(HandoffSource const &other) = delete;
+
+    protected:
+	class Session;
+
+	enum class Stage
+	{
+	    Idle,
+	    Request,
+	    Reply,
+	    Confirm
+	};
+
+	Library &socketLib;
+	EventLoop &eventLoop;
+	Provider &provider;
+	std::string path;
+	Socket listener;
+	Event acceptEvent;
+	EventLoop::HandlerId handlerId;
+
+	// Only one handoff at a time. The socket path is removed while it runs, so the new process
+	// can create its own source on the same path once it received the sockets.
+	std::unique_ptr<Session> session;		// handler for the peer socket
+	Socket peer;
+	Event peerEvent;
+	EventLoop::HandlerId peerHandlerId;
+	Stage stage = Stage::Idle;
+	std::vector<char> message;			// request, then reply
+	std::size_t messageOffset = 0U;
+	std::uint_least32_t entryCount = 0U;
+	DWORD processId = 0U;
+	bool offering = false;
+
+	void listen();
+	void closeListener() noexcept;
+	void pump();
+	void endHandoff() noexcept;
+	void fail(int wsaError);
+	void offer(Socket const &socket, std::uint_least32_t tag, bool listening, void const *buffered, std::size_t length);
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+
+	friend class Session;
+    };
+
+    class HandoffSource::Session: public EventLoop::EventHandler
+    {
+    protected:
+	HandoffSource &source;
+
+	virtual EventHandle eventHandle() override;
+	virtual bool onEventTrigger(EventLoop &eventLoop) override;
+	virtual void onLoopQuit(EventLoop &eventLoop) override;
+
+	Session(HandoffSource &source);
+
+	friend class HandoffSource;
+    };
+
+    // New process side of the handoff. Blocking, with the timeout applied to each send and
+    // receive, and meant to run before the new loop starts, or right after.
+    class HandoffReceiver
+    {
+    public:
+	// Throws when no process listens on the path, as on a cold start, with EConnRefused or the
+	// error for a missing file
+	std::vector<HandedSocket> receive();
+
+	// Once the sockets are in the new loop. The old process is told to quit.
+	void confirm();
+
+	HandoffReceiver(Library &socketLib, char const *path, std::uint_least32_t timeoutMs = 5000U);
+
+    protected:
+	Library &socketLib;
+	std::string path;
+	std::uint_least32_t timeoutMs;
+	Socket socket;
+
+	void receiveAll(void *data, std::size_t length);
+	void sendAll(void const *data, std::size_t length);
+    };
+}
+
+inline netsocket::HandoffSource::Provider::~Provider()
+{
+}
+
+inline void netsocket::HandoffSource::Provider::onHandoffFailed(EventLoop &, int)
+{
+}
+
+inline void netsocket::HandoffSource::offerListener(Socket const &socket, std::uint_least32_t tag)
+{
+    offer(socket, tag, true, nullptr, 0U);
+}
+
+inline void netsocket::HandoffSource::offerConnection(Socket const &socket, std::uint_least32_t tag, void const *buffered, std::size_t length)
+{
+    offer(socket, tag, false, buffered, length);
+}
+
+inline bool netsocket::HandoffSource::busy() const noexcept
+{
+    return stage != Stage::Idle;
+}
+
+inline netsocket::EventHandle netsocket::HandoffSource::eventHandle()
+{
+    return acceptEvent.handle();
+}
+
+inline netsocket::HandoffReceiver::HandoffReceiver(Library &socketLib, char const *path, std::uint_least32_t timeoutMs)
+    : socketLib(socketLib), path(path), timeoutMs(timeoutMs)
+{
+}
+
+#endif // !defined(WINSOCK2_CXX_SOCKET_HANDOFF)
@@ -0,0 +1,294 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "SocketError.hpp"
+#include "SocketEventTrace.hpp"
+#include "SocketEventLoop.hpp"
+#include "StallWatchdog.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::vector;
+
+netsocket::StallWatchdog::StallWatchdog(Settings const &settings, Reporter *reporter)
+    : settings(settings), reporter(reporter)
+{
+    if (!this->settings.thresholdMs)
+	raiseError(Error::EInval);
+
+    if (!this->settings.pollIntervalMs)
+	this->settings.pollIntervalMs = std::max<uint_least32_t>(this->settings.thresholdMs / 4U, 1U);
+
+    history.reserve(this->settings.historySize);
+
+    // twice the copy, so the unwinder can read past the end of a partly copied frame
+    if (this->settings.captureStack)
+	stackCopy.resize(2U * stackCopyBytes / sizeof(DWORD64));
+
+    watchThread = std::thread(&StallWatchdog::run, this);
+}
+
+netsocket::StallWatchdog::~StallWatchdog()
+{
+    {
+	lock_guard<mutex> lock(watchMutex);
+	stopping = true;
+    }
+
+    stopCondition.notify_one();
+    watchThread.join();
+
+    for (Watched &entry: watched)
+	::CloseHandle(entry.hThread);
+}
+
+void netsocket::StallWatchdog::watch(EventLoop &eventLoop)
+{
+    HANDLE hThread = ::OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, ::GetCurrentThreadId());
+
+    if (!hThread)
+	raiseError(static_cast<int>(::GetLastError()));
+
+    ULONG_PTR stackLow, stackHigh;
+
+    ::GetCurrentThreadStackLimits(&stackLow, &stackHigh);
+
+    lock_guard<mutex> lock(watchMutex);
+
+    try
+    {
+	watched.push_back(Watched { &eventLoop, hThread, stackHigh, eventLoop.dispatchState(), ::GetTickCount64(), false, Stall { } });
+    }
+    catch (...)
+    {
+	::CloseHandle(hThread);
+	throw;
+    }
+}
+
+void netsocket::StallWatchdog::unwatch(EventLoop &eventLoop) noexcept
+{
+    lock_guard<mutex> lock(watchMutex);
+
+    for (auto it = watched.begin(); it != watched.end(); ++it)
+	if (it->eventLoop == &eventLoop)
+	{
+	    if (it->stalled)
+		endStall(*it);
+
+	    ::CloseHandle(it->hThread);
+	    watched.erase(it);
+
+	    return;
+	}
+}
+
+netsocket::StallWatchdog::Statistics netsocket::StallWatchdog::statistics() const
+{
+    lock_guard<mutex> lock(watchMutex);
+
+    return counters;
+}
+
+vector<netsocket::StallWatchdog::Stall> netsocket::StallWatchdog::recentStalls() const
+{
+    lock_guard<mutex> lock(watchMutex);
+    vector<Stall> stalls;
+
+    stalls.reserve(history.size());
+
+    // history is a ring once it is full, with the oldest stall at historyNext
+    for (size_t index = 0U; index < history.size(); index++)
+	stalls.push_back(history[(historyNext + index) % history.size()]);
+
+    for (Watched const &entry: watched)
+	if (entry.stalled)
+	    stalls.push_back(entry.stall);
+
+    return stalls;
+}
+
+void netsocket::StallWatchdog::run()
+{
+    unique_lock<mutex> lock(watchMutex);
+
+    while (!stopping)
+    {
+	stopCondition.wait_for(lock, std::chrono::milliseconds(settings.pollIntervalMs));
+
+	ULONGLONG currentTickCountMs = ::GetTickCount64();
+
+	for (Watched &entry: watched)
+	    check(entry, currentTickCountMs);
+    }
+}
+
+// A loop is stalled when two samples the threshold apart see the same dispatch
+void netsocket::StallWatchdog::check(Watched &entry, ULONGLONG currentTickCountMs)
+{
+    EventLoop::DispatchState state = entry.eventLoop->dispatchState();
+
+    if (state != entry.state)
+    {
+	if (entry.stalled)
+	    endStall(entry);
+
+	entry.state = state;
+	entry.sinceTickCountMs = currentTickCountMs;
+
+	return;
+    }
+
+    if (state.kind == EventTrace::Kind::Wait)
+	return;
+
+    uint_least32_t durationMs = static_cast<uint_least32_t>(currentTickCountMs - entry.sinceTickCountMs);
+
+    if (entry.stalled)
+    {
+	entry.stall.durationMs = durationMs;
+	return;
+    }
+
+    if (durationMs < settings.thresholdMs)
+	return;
+
+    entry.stalled = true;
+    entry.stall.eventLoop = entry.eventLoop;
+    entry.stall.kind = state.kind;
+    entry.stall.handler = state.handler;
+    entry.stall.startTickCountMs = entry.sinceTickCountMs;
+    entry.stall.durationMs = durationMs;
+    entry.stall.ended = false;
+    entry.stall.frameCount = 0U;
+
+    if (settings.captureStack)
+	captureStack(entry);
+
+    counters.stalls++;
+    counters.stalledLoops++;
+
+    if (reporter)
+	reporter->onStall(entry.stall);
+}
+
+void netsocket::StallWatchdog::endStall(Watched &entry)
+{
+    entry.stalled = false;
+    entry.stall.durationMs = static_cast<uint_least32_t>(::GetTickCount64() - entry.stall.startTickCountMs);
+    entry.stall.ended = true;
+
+    counters.stallMs += entry.stall.durationMs;
+    counters.longestStallMs = std::max(counters.longestStallMs, entry.stall.durationMs);
+    counters.stalledLoops--;
+
+    keep(entry.stall);
+
+    if (reporter)
+	reporter->onStallEnd(entry.stall);
+}
+
+void netsocket::StallWatchdog::keep(Stall const &stall)
+{
+    if (!settings.historySize)
+	return;
+
+    if (history.size() < settings.historySize)
+	history.push_back(stall);
+    else
+	history[historyNext] = stall;
+
+    historyNext = (historyNext + 1U) % settings.historySize;
+}
+
+// Nothing here may allocate, take a lock or read the stack of the loop thread through its own
+// pointers while the thread is suspended: the thread may hold the heap lock or the function table
+// locks of RtlLookupFunctionEntry(), and a bad frame would fault with the thread left suspended.
+// Only the context and the top of the stack, within the stack limits, are copied before it is
+// resumed. The dispatch is checked again once the thread is stopped, so the stack is the one of
+// the stalled handler.
+void netsocket::StallWatchdog::captureStack(Watched &entry) noexcept
+{
+    if (::SuspendThread(entry.hThread) == static_cast<DWORD>(-1))
+	return;
+
+    CONTEXT context { };
+    size_t copied = 0U;
+
+    context.ContextFlags = CONTEXT_FULL;
+
+    bool captured = ::GetThreadContext(entry.hThread, &context) && entry.eventLoop->dispatchState() == entry.state;
+
+#if defined(_M_X64)
+    if (captured && !stackCopy.empty() && context.Rsp < entry.stackHigh)
+    {
+	copied = std::min<size_t>(static_cast<size_t>(entry.stackHigh - context.Rsp), stackCopyBytes);
+	std::memcpy(stackCopy.data(), reinterpret_cast<void const *>(context.Rsp), copied);
+    }
+#endif
+
+    ::ResumeThread(entry.hThread);
+
+    if (!captured)
+	return;
+
+    Stall &stall = entry.stall;
+
+#if defined(_M_X64)
+    unsigned char *copyBase = static_cast<unsigned char *>(static_cast<void *>(stackCopy.data()));
+    DWORD64 stackTop = context.Rsp, offset = reinterpret_cast<DWORD64>(copyBase) - stackTop;
+
+    std::memset(copyBase + copied, 0, stackCopy.size() * sizeof(DWORD64) - copied);
+
+    // Stack addresses, including the saved frame pointers, are moved into the copy
+    context.Rsp += offset;
+
+    if (context.Rbp - stackTop < copied)
+	context.Rbp += offset;
+
+    while (stall.frameCount < maxFrames && context.Rip)
+    {
+	stall.frames[stall.frameCount++] = reinterpret_cast<void *>(context.Rip);
+
+	if (context.Rsp - reinterpret_cast<DWORD64>(copyBase) + sizeof(DWORD64) > copied)
+	    break;
+
+	DWORD64 imageBase;
+	PRUNTIME_FUNCTION function = ::RtlLookupFunctionEntry(context.Rip, &imageBase, nullptr);
+
+	if (function)
+	{
+	    void *handlerData;
+	    DWORD64 establisherFrame;
+
+	    ::RtlVirtualUnwind(UNW_FLAG_NHANDLER, imageBase, context.Rip, function, &context, &handlerData, &establisherFrame, nullptr);
+	}
+	else
+	{
+	    // Leaf function, with the return address on top of the stack
+	    context.Rip = *reinterpret_cast<DWORD64 const *>(context.Rsp);
+	    context.Rsp += sizeof(DWORD64);
+	}
+
+	if (context.Rbp - stackTop < copied)
+	    context.Rbp += offset;
+    }
+#elif defined(_M_IX86)
+    stall.frames[stall.frameCount++] = reinterpret_cast<void *>(static_cast<std::uintptr_t>(context.Eip));
+#elif defined(_M_ARM64)
+    stall.frames[stall.frameCount++] = reinterpret_cast<void *>(static_cast<std::uintptr_t>(context.Pc));
+#endif
+}
@@ -0,0 +1,135 @@
+#if !defined(WINSOCK2_CXX_STALL_WATCHDOG)
+#define WINSOCK2_CXX_STALL_WATCHDOG
+
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "SocketEventTrace.hpp"
+#include "SocketEventLoop.hpp"
+
+namespace netsocket
+{
+    // Background thread that notices handlers blocking their event loop, for a group of loops.
+    // Each loop publishes the handler it is running with EventLoop::dispatchState(), and the
+    // watchdog samples it a few times per threshold. A loop found in the same dispatch for longer
+    // than the threshold is stalled: the watchdog records the handler and the kind of dispatch,
+    // and the stack of the loop thread, taken while the thread is briefly suspended.
+    //
+    // The stack is the return addresses only, to be resolved offline against the symbols. On x64
+    // the top of the stack is copied while the thread is suspended, and walked with
+    // RtlVirtualUnwind() after it runs again, so the walk ends where the copy ends. Elsewhere it
+    // only holds the current instruction.
+    class StallWatchdog
+    {
+    public:
+	class Reporter;
+
+	static constexpr std::size_t maxFrames = 32U;
+	static constexpr std::size_t stackCopyBytes = 32768U;
+
+	struct Settings
+	{
+	    std::uint_least32_t thresholdMs = 100U;
+	    std::uint_least32_t pollIntervalMs = 0U;	// a quarter of the threshold when 0
+	    std::size_t historySize = 64U;		// most recent stalls kept for recentStalls()
+	    bool captureStack = true;
+	};
+
+	struct Stall
+	{
+	    EventLoop const *eventLoop;
+	    EventTrace::Kind kind;
+	    void const *handler;			// the object dispatched, as given to EventTrace
+	    ULONGLONG startTickCountMs;			// when the watchdog saw the dispatch first
+	    std::uint_least32_t durationMs;		// so far, or in total once the stall ended
+	    bool ended;
+	    std::size_t frameCount;
+	    void *frames[maxFrames];
+	};
+
+	struct Statistics
+	{
+	    std::uint_least64_t stalls;
+	    std::uint_least64_t stallMs;		// total for the stalls that ended
+	    std::uint_least32_t longestStallMs;
+	    std::size_t stalledLoops;			// stalled right now
+	};
+
+	// Call from the loop thread, that is the one suspended for the stack. Unwatch the loop
+	// before it is destroyed.
+	void watch(EventLoop &eventLoop);
+	void unwatch(EventLoop &eventLoop) noexcept;
+
+	Statistics statistics() const;
+	std::vector<Stall> recentStalls() const;	// oldest first
+
+	StallWatchdog(Reporter *reporter = nullptr);
+	StallWatchdog(Settings const &settings, Reporter *reporter = nullptr);
+	~StallWatchdog();
+	StallWatchdog(StallWatchdog const &other) = delete;
+	StallWatchdog &operator =(StallWatchdog const &other) = delete;
+
+    protected:
+	struct Watched
+	{
+	    EventLoop *eventLoop;
+	    HANDLE hThread;
+	    ULONG_PTR stackHigh;			// the top of the thread stack, exclusive
+	    EventLoop::DispatchState state;
+	    ULONGLONG sinceTickCountMs;
+	    bool stalled;
+	    Stall stall;
+	};
+
+	Settings settings;
+	Reporter *reporter;
+	mutable std::mutex watchMutex;
+	std::condition_variable stopCondition;
+	std::vector<Watched> watched;			// guarded by watchMutex, like the fields below
+	std::vector<Stall> history;
+	std::size_t historyNext = 0U;
+	std::vector<DWORD64> stackCopy;			// used by the watchdog thread only
+	Statistics counters { };
+	bool stopping = false;
+	std::thread watchThread;
+
+	void run();
+	void check(Watched &entry, ULONGLONG currentTickCountMs);
+	void endStall(Watched &entry);
+	void captureStack(Watched &entry) noexcept;
+	void keep(Stall const &stall);
+    };
+
+    // Called from the watchdog thread, with the watchdog lock held: report or queue the stall,
+    // but do not call back into the watchdog
+    class StallWatchdog::Reporter
+    {
+    public:
+	virtual void onStall(Stall const &stall) noexcept = 0;
+	virtual void onStallEnd(Stall const &stall) noexcept;
+
+	virtual ~Reporter();
+    };
+}
+
+inline netsocket::StallWatchdog::StallWatchdog(Reporter *reporter)
+    : StallWatchdog(Settings(), reporter)
+{
+}
+
+inline void netsocket::StallWatchdog::Reporter::onStallEnd(Stall const &) noexcept
+{
+}
+
+inline netsocket::StallWatchdog::Reporter::~Reporter()
+{
+}
+
+#endif // !defined(WINSOCK2_CXX_STALL_WATCHDOG)
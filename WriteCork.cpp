@@ -0,0 +1,112 @@
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#include "WriteCork.hpp"
+
+using std::size_t;
+using std::min;
+
+void netsocket::WriteCork::send(void const *data, size_t length)
+{
+    unsigned char const *bytes = static_cast<unsigned char const *>(data);
+
+    while (length)
+    {
+	if (chunks.empty() || tailLength == chunkSize)
+	{
+	    chunks.push_back(bufferCache.acquire(chunkSize));
+	    tailLength = 0U;
+	}
+
+	size_t count = min(length, chunkSize - tailLength);
+
+	std::memcpy(chunks.back().data() + tailLength, bytes, count);
+	tailLength += count;
+	queuedBytes += count;
+	bytes += count;
+	length -= count;
+    }
+
+    if (!corkEnabled)
+	flush();
+    else
+	if (queuedBytes)
+	    eventLoop.requestIterationEnd(*this);
+}
+
+bool netsocket::WriteCork::flush()
+{
+    while (queuedBytes)
+    {
+	WSABUF buffers[maxBuffers];
+	DWORD bufferCount = static_cast<DWORD>(min(chunks.size() - headChunk, static_cast<size_t>(maxBuffers)));
+	size_t batchBytes = 0U;
+
+	for (DWORD index = 0U; index < bufferCount; index++)
+	{
+	    size_t begin = index ? 0U : headOffset;
+	    size_t end = headChunk + index + 1U == chunks.size() ? tailLength : chunkSize;
+
+	    buffers[index].buf = static_cast<char *>(static_cast<void *>(chunks[headChunk + index].data() + begin));
+	    buffers[index].len = static_cast<ULONG>(end - begin);
+	    batchBytes += end - begin;
+	}
+
+	DWORD dwSent = socket.send(buffers, bufferCount);
+
+	consume(dwSent);
+
+	if (dwSent < batchBytes)
+	    break;
+    }
+
+    if (pendingIterationEnd() && !queuedBytes)
+	eventLoop.cancelIterationEnd(*this);
+
+    return !queuedBytes;
+}
+
+// Sent chunks go back to the cache right away, and their entries are dropped once they make up
+// half of the vector, so each entry is moved at most once on average
+void netsocket::WriteCork::consume(size_t length) noexcept
+{
+    queuedBytes -= length;
+
+    while (length)
+    {
+	size_t available = (headChunk + 1U == chunks.size() ? tailLength : chunkSize) - headOffset;
+
+	if (length < available)
+	{
+	    headOffset += length;
+	    break;
+	}
+
+	length -= available;
+	chunks[headChunk++].release();
+	headOffset = 0U;
+    }
+
+    if (headChunk && headChunk * 2U >= chunks.size())
+    {
+	chunks.erase(chunks.begin(), chunks.begin() + headChunk);
+	headChunk = 0U;
+    }
+}
+
+void netsocket::WriteCork::cork(bool enable)
+{
+    corkEnabled = enable;
+
+    if (!enable)
+	flush();
+}
+
+void netsocket::WriteCork::onIterationEnd(EventLoop &)
+{
+    flush();
+}
@@ -0,0 +1,70 @@
+#if !defined(WINSOCK2_CXX_WRITE_CORK)
+#define WINSOCK2_CXX_WRITE_CORK
+
+#include <WinSock2.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+#include "BufferPool.hpp"
+
+namespace netsocket
+{
+    // Userspace corking for one connection. Data sent during a loop iteration is copied into pool
+    // buffers, and goes out in one gathered WSASend() call at the end of the iteration, so a
+    // handler answering several pipelined requests makes a single system call, with fewer small
+    // packets. The buffers go back to the cache once all the data is sent.
+    //
+    // When the socket can not take all the data, the rest stays queued: call flush() again on the
+    // next FD_WRITE. Errors from the flush at the end of the iteration go to the loop exception
+    // handler.
+    class WriteCork: public EventLoop::IterationEndHandler
+    {
+    public:
+	static constexpr std::size_t chunkSize = 16384U;
+	static constexpr DWORD maxBuffers = 64U;		// per WSASend() call
+
+	void send(void const *data, std::size_t length);
+	bool flush();						// true when all data was sent
+	std::size_t pendingBytes() const noexcept;
+
+	void cork(bool enable);					// sends right away when disabled
+	bool corked() const noexcept;
+
+	WriteCork(EventLoop &eventLoop, Socket &socket, BufferPool::Cache &bufferCache);
+	WriteCork(WriteCork const &other) = delete;
+	WriteCork &operator =(WriteCork const &other) = delete;
+
+    protected:
+	EventLoop &eventLoop;
+	Socket &socket;
+	BufferPool::Cache &bufferCache;
+	std::vector<BufferPool::Buffer> chunks;
+	std::size_t headChunk = 0U;				// first chunk not yet sent
+	std::size_t headOffset = 0U, tailLength = 0U, queuedBytes = 0U;
+	bool corkEnabled = true;
+
+	void consume(std::size_t length) noexcept;
+
+	virtual void onIterationEnd(EventLoop &eventLoop) override;
+    };
+}
+
+inline std::size_t netsocket::WriteCork::pendingBytes() const noexcept
+{
+    return queuedBytes;
+}
+
+inline bool netsocket::WriteCork::corked() const noexcept
+{
+    return corkEnabled;
+}
+
+inline netsocket::WriteCork::WriteCork(EventLoop &eventLoop, Socket &socket, BufferPool::Cache &bufferCache)
+    : eventLoop(eventLoop), socket(socket), bufferCache(bufferCache)
+{
+}
+
+#endif // !defined(WINSOCK2_CXX_WRITE_CORK)
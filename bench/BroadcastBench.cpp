@@ -0,0 +1,490 @@
+#define NOMINMAX
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+#include "SocketError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+#include "ConnectionTable.hpp"
+#include "Broadcast.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::uint_least64_t;
+using std::int_least64_t;
+using std::atomic;
+using std::thread;
+using std::unique_ptr;
+using std::string;
+using std::vector;
+using std::max;
+using std::exception;
+
+using netsocket::Library;
+using netsocket::Event;
+using netsocket::EventHandle;
+using netsocket::EventLoop;
+using netsocket::Socket;
+using netsocket::ConnectionTable;
+using netsocket::Broadcast;
+
+// Fan-out benchmark for Broadcast, over loopback TCP.
+//
+// One publisher loop sends the same stream of messages to every subscriber connection, as fast
+// as the subscribers take them, while receiver loops drain the other ends of the connections
+// with a ConnectionTable each. The run is repeated for each subscriber count, and reports the
+// updates published and the messages delivered per second, with the subscribers dropped for
+// falling behind and the messages conflated.
+
+namespace
+{
+    struct Options
+    {
+	vector<unsigned> subscriberCounts { 100U, 1000U, 10000U };
+	unsigned	messageSize = 64U;
+	unsigned	batch = 16U;
+	unsigned	keys = 0U;
+	unsigned	maxQueued = 256U;
+	unsigned	seconds = 5U;
+	unsigned	receiverThreads = 4U;
+	bool		conflate = false;
+    };
+
+    atomic<bool> stopping { false };
+
+    int_least64_t ticks() noexcept
+    {
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart;
+    }
+
+    int_least64_t ticksPerSecond() noexcept
+    {
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	return frequency.QuadPart;
+    }
+
+    class StopTimer: public EventLoop::TimerHandler
+    {
+    protected:
+	virtual std::uint_least32_t timerIntervalMs() override
+	{
+	    return 10U;
+	}
+
+	virtual bool onTimerTrigger(EventLoop &eventLoop) override
+	{
+	    if (stopping.load(std::memory_order_relaxed))
+		eventLoop.postQuitRequest();
+
+	    return true;
+	}
+    };
+
+    class ReportException: public EventLoop::ExceptionHandler
+    {
+    protected:
+	virtual void onException(EventLoop &) noexcept override
+	{
+	    try
+	    {
+		throw;
+	    }
+	    catch (exception const &ex)
+	    {
+		std::fprintf(stderr, "Event loop error: %s\n", ex.what());
+	    }
+	    catch (...)
+	    {
+		std::fprintf(stderr, "Event loop error\n");
+	    }
+	}
+    };
+
+    // Drains the receiving ends of the connections, and counts the bytes
+    class ReceiverLoop: public ConnectionTable::Dispatcher
+    {
+    protected:
+	Library &socketLib;
+	vector<Socket> sockets;
+	thread loopThread;
+	char buffer[65536];
+
+	virtual void onReady(ConnectionTable &table, ConnectionTable::SlotId slot, short readyEvents) override
+	{
+	    if (!(readyEvents & (POLLRDNORM | POLLHUP | POLLERR)))
+		return;
+
+	    Socket socket(table.socket(slot));
+	    int received;
+
+	    try
+	    {
+		while ((received = socket.receive(buffer, sizeof buffer)) > 0)
+		    bytes += static_cast<uint_least64_t>(received);
+	    }
+	    catch (netsocket::Exception const &)
+	    {
+		received = 0;
+	    }
+
+	    socket.release();			// still owned by the table
+
+	    if (!received)
+		table.remove(slot);
+	}
+
+	virtual void onTimeout(ConnectionTable &, ConnectionTable::SlotId) override
+	{
+	}
+
+	void run()
+	{
+	    EventLoop eventLoop(socketLib);
+	    ConnectionTable table(socketLib, eventLoop, *this);
+	    StopTimer stopTimer;
+	    ReportException reportException;
+
+	    for (Socket &socket: sockets)
+		table.add(std::move(socket), POLLRDNORM);
+
+	    sockets.clear();
+	    eventLoop.addTimerHandler(stopTimer);
+	    eventLoop.runLoop(&reportException);
+	}
+
+    public:
+	uint_least64_t bytes = 0U;		// read after join()
+
+	void add(Socket &&socket)
+	{
+	    sockets.push_back(std::move(socket));
+	}
+
+	void start()
+	{
+	    loopThread = thread([this]() { run(); });
+	}
+
+	void join()
+	{
+	    loopThread.join();
+	}
+
+	ReceiverLoop(Library &socketLib)
+	    : socketLib(socketLib)
+	{
+	}
+    };
+
+    class Feed: public Broadcast::Subscriber
+    {
+    protected:
+	virtual void onDropped(Broadcast &) override
+	{
+	    dropped = true;
+	}
+
+    public:
+	Socket socket;
+	bool dropped = false;
+
+	Feed(Socket &&acceptedSocket)
+	    : Subscriber(socket), socket(std::move(acceptedSocket))
+	{
+	}
+    };
+
+    // Publishes a batch of messages on every loop iteration. All the feed sockets signal the same
+    // event when they are writable again, and the feeds waiting for it are flushed then.
+    class Publisher: public EventLoop::EventHandler, protected EventLoop::DeadlineHandler
+    {
+    protected:
+	Options const &options;
+	EventLoop eventLoop;
+	Event writableEvent;
+	Broadcast broadcast;
+	vector<unique_ptr<Feed>> feeds;
+	vector<char> message;
+	StopTimer stopTimer;
+	ReportException reportException;
+	thread loopThread;
+
+	static Broadcast::Settings settings(Options const &options)
+	{
+	    Broadcast::Settings settings;
+
+	    settings.maxQueued = options.maxQueued;
+	    settings.maxQueuedBytes = static_cast<size_t>(options.maxQueued) * options.messageSize;
+	    settings.policy = options.conflate ? Broadcast::Policy::Conflate : Broadcast::Policy::Drop;
+
+	    return settings;
+	}
+
+	virtual EventHandle eventHandle() override
+	{
+	    return writableEvent.handle();
+	}
+
+	virtual bool onEventTrigger(EventLoop &) override
+	{
+	    writableEvent.reset();
+
+	    for (auto &feed: feeds)
+		if (feed->waiting() && feed->subscribed())
+		    try
+		    {
+			feed->flush();
+		    }
+		    catch (netsocket::Exception const &)
+		    {
+			broadcast.unsubscribe(*feed);
+			feed->dropped = true;
+		    }
+
+	    return true;
+	}
+
+	virtual void onDeadline(EventLoop &) override
+	{
+	    for (unsigned count = 0U; count < options.batch; count++)
+	    {
+		uint_least64_t key = options.keys ? sequence % options.keys + 1U : 0U;
+
+		std::memcpy(message.data(), &sequence, sizeof sequence);
+		broadcast.publish(Broadcast::payload(message.data(), message.size(), key));
+		sequence++;
+	    }
+
+	    eventLoop.setDeadline(*this, 0U);
+	}
+
+	void run()
+	{
+	    eventLoop.addEventHandler(*this);
+	    eventLoop.addTimerHandler(stopTimer);
+	    eventLoop.setDeadline(*this, 0U);
+	    eventLoop.runLoop(&reportException);
+	    eventLoop.cancelDeadline(*this);
+
+	    statistics = broadcast.statistics();
+	}
+
+    public:
+	uint_least64_t sequence = 0U;
+	Broadcast::Statistics statistics { };		// read after join()
+
+	void add(Socket &&acceptedSocket)
+	{
+	    feeds.push_back(std::make_unique<Feed>(std::move(acceptedSocket)));
+	    feeds.back()->socket.selectEvents(writableEvent.handle(), FD_WRITE | FD_CLOSE);
+	    broadcast.subscribe(*feeds.back());
+	}
+
+	void start()
+	{
+	    loopThread = thread([this]() { run(); });
+	}
+
+	void join()
+	{
+	    loopThread.join();
+	}
+
+	Publisher(Library &socketLib, Options const &options)
+	    : options(options), eventLoop(socketLib), writableEvent(socketLib), broadcast(eventLoop, settings(options)),
+	      message(max<size_t>(options.messageSize, sizeof(uint_least64_t)), 'x')
+	{
+	}
+    };
+
+    void runCount(Library &socketLib, Options const &options, unsigned subscriberCount)
+    {
+	Socket listener(socketLib, AF_INET);
+	sockaddr_in address { };
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	listener.bind(static_cast<sockaddr const *>(static_cast<void const *>(&address)), static_cast<int>(sizeof address));
+	listener.listen();
+
+	sockaddr_storage localAddress;
+	listener.localAddress(localAddress);
+	address.sin_port = static_cast<sockaddr_in *>(static_cast<void *>(&localAddress))->sin_port;
+
+	Publisher publisher(socketLib, options);
+	vector<unique_ptr<ReceiverLoop>> receivers;
+
+	for (unsigned index = 0U; index < max(options.receiverThreads, 1U); index++)
+	    receivers.push_back(std::make_unique<ReceiverLoop>(socketLib));
+
+	for (unsigned index = 0U; index < subscriberCount; index++)
+	{
+	    Socket client(socketLib, AF_INET);
+
+	    client.connect(static_cast<sockaddr const *>(static_cast<void const *>(&address)), static_cast<int>(sizeof address));
+	    publisher.add(listener.accept());
+	    receivers[index % receivers.size()]->add(std::move(client));
+	}
+
+	stopping = false;
+
+	for (auto &receiver: receivers)
+	    receiver->start();
+
+	int_least64_t startTicks = ticks();
+	publisher.start();
+
+	std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+
+	stopping = true;
+	publisher.join();
+
+	double seconds = static_cast<double>(ticks() - startTicks) / static_cast<double>(ticksPerSecond());
+	uint_least64_t bytes = 0U;
+
+	for (auto &receiver: receivers)
+	{
+	    receiver->join();
+	    bytes += receiver->bytes;
+	}
+
+	double delivered = static_cast<double>(bytes) / static_cast<double>(options.messageSize);
+
+	std::printf
+	    (
+		"%11u %12.0f %14.0f %10.2f %9llu %11llu\n",
+		subscriberCount,
+		static_cast<double>(publisher.statistics.published) / seconds,
+		delivered / seconds,
+		static_cast<double>(bytes) / seconds / (1024.0 * 1024.0),
+		static_cast<unsigned long long>(publisher.statistics.dropped),
+		static_cast<unsigned long long>(publisher.statistics.conflated)
+	    );
+    }
+
+    bool parseCounts(char const *list, vector<unsigned> &counts)
+    {
+	counts.clear();
+
+	while (*list)
+	{
+	    char *end;
+	    unsigned long count = std::strtoul(list, &end, 10);
+
+	    if (end == list || !count || (*end && *end != ','))
+		return false;
+
+	    counts.push_back(static_cast<unsigned>(count));
+	    list = *end ? end + 1 : end;
+	}
+
+	return !counts.empty();
+    }
+
+    bool parseOption(char const *arg, Options &options)
+    {
+	char const *value = std::strchr(arg, '=');
+	string name(arg, value ? static_cast<size_t>(value - arg) : std::strlen(arg));
+	unsigned long number = value ? std::strtoul(value + 1, nullptr, 10) : 0U;
+
+	if (name == "--subscribers" && value)
+	    return parseCounts(value + 1, options.subscriberCounts);
+	else if (name == "--size" && value)
+	    options.messageSize = static_cast<unsigned>(number);
+	else if (name == "--batch" && value)
+	    options.batch = static_cast<unsigned>(number);
+	else if (name == "--keys" && value)
+	    options.keys = static_cast<unsigned>(number);
+	else if (name == "--queue" && value)
+	    options.maxQueued = static_cast<unsigned>(number);
+	else if (name == "--seconds" && value)
+	    options.seconds = static_cast<unsigned>(number);
+	else if (name == "--receiver-threads" && value)
+	    options.receiverThreads = static_cast<unsigned>(number);
+	else if (name == "--conflate" && !value)
+	    options.conflate = true;
+	else
+	    return false;
+
+	return true;
+    }
+
+    void usage(char const *program)
+    {
+	std::fprintf
+	    (
+		stderr,
+		"Usage: %s [options]\n"
+		"    --subscribers=N,N,...      subscriber counts to measure (default 100,1000,10000)\n"
+		"    --size=BYTES               message size, at least 8 (default 64)\n"
+		"    --batch=N                  messages published per loop iteration (default 16)\n"
+		"    --keys=N                   distinct conflation keys, 0 for none (default 0)\n"
+		"    --queue=N                  messages queued per subscriber before it falls behind (default 256)\n"
+		"    --seconds=N                measurement time for each count (default 5)\n"
+		"    --receiver-threads=N       loop threads draining the subscriber connections (default 4)\n"
+		"    --conflate                 replace queued messages with the same key, instead of dropping slow subscribers\n",
+		program
+	    );
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    Options options;
+
+    for (int index = 1; index < argc; index++)
+	if (!parseOption(argv[index], options))		// including --help
+	{
+	    usage(argv[0]);
+	    return 2;
+	}
+
+    if (options.messageSize < sizeof(uint_least64_t) || !options.batch || !options.maxQueued || !options.seconds)
+    {
+	usage(argv[0]);
+	return 2;
+    }
+
+    Library socketLib;
+
+    std::printf
+	(
+	    "message size %u, batch %u, queue %u, %s, %u keys, %u receiver threads\n"
+	    "subscribers    updates/s   deliveries/s      MiB/s   dropped   conflated\n",
+	    options.messageSize, options.batch, options.maxQueued, options.conflate ? "conflate" : "drop", options.keys, max(options.receiverThreads, 1U)
+	);
+
+    for (unsigned subscriberCount: options.subscriberCounts)
+	runCount(socketLib, options, subscriberCount);
+
+    return 0;
+}
+catch (exception const &ex)
+{
+    std::fprintf(stderr, "Error: %s\n", ex.what());
+    return 1;
+}
@@ -0,0 +1,199 @@
+#define NOMINMAX
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+#include "FrameChecksum.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::uint_least64_t;
+using std::int_least64_t;
+using std::string;
+using std::vector;
+using std::max;
+using std::exception;
+
+using netsocket::Crc32cKernel;
+
+// Throughput of the CRC32C kernels from FrameChecksum, in GB/s (10^9 bytes per second).
+//
+// Each kernel the processor supports checksums the same buffer for each frame size, with and
+// without the copy done by crc32cCopy(), until a fixed amount of data went through. Every call
+// continues from the previous crc value, so the calls can not be dropped or overlapped, and the
+// kernels are checked to agree on the result.
+
+namespace
+{
+    struct Options
+    {
+	vector<unsigned> sizes { 64U, 1500U, 16384U, 1048576U };
+	unsigned	megabytes = 1024U;		// per measurement
+    };
+
+    struct KernelName
+    {
+	Crc32cKernel kernel;
+	char const *name;
+    };
+
+    KernelName const kernels[] =
+    {
+	{ Crc32cKernel::Portable, "portable" },
+	{ Crc32cKernel::SSE42, "sse4.2" },
+	{ Crc32cKernel::SSE42_PCLMUL, "sse4.2+pclmul" }
+    };
+
+    int_least64_t ticks() noexcept
+    {
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart;
+    }
+
+    int_least64_t ticksPerSecond() noexcept
+    {
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	return frequency.QuadPart;
+    }
+
+    // Returns GB/s, and the final crc in crc
+    double measure(Crc32cKernel kernel, bool copy, char *destination, char const *source, size_t size, uint_least64_t totalBytes, uint_least32_t &crc)
+    {
+	uint_least64_t calls = max<uint_least64_t>(totalBytes / size, 1U);
+
+	crc = 0U;
+
+	int_least64_t startTicks = ticks();
+
+	for (uint_least64_t call = 0U; call < calls; call++)
+	    crc = copy ? netsocket::crc32cCopy(kernel, destination, source, size, crc) : netsocket::crc32c(kernel, source, size, crc);
+
+	double seconds = static_cast<double>(ticks() - startTicks) / static_cast<double>(ticksPerSecond());
+
+	return static_cast<double>(calls * size) / max(seconds, 1e-9) / 1e9;
+    }
+
+    bool parseCounts(char const *list, vector<unsigned> &counts)
+    {
+	counts.clear();
+
+	while (*list)
+	{
+	    char *end;
+	    unsigned long count = std::strtoul(list, &end, 10);
+
+	    if (end == list || !count || (*end && *end != ','))
+		return false;
+
+	    counts.push_back(static_cast<unsigned>(count));
+	    list = *end ? end + 1 : end;
+	}
+
+	return !counts.empty();
+    }
+
+    bool parseOption(char const *arg, Options &options)
+    {
+	char const *value = std::strchr(arg, '=');
+	string name(arg, value ? static_cast<size_t>(value - arg) : std::strlen(arg));
+	unsigned long number = value ? std::strtoul(value + 1, nullptr, 10) : 0U;
+
+	if (name == "--sizes" && value)
+	    return parseCounts(value + 1, options.sizes);
+	else if (name == "--megabytes" && value)
+	    options.megabytes = static_cast<unsigned>(number);
+	else
+	    return false;
+
+	return true;
+    }
+
+    void usage(char const *program)
+    {
+	std::fprintf
+	    (
+		stderr,
+		"Usage: %s [options]\n"
+		"    --sizes=BYTES,BYTES,...    frame sizes to measure (default 64,1500,16384,1048576)\n"
+		"    --megabytes=N              data checksummed for each kernel and size, in MB (default 1024)\n",
+		program
+	    );
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    Options options;
+
+    for (int index = 1; index < argc; index++)
+	if (!parseOption(argv[index], options))		// including --help
+	{
+	    usage(argv[0]);
+	    return 2;
+	}
+
+    if (!options.megabytes)
+    {
+	usage(argv[0]);
+	return 2;
+    }
+
+    size_t bufferSize = *std::max_element(options.sizes.begin(), options.sizes.end());
+    vector<char> source(bufferSize), destination(bufferSize);
+    uint_least64_t totalBytes = static_cast<uint_least64_t>(options.megabytes) * 1000000U;
+
+    for (size_t position = 0U; position < bufferSize; position++)
+	source[position] = static_cast<char>(std::rand());
+
+    std::printf("selected kernel: %s\n", kernels[static_cast<size_t>(netsocket::crc32cKernel())].name);
+    std::printf("kernel               size   crc32c GB/s   crc32cCopy GB/s\n");
+
+    int status = 0;
+
+    for (KernelName const &kernelName: kernels)
+    {
+	if (!netsocket::crc32cSupported(kernelName.kernel))
+	{
+	    std::printf("%-14s  not supported by the processor\n", kernelName.name);
+	    continue;
+	}
+
+	for (unsigned size: options.sizes)
+	{
+	    uint_least32_t crc, copyCrc;
+	    double checksumRate = measure(kernelName.kernel, false, destination.data(), source.data(), size, totalBytes, crc);
+	    double copyRate = measure(kernelName.kernel, true, destination.data(), source.data(), size, totalBytes, copyCrc);
+
+	    std::printf("%-14s  %9u   %11.2f   %15.2f\n", kernelName.name, size, checksumRate, copyRate);
+
+	    uint_least32_t expectedCrc = netsocket::crc32c(Crc32cKernel::Portable, source.data(), size);
+
+	    if (netsocket::crc32c(kernelName.kernel, source.data(), size) != expectedCrc || copyCrc != crc || std::memcmp(destination.data(), source.data(), size))
+	    {
+		std::fprintf(stderr, "Error: %s kernel result differs from the portable kernel for size %u\n", kernelName.name, size);
+		status = 1;
+	    }
+	}
+    }
+
+    return status;
+}
+catch (exception const &ex)
+{
+    std::fprintf(stderr, "Error: %s\n", ex.what());
+    return 1;
+}
@@ -0,0 +1,1064 @@
+#define NOMINMAX
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+#include "SocketError.hpp"
+#include "SocketLibrary.hpp"
+#include "SocketEvent.hpp"
+#include "SocketEventHandle.hpp"
+#include "SocketEventLoop.hpp"
+#include "Socket.hpp"
+#include "BufferPool.hpp"
+#include "SharedRing.hpp"
+
+using std::size_t;
+using std::uint_least32_t;
+using std::uint_least64_t;
+using std::int_least64_t;
+using std::atomic;
+using std::mutex;
+using std::lock_guard;
+using std::thread;
+using std::unique_ptr;
+using std::string;
+using std::vector;
+using std::min;
+using std::max;
+using std::exception;
+
+using netsocket::Library;
+using netsocket::Event;
+using netsocket::EventHandle;
+using netsocket::EventLoop;
+using netsocket::Socket;
+using netsocket::BufferPool;
+using netsocket::SharedRing;
+
+// Echo server and load generator for netsocket event loops, over loopback TCP.
+//
+// Each client connection keeps a fixed number of messages in flight (the pipeline depth), and
+// sends a new one as each echo comes back. The first 8 bytes of a message hold its send time,
+// so latency is measured from the echo alone. Every EventLoop waits on at most 64 events, so
+// both the server and the client spread their connections over as many loop threads as needed.
+//
+// With --transport=ring the messages go over SharedRing instead, for comparison: the client
+// loops write to one request ring, and the server loop echoes each message from the ring, in
+// place, to the reply ring of the client loop. The connections are then message streams of the
+// client loops, each with the same pipeline depth.
+
+namespace
+{
+    struct Options
+    {
+	string		mode = "both";
+	string		transport = "tcp";
+	string		host = "127.0.0.1";
+	unsigned short	port = 0U;
+	unsigned	connections = 256U;
+	unsigned	messageSize = 64U;
+	unsigned	pipeline = 1U;
+	unsigned	seconds = 10U;
+	unsigned	warmupSeconds = 1U;
+	unsigned	clientThreads = 0U;
+	unsigned	busyPollUs = 0U;
+	bool		noDelay = true;
+    };
+
+    atomic<bool> clientStopping { false };
+    atomic<bool> serverStopping { false };
+    atomic<bool> recording { false };
+
+    int_least64_t ticks() noexcept
+    {
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart;
+    }
+
+    int_least64_t ticksPerSecond() noexcept
+    {
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	return frequency.QuadPart;
+    }
+
+    // Log-linear histogram, 32 buckets per power of 2, for about 3% resolution at any scale
+    class LatencyHistogram
+    {
+    protected:
+	static unsigned const subBits = 5U, subCount = 1U << subBits;
+
+	vector<uint_least64_t> counts = vector<uint_least64_t>((64U - subBits + 1U) * subCount);
+	uint_least64_t total = 0U, maximum = 0U;
+
+	static unsigned bucket(uint_least64_t value) noexcept
+	{
+	    if (value < subCount)
+		return static_cast<unsigned>(value);
+
+	    unsigned shift = 0U;
+
+	    while (value >> shift >= 2U * subCount)
+		shift++;
+
+	    return (shift + 1U) * subCount + static_cast<unsigned>((value >> shift) - subCount);
+	}
+
+	static uint_least64_t bucketValue(unsigned index) noexcept
+	{
+	    if (index < subCount)
+		return index;
+
+	    return static_cast<uint_least64_t>(index % subCount + subCount) << (index / subCount - 1U);
+	}
+
+    public:
+	void record(uint_least64_t value) noexcept
+	{
+	    counts[bucket(value)]++;
+	    total++;
+	    maximum = max(maximum, value);
+	}
+
+	void merge(LatencyHistogram const &other) noexcept
+	{
+	    for (size_t index = 0U; index < counts.size(); index++)
+		counts[index] += other.counts[index];
+
+	    total += other.total;
+	    maximum = max(maximum, other.maximum);
+	}
+
+	uint_least64_t percentile(double percent) const noexcept
+	{
+	    uint_least64_t rank = static_cast<uint_least64_t>(percent / 100.0 * static_cast<double>(total)), seen = 0U;
+
+	    for (unsigned index = 0U; index < counts.size(); index++)
+	    {
+		seen += counts[index];
+
+		if (seen > rank)
+		    return min(bucketValue(index), maximum);
+	    }
+
+	    return maximum;
+	}
+
+	uint_least64_t count() const noexcept
+	{
+	    return total;
+	}
+
+	uint_least64_t maximumValue() const noexcept
+	{
+	    return maximum;
+	}
+    };
+
+    class StopTimer: public EventLoop::TimerHandler
+    {
+    protected:
+	atomic<bool> const &stopping;
+
+	virtual std::uint_least32_t timerIntervalMs() override
+	{
+	    return 10U;
+	}
+
+	virtual bool onTimerTrigger(EventLoop &eventLoop) override
+	{
+	    if (stopping.load(std::memory_order_relaxed))
+		eventLoop.postQuitRequest();
+
+	    return true;
+	}
+
+    public:
+	StopTimer(atomic<bool> const &stopping)
+	    : stopping(stopping)
+	{
+	}
+    };
+
+    class ReportException: public EventLoop::ExceptionHandler
+    {
+    protected:
+	virtual void onException(EventLoop &) noexcept override
+	{
+	    try
+	    {
+		throw;
+	    }
+	    catch (exception const &ex)
+	    {
+		std::fprintf(stderr, "Event loop error: %s\n", ex.what());
+	    }
+	    catch (...)
+	    {
+		std::fprintf(stderr, "Event loop error\n");
+	    }
+	}
+    };
+
+    // Echoes back everything it receives. While the peer is not reading, it stops reading too,
+    // and resumes on FD_WRITE.
+    class EchoConnection: public EventLoop::EventHandler
+    {
+    protected:
+	Socket socket;
+	Event event;
+	atomic<unsigned> &connectionCount;
+	BufferPool::Cache &bufferCache;
+	BufferPool::Buffer buffer;		// only held while echo data is pending
+	size_t pendingOffset = 0U, pendingLength = 0U;
+
+	virtual EventHandle eventHandle() override
+	{
+	    return event.handle();
+	}
+
+	virtual bool onEventTrigger(EventLoop &eventLoop) override
+	{
+	    try
+	    {
+		WSANETWORKEVENTS networkEvents = socket.networkEvents(event.handle());
+
+		if (pump() && !(networkEvents.lNetworkEvents & FD_CLOSE))
+		    return true;
+	    }
+	    catch (netsocket::Exception const &)
+	    {
+	    }
+
+	    eventLoop.enqueueDisposeHandler(this);
+
+	    return false;
+	}
+
+	virtual void onLoopQuit(EventLoop &eventLoop) override
+	{
+	    eventLoop.enqueueDisposeHandler(this);
+	}
+
+	// Returns false once the peer has closed the connection
+	bool pump()
+	{
+	    for (;;)
+	    {
+		while (pendingOffset < pendingLength)
+		{
+		    int sent = socket.send(buffer.data() + pendingOffset, pendingLength - pendingOffset);
+
+		    if (!sent)
+			return true;
+
+		    pendingOffset += static_cast<size_t>(sent);
+		}
+
+		if (!buffer)
+		    buffer = bufferCache.acquire(16384U);
+
+		int received = socket.receive(buffer.data(), buffer.size());
+
+		if (received <= 0)
+		{
+		    buffer.release();
+
+		    return received < 0;
+		}
+
+		pendingOffset = 0U;
+		pendingLength = static_cast<size_t>(received);
+	    }
+	}
+
+    public:
+	EchoConnection(Library &socketLib, Socket &&acceptedSocket, atomic<unsigned> &connectionCount, BufferPool::Cache &bufferCache, bool noDelay)
+	    : socket(std::move(acceptedSocket)), event(socketLib), connectionCount(connectionCount), bufferCache(bufferCache)
+	{
+	    socket.noDelay(noDelay);
+	    socket.selectEvents(event.handle(), FD_READ | FD_WRITE | FD_CLOSE);
+	}
+
+	virtual ~EchoConnection() override
+	{
+	    connectionCount--;
+	}
+    };
+
+    // Event loop thread for server connections, that receives accepted sockets from the acceptor
+    class ServerLoop: public EventLoop::EventHandler
+    {
+    protected:
+	Library &socketLib;
+	Options const &options;
+	BufferPool::Cache bufferCache;		// outlives the connections in the loop
+	EventLoop eventLoop;
+	Event inboxEvent;
+	mutex inboxMutex;
+	vector<SOCKET> inbox, arrived;
+	StopTimer stopTimer { serverStopping };
+	ReportException reportException;
+	thread loopThread;
+
+	virtual EventHandle eventHandle() override
+	{
+	    return inboxEvent.handle();
+	}
+
+	virtual bool onEventTrigger(EventLoop &) override
+	{
+	    {
+		lock_guard<mutex> lock(inboxMutex);
+
+		inboxEvent.reset();
+		arrived.swap(inbox);
+	    }
+
+	    for (SOCKET hSocket: arrived)
+	    {
+		try
+		{
+		    EchoConnection *connection = new EchoConnection(socketLib, Socket(hSocket), connectionCount, bufferCache, options.noDelay);
+
+		    eventLoop.addEventHandler(*connection);
+		}
+		catch (netsocket::Exception const &)
+		{
+		    connectionCount--;
+		}
+	    }
+
+	    arrived.clear();
+
+	    return true;
+	}
+
+	void run()
+	{
+	    eventLoop.addEventHandler(*this);
+	    eventLoop.addTimerHandler(stopTimer);
+
+	    if (options.busyPollUs)
+		eventLoop.busyPoll(options.busyPollUs);
+
+	    eventLoop.runLoop(&reportException);
+	}
+
+    public:
+	atomic<unsigned> connectionCount { 0U };
+
+	void post(Socket &&acceptedSocket)
+	{
+	    connectionCount++;
+
+	    lock_guard<mutex> lock(inboxMutex);
+
+	    inbox.push_back(acceptedSocket.release());
+	    inboxEvent.set();
+	}
+
+	void join()
+	{
+	    loopThread.join();
+	}
+
+	ServerLoop(Library &socketLib, Options const &options, BufferPool &bufferPool)
+	    : socketLib(socketLib), options(options), bufferCache(bufferPool), eventLoop(socketLib), inboxEvent(socketLib)
+	{
+	    loopThread = thread([this]() { run(); });
+	}
+    };
+
+    class EchoServer: public EventLoop::EventHandler
+    {
+    protected:
+	Library &socketLib;
+	Options const &options;
+	Socket listener;
+	Event acceptEvent;
+	BufferPool bufferPool;
+	vector<unique_ptr<ServerLoop>> serverLoops;
+
+	virtual EventHandle eventHandle() override
+	{
+	    return acceptEvent.handle();
+	}
+
+	virtual bool onEventTrigger(EventLoop &) override
+	{
+	    listener.networkEvents(acceptEvent.handle());
+
+	    while (Socket acceptedSocket = listener.accept())
+	    {
+		ServerLoop *serverLoop = nullptr;
+
+		// one event is taken by the server loop inbox
+		for (auto &candidate: serverLoops)
+		    if (candidate->connectionCount.load() < WSA_MAXIMUM_WAIT_EVENTS - 1U)
+		    {
+			serverLoop = candidate.get();
+			break;
+		    }
+
+		if (!serverLoop)
+		{
+		    serverLoops.push_back(std::make_unique<ServerLoop>(socketLib, options, bufferPool));
+		    serverLoop = serverLoops.back().get();
+		}
+
+		serverLoop->post(std::move(acceptedSocket));
+	    }
+
+	    return true;
+	}
+
+    public:
+	unsigned short port() const
+	{
+	    sockaddr_storage address;
+	    listener.localAddress(address);
+
+	    return ntohs(static_cast<sockaddr_in *>(static_cast<void *>(&address))->sin_port);
+	}
+
+	size_t loopCount() const
+	{
+	    return serverLoops.size();
+	}
+
+	void run()
+	{
+	    EventLoop eventLoop(socketLib);
+	    StopTimer stopTimer(serverStopping);
+	    ReportException reportException;
+
+	    eventLoop.addEventHandler(*this);
+	    eventLoop.addTimerHandler(stopTimer);
+	    eventLoop.runLoop(&reportException);
+
+	    for (auto &serverLoop: serverLoops)
+		serverLoop->join();
+	}
+
+	EchoServer(Library &socketLib, Options const &options, sockaddr_in const &address)
+	    : socketLib(socketLib), options(options), listener(socketLib, AF_INET), acceptEvent(socketLib)
+	{
+	    listener.bind(static_cast<sockaddr const *>(static_cast<void const *>(&address)), static_cast<int>(sizeof address));
+	    listener.listen();
+	    listener.selectEvents(acceptEvent.handle(), FD_ACCEPT);
+	}
+    };
+
+    struct ClientStats
+    {
+	LatencyHistogram latencyTicks;
+	uint_least64_t messages = 0U, bytes = 0U, errors = 0U;
+    };
+
+    class ClientConnection: public EventLoop::EventHandler
+    {
+    protected:
+	Options const &options;
+	ClientStats &stats;
+	Socket socket;
+	Event event;
+	vector<char> outgoing;
+	size_t outgoingOffset = 0U;
+	size_t messageOffset = 0U;
+	unsigned char stamp[sizeof(int_least64_t)];
+	char buffer[16384];
+
+	virtual EventHandle eventHandle() override
+	{
+	    return event.handle();
+	}
+
+	virtual bool onEventTrigger(EventLoop &) override
+	{
+	    try
+	    {
+		WSANETWORKEVENTS networkEvents = socket.networkEvents(event.handle());
+
+		if (networkEvents.lNetworkEvents & FD_CONNECT)
+		{
+		    if (networkEvents.iErrorCode[FD_CONNECT_BIT])
+		    {
+			stats.errors++;
+			return false;
+		    }
+
+		    for (unsigned count = 0U; count < options.pipeline; count++)
+			queueMessage();
+		}
+
+		int received;
+
+		while ((received = socket.receive(buffer, sizeof buffer)) > 0)
+		    consume(buffer, static_cast<size_t>(received));
+
+		flush();
+
+		if (!received || networkEvents.lNetworkEvents & FD_CLOSE)
+		    return false;
+
+		return true;
+	    }
+	    catch (netsocket::Exception const &)
+	    {
+		stats.errors++;
+	    }
+
+	    return false;
+	}
+
+	void queueMessage()
+	{
+	    if (outgoingOffset == outgoing.size())
+	    {
+		outgoing.clear();
+		outgoingOffset = 0U;
+	    }
+
+	    size_t messageStart = outgoing.size();
+	    int_least64_t sendTicks = ticks();
+
+	    outgoing.resize(messageStart + options.messageSize, 'x');
+	    std::memcpy(outgoing.data() + messageStart, &sendTicks, sizeof sendTicks);
+	}
+
+	void flush()
+	{
+	    while (outgoingOffset < outgoing.size())
+	    {
+		int sent = socket.send(outgoing.data() + outgoingOffset, outgoing.size() - outgoingOffset);
+
+		if (!sent)
+		    break;
+
+		outgoingOffset += static_cast<size_t>(sent);
+	    }
+	}
+
+	void consume(char const *data, size_t length)
+	{
+	    while (length)
+	    {
+		size_t chunk = min(length, options.messageSize - messageOffset);
+
+		if (messageOffset < sizeof stamp)
+		    std::memcpy(stamp + messageOffset, data, min(chunk, sizeof stamp - messageOffset));
+
+		messageOffset += chunk;
+		data += chunk;
+		length -= chunk;
+
+		if (messageOffset == options.messageSize)
+		{
+		    int_least64_t sendTicks;
+
+		    std::memcpy(&sendTicks, stamp, sizeof sendTicks);
+		    messageOffset = 0U;
+
+		    if (recording.load(std::memory_order_relaxed))
+		    {
+			stats.latencyTicks.record(static_cast<uint_least64_t>(ticks() - sendTicks));
+			stats.messages++;
+			stats.bytes += options.messageSize;
+		    }
+
+		    if (!clientStopping.load(std::memory_order_relaxed))
+			queueMessage();
+		}
+	    }
+	}
+
+    public:
+	ClientConnection(Library &socketLib, Options const &options, ClientStats &stats, sockaddr_in const &address)
+	    : options(options), stats(stats), socket(socketLib, AF_INET), event(socketLib)
+	{
+	    socket.noDelay(options.noDelay);
+	    socket.selectEvents(event.handle(), FD_CONNECT | FD_READ | FD_WRITE | FD_CLOSE);
+	    socket.connect(static_cast<sockaddr const *>(static_cast<void const *>(&address)), static_cast<int>(sizeof address));
+	}
+    };
+
+    class ClientLoop
+    {
+    protected:
+	Library &socketLib;
+	Options const &options;
+	sockaddr_in address;
+	unsigned connectionCount;
+	thread loopThread;
+
+	void run()
+	{
+	    EventLoop eventLoop(socketLib);
+	    StopTimer stopTimer(clientStopping);
+	    ReportException reportException;
+	    vector<unique_ptr<ClientConnection>> connections;
+
+	    for (unsigned count = 0U; count < connectionCount; count++)
+	    {
+		connections.push_back(std::make_unique<ClientConnection>(socketLib, options, stats, address));
+		eventLoop.addEventHandler(*connections.back());
+	    }
+
+	    eventLoop.addTimerHandler(stopTimer);
+
+	    if (options.busyPollUs)
+		eventLoop.busyPoll(options.busyPollUs);
+
+	    eventLoop.runLoop(&reportException);
+	}
+
+    public:
+	ClientStats stats;
+
+	void join()
+	{
+	    loopThread.join();
+	}
+
+	ClientLoop(Library &socketLib, Options const &options, sockaddr_in const &address, unsigned connectionCount)
+	    : socketLib(socketLib), options(options), address(address), connectionCount(connectionCount)
+	{
+	    loopThread = thread([this]() { run(); });
+	}
+    };
+
+    string ringName(char const *kind, unsigned index)
+    {
+	return "Local\\netsocket-bench-" + std::to_string(::GetCurrentProcessId()) + "-" + kind + "-" + std::to_string(index);
+    }
+
+    // Room for all the messages that can be in flight, with space left for the padding at the end
+    // of the ring
+    size_t ringCapacity(Options const &options, unsigned streamCount)
+    {
+	size_t recordLength = (sizeof(uint_least64_t) + options.messageSize + 7U) & ~static_cast<size_t>(7U);
+
+	return max(SharedRing::minCapacity, 4U * recordLength * streamCount * options.pipeline);
+    }
+
+    // The client loop index follows the send time in each message
+    size_t const ringClientOffset = sizeof(int_least64_t);
+
+    void writeRing(SharedRing::Producer &producer, void const *message, size_t length)
+    {
+	while (!producer.tryWrite(message, length))
+	    std::this_thread::yield();
+    }
+
+    class RingEcho: public SharedRing::Consumer
+    {
+    protected:
+	vector<unique_ptr<SharedRing>> replyRings;
+	vector<SharedRing::Producer> replies;
+
+	virtual bool onMessage(EventLoop &, void const *message, size_t length) override
+	{
+	    uint_least32_t client;
+
+	    std::memcpy(&client, static_cast<char const *>(message) + ringClientOffset, sizeof client);
+
+	    if (client < replies.size())
+		writeRing(replies[client], message, length);
+
+	    return true;
+	}
+
+    public:
+	// The reply rings are opened by name, as from another process
+	RingEcho(Library &socketLib, SharedRing &requestRing, unsigned clientCount)
+	    : Consumer(requestRing)
+	{
+	    replies.reserve(clientCount);
+
+	    for (unsigned index = 0U; index < clientCount; index++)
+	    {
+		replyRings.push_back(std::make_unique<SharedRing>(socketLib, ringName("reply", index).c_str()));
+		replies.emplace_back(*replyRings.back());
+	    }
+	}
+    };
+
+    class RingServer
+    {
+    protected:
+	Library &socketLib;
+	Options const &options;
+	SharedRing requestRing;
+	thread loopThread;
+
+	void run(unsigned clientCount)
+	{
+	    EventLoop eventLoop(socketLib);
+	    StopTimer stopTimer(serverStopping);
+	    ReportException reportException;
+	    RingEcho ringEcho(socketLib, requestRing, clientCount);
+
+	    eventLoop.addEventHandler(ringEcho);
+	    eventLoop.addTimerHandler(stopTimer);
+
+	    if (options.busyPollUs)
+		eventLoop.busyPoll(options.busyPollUs);
+
+	    eventLoop.runLoop(&reportException);
+	}
+
+    public:
+	// Once the client loops have created their reply rings
+	void start(unsigned clientCount)
+	{
+	    loopThread = thread([this, clientCount]() { run(clientCount); });
+	}
+
+	void join()
+	{
+	    loopThread.join();
+	}
+
+	RingServer(Library &socketLib, Options const &options)
+	    : socketLib(socketLib), options(options), requestRing(socketLib, ringName("request", 0U).c_str(), ringCapacity(options, options.connections))
+	{
+	}
+    };
+
+    class RingClient: public SharedRing::Consumer
+    {
+    protected:
+	Options const &options;
+	ClientStats &stats;
+	SharedRing::Producer requests;
+	vector<char> outgoing;
+
+	virtual bool onMessage(EventLoop &, void const *message, size_t) override
+	{
+	    int_least64_t sendTicks;
+
+	    std::memcpy(&sendTicks, message, sizeof sendTicks);
+
+	    if (recording.load(std::memory_order_relaxed))
+	    {
+		stats.latencyTicks.record(static_cast<uint_least64_t>(ticks() - sendTicks));
+		stats.messages++;
+		stats.bytes += options.messageSize;
+	    }
+
+	    if (!clientStopping.load(std::memory_order_relaxed))
+		send();
+
+	    return true;
+	}
+
+    public:
+	void send()
+	{
+	    int_least64_t sendTicks = ticks();
+
+	    std::memcpy(outgoing.data(), &sendTicks, sizeof sendTicks);
+	    writeRing(requests, outgoing.data(), outgoing.size());
+	}
+
+	RingClient(Options const &options, ClientStats &stats, SharedRing &replyRing, SharedRing &requestRing, uint_least32_t clientIndex)
+	    : Consumer(replyRing), options(options), stats(stats), requests(requestRing), outgoing(options.messageSize, 'x')
+	{
+	    std::memcpy(outgoing.data() + ringClientOffset, &clientIndex, sizeof clientIndex);
+	}
+    };
+
+    class RingClientLoop
+    {
+    protected:
+	Library &socketLib;
+	Options const &options;
+	unsigned clientIndex, streamCount;
+	SharedRing replyRing, requestRing;
+	thread loopThread;
+
+	void run()
+	{
+	    EventLoop eventLoop(socketLib);
+	    StopTimer stopTimer(clientStopping);
+	    ReportException reportException;
+	    RingClient ringClient(options, stats, replyRing, requestRing, clientIndex);
+
+	    eventLoop.addEventHandler(ringClient);
+	    eventLoop.addTimerHandler(stopTimer);
+
+	    if (options.busyPollUs)
+		eventLoop.busyPoll(options.busyPollUs);
+
+	    for (unsigned count = 0U; count < streamCount * options.pipeline; count++)
+		ringClient.send();
+
+	    eventLoop.runLoop(&reportException);
+	}
+
+    public:
+	ClientStats stats;
+
+	void join()
+	{
+	    loopThread.join();
+	}
+
+	RingClientLoop(Library &socketLib, Options const &options, unsigned clientIndex, unsigned streamCount)
+	    : socketLib(socketLib), options(options), clientIndex(clientIndex), streamCount(streamCount),
+		replyRing(socketLib, ringName("reply", clientIndex).c_str(), ringCapacity(options, streamCount)),
+		requestRing(socketLib, ringName("request", 0U).c_str())
+	{
+	    loopThread = thread([this]() { run(); });
+	}
+    };
+
+    bool parseOption(char const *arg, Options &options)
+    {
+	char const *value = std::strchr(arg, '=');
+	string name(arg, value ? static_cast<size_t>(value - arg) : std::strlen(arg));
+	unsigned long number = value ? std::strtoul(value + 1, nullptr, 10) : 0U;
+
+	if (name == "--mode" && value)
+	    options.mode = value + 1;
+	else if (name == "--transport" && value)
+	    options.transport = value + 1;
+	else if (name == "--host" && value)
+	    options.host = value + 1;
+	else if (name == "--port" && value)
+	    options.port = static_cast<unsigned short>(number);
+	else if (name == "--connections" && value)
+	    options.connections = static_cast<unsigned>(number);
+	else if (name == "--size" && value)
+	    options.messageSize = static_cast<unsigned>(number);
+	else if (name == "--pipeline" && value)
+	    options.pipeline = static_cast<unsigned>(number);
+	else if (name == "--seconds" && value)
+	    options.seconds = static_cast<unsigned>(number);
+	else if (name == "--warmup" && value)
+	    options.warmupSeconds = static_cast<unsigned>(number);
+	else if (name == "--client-threads" && value)
+	    options.clientThreads = static_cast<unsigned>(number);
+	else if (name == "--busy-poll" && value)
+	    options.busyPollUs = static_cast<unsigned>(number);
+	else if (name == "--delay" && !value)
+	    options.noDelay = false;
+	else
+	    return false;
+
+	return true;
+    }
+
+    void usage(char const *program)
+    {
+	std::fprintf
+	    (
+		stderr,
+		"Usage: %s [options]\n"
+		"    --mode=both|server|client  run the echo server, the load generator, or both (default both)\n"
+		"    --transport=tcp|ring       loopback TCP, or SharedRing with --mode=both (default tcp)\n"
+		"    --host=ADDRESS             IPv4 address to listen on or connect to (default 127.0.0.1)\n"
+		"    --port=N                   TCP port (default any free port with --mode=both)\n"
+		"    --connections=N            client connections (default 256)\n"
+		"    --size=BYTES               message size, at least 8, or 12 for ring (default 64)\n"
+		"    --pipeline=N               messages in flight per connection (default 1)\n"
+		"    --seconds=N                measurement time, or server run time, 0 to run forever (default 10)\n"
+		"    --warmup=N                 seconds before measuring (default 1)\n"
+		"    --client-threads=N         minimum client loop threads (default as needed, 64 connections each)\n"
+		"    --busy-poll=US             busy poll budget for all event loops (default 0, off)\n"
+		"    --delay                    leave Nagle's algorithm on\n",
+		program
+	    );
+    }
+
+    template <typename Loop>
+	void report(Options const &options, vector<unique_ptr<Loop>> const &clientLoops, double seconds)
+    {
+	ClientStats total;
+
+	for (auto const &clientLoop: clientLoops)
+	{
+	    total.latencyTicks.merge(clientLoop->stats.latencyTicks);
+	    total.messages += clientLoop->stats.messages;
+	    total.bytes += clientLoop->stats.bytes;
+	    total.errors += clientLoop->stats.errors;
+	}
+
+	double microsecondsPerTick = 1e6 / static_cast<double>(ticksPerSecond());
+
+	auto latencyUs = [&](double percent)
+	{
+	    return static_cast<double>(total.latencyTicks.percentile(percent)) * microsecondsPerTick;
+	};
+
+	std::printf
+	    (
+		"%s, connections %u, client threads %zu, message size %u, pipeline %u, busy poll %u us\n"
+		"messages %llu in %.2f s: %.0f msg/s, %.2f MiB/s echoed, %llu connection errors\n"
+		"latency us: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+		options.transport.c_str(), options.connections, clientLoops.size(), options.messageSize, options.pipeline, options.busyPollUs,
+		static_cast<unsigned long long>(total.messages), seconds,
+		static_cast<double>(total.messages) / seconds,
+		static_cast<double>(total.bytes) / seconds / (1024.0 * 1024.0),
+		static_cast<unsigned long long>(total.errors),
+		latencyUs(50.0), latencyUs(90.0), latencyUs(99.0), latencyUs(99.9),
+		static_cast<double>(total.latencyTicks.maximumValue()) * microsecondsPerTick
+	    );
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    Options options;
+
+    for (int index = 1; index < argc; index++)
+	if (!parseOption(argv[index], options))		// including --help
+	{
+	    usage(argv[0]);
+	    return 2;
+	}
+
+    bool
+	runServer = options.mode == "both" || options.mode == "server",
+	runClient = options.mode == "both" || options.mode == "client";
+
+    bool
+	tcp = options.transport == "tcp",
+	ring = options.transport == "ring" && options.mode == "both" && options.messageSize >= ringClientOffset + sizeof(uint_least32_t);
+
+    if ((!runServer && !runClient) || options.messageSize < sizeof(int_least64_t) || !options.pipeline || (!options.port && !runServer) || (!tcp && !ring))
+    {
+	usage(argv[0]);
+	return 2;
+    }
+
+    Library socketLib;
+
+    if (ring)
+    {
+	unsigned loopCount = max(options.clientThreads, (options.connections + WSA_MAXIMUM_WAIT_EVENTS - 1U) / WSA_MAXIMUM_WAIT_EVENTS);
+	RingServer server(socketLib, options);
+	vector<unique_ptr<RingClientLoop>> clientLoops;
+
+	for (unsigned index = 0U; index < loopCount; index++)
+	{
+	    unsigned streamCount = options.connections / loopCount + (index < options.connections % loopCount ? 1U : 0U);
+	    clientLoops.push_back(std::make_unique<RingClientLoop>(socketLib, options, index, streamCount));
+	}
+
+	server.start(loopCount);
+
+	std::this_thread::sleep_for(std::chrono::seconds(options.warmupSeconds));
+
+	int_least64_t startTicks = ticks();
+	recording = true;
+
+	std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+
+	recording = false;
+	int_least64_t endTicks = ticks();
+
+	clientStopping = true;
+
+	for (auto &clientLoop: clientLoops)
+	    clientLoop->join();
+
+	serverStopping = true;
+	server.join();
+
+	report(options, clientLoops, static_cast<double>(endTicks - startTicks) / static_cast<double>(ticksPerSecond()));
+
+	return 0;
+    }
+    sockaddr_in address { };
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+
+    if (::inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1)
+    {
+	std::fprintf(stderr, "Invalid IPv4 address %s\n", options.host.c_str());
+	return 2;
+    }
+
+    unique_ptr<EchoServer> server;
+    thread serverThread;
+
+    if (runServer)
+    {
+	server = std::make_unique<EchoServer>(socketLib, options, address);
+	address.sin_port = htons(server->port());
+	serverThread = thread([&server]() { server->run(); });
+
+	std::printf("echo server on %s:%u\n", options.host.c_str(), static_cast<unsigned>(server->port()));
+    }
+
+    if (runClient)
+    {
+	unsigned perLoop = WSA_MAXIMUM_WAIT_EVENTS;
+	unsigned loopCount = max(options.clientThreads, (options.connections + perLoop - 1U) / perLoop);
+	vector<unique_ptr<ClientLoop>> clientLoops;
+
+	for (unsigned index = 0U; index < loopCount; index++)
+	{
+	    unsigned connectionCount = options.connections / loopCount + (index < options.connections % loopCount ? 1U : 0U);
+	    clientLoops.push_back(std::make_unique<ClientLoop>(socketLib, options, address, connectionCount));
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(options.warmupSeconds));
+
+	int_least64_t startTicks = ticks();
+	recording = true;
+
+	std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+
+	recording = false;
+	int_least64_t endTicks = ticks();
+
+	clientStopping = true;
+
+	for (auto &clientLoop: clientLoops)
+	    clientLoop->join();
+
+	report(options, clientLoops, static_cast<double>(endTicks - startTicks) / static_cast<double>(ticksPerSecond()));
+    }
+    else
+	if (options.seconds)
+	    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+	else
+	    serverThread.join();		// runs until the process is stopped
+
+    if (runServer)
+    {
+	serverStopping = true;
+	serverThread.join();
+	std::printf("server loop threads %zu\n", server->loopCount());
+    }
+
+    return 0;
+}
+catch (exception const &ex)
+{
+    std::fprintf(stderr, "Error: %s\n", ex.what());
+    return 1;
+}
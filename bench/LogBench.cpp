@@ -0,0 +1,315 @@
+#define NOMINMAX
+#include <WinSock2.h>
+#include <Windows.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+#include "SocketError.hpp"
+#include "AsyncLog.hpp"
+
+using std::size_t;
+using std::uint_least64_t;
+using std::int_least64_t;
+using std::atomic;
+using std::thread;
+using std::unique_ptr;
+using std::string;
+using std::vector;
+using std::max;
+using std::exception;
+
+using netsocket::AsyncLog;
+
+// Caller-side cost of AsyncLog, against formatting and writing each record right away.
+//
+// Each thread logs a fixed number of records with a few arguments, and times them in batches, as
+// single calls are too short for the performance counter. The report gives the mean time per
+// call, and percentiles of the per-call time in each batch, with the records dropped.
+
+namespace
+{
+    struct Options
+    {
+	unsigned	threads = 4U;
+	unsigned	records = 1000000U;		// per thread
+	unsigned	batch = 16U;
+	size_t		ringCapacity = 1048576U;
+	string		file;				// empty to discard the output
+	bool		sync = false;
+    };
+
+    int_least64_t ticks() noexcept
+    {
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart;
+    }
+
+    int_least64_t ticksPerSecond() noexcept
+    {
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	return frequency.QuadPart;
+    }
+
+    class NullSink: public AsyncLog::Sink
+    {
+    public:
+	atomic<uint_least64_t> bytes { 0U };
+
+	virtual void write(char const *, size_t length) noexcept override
+	{
+	    bytes.fetch_add(length, std::memory_order_relaxed);
+	}
+    };
+
+    // Synchronous baseline: each call formats its line and writes it to the sink
+    class SyncLog
+    {
+    protected:
+	AsyncLog::Sink &sink;
+
+    public:
+	bool log(unsigned thread, unsigned record, char const *peer, double value) noexcept
+	{
+	    char line[160];
+	    int length = std::snprintf(line, sizeof line, "%12.6f INFO  %5u record %u from %s took %g ms\n",
+		    static_cast<double>(ticks()) / static_cast<double>(ticksPerSecond()), thread, record, peer, value);
+
+	    sink.write(line, static_cast<size_t>(max(length, 0)));
+
+	    return true;
+	}
+
+	SyncLog(AsyncLog::Sink &sink)
+	    : sink(sink)
+	{
+	}
+    };
+
+    struct ThreadStats
+    {
+	vector<uint_least64_t> batchTicks;
+	int_least64_t totalTicks = 0;
+	uint_least64_t dropped = 0U;
+    };
+
+    template <typename Log>
+	void runThread(Options const &options, Log &log, unsigned threadIndex, ThreadStats &stats)
+    {
+	static char const *const peers[] = { "10.0.0.1:443", "192.168.100.200:8080", "[2001:db8::1]:80" };
+
+	stats.batchTicks.reserve(options.records / options.batch + 1U);
+
+	int_least64_t startTicks = ticks();
+
+	for (unsigned record = 0U; record < options.records; record += options.batch)
+	{
+	    int_least64_t batchStart = ticks();
+
+	    for (unsigned index = record; index < record + options.batch && index < options.records; index++)
+		if (!log.log(threadIndex, index, peers[index % 3U], static_cast<double>(index % 1000U) * 0.001))
+		    stats.dropped++;
+
+	    stats.batchTicks.push_back(static_cast<uint_least64_t>(ticks() - batchStart));
+	}
+
+	stats.totalTicks = ticks() - startTicks;
+    }
+
+    // Adapts a producer to the call made by runThread()
+    class ProducerLog
+    {
+    protected:
+	AsyncLog::Producer producer;
+
+    public:
+	bool log(unsigned thread, unsigned record, char const *peer, double value) noexcept
+	{
+	    return producer.log(AsyncLog::Level::Info, "{} record {} from {} took {} ms", thread, record, peer, value);
+	}
+
+	ProducerLog(AsyncLog &asyncLog)
+	    : producer(asyncLog)
+	{
+	}
+    };
+
+    bool parseOption(char const *arg, Options &options)
+    {
+	char const *value = std::strchr(arg, '=');
+	string name(arg, value ? static_cast<size_t>(value - arg) : std::strlen(arg));
+	unsigned long number = value ? std::strtoul(value + 1, nullptr, 10) : 0U;
+
+	if (name == "--threads" && value)
+	    options.threads = static_cast<unsigned>(number);
+	else if (name == "--records" && value)
+	    options.records = static_cast<unsigned>(number);
+	else if (name == "--batch" && value)
+	    options.batch = static_cast<unsigned>(number);
+	else if (name == "--ring" && value)
+	    options.ringCapacity = static_cast<size_t>(number);
+	else if (name == "--file" && value)
+	    options.file = value + 1;
+	else if (name == "--sync" && !value)
+	    options.sync = true;
+	else
+	    return false;
+
+	return true;
+    }
+
+    void usage(char const *program)
+    {
+	std::fprintf
+	    (
+		stderr,
+		"Usage: %s [options]\n"
+		"    --threads=N                logging threads (default 4)\n"
+		"    --records=N                records logged by each thread (default 1000000)\n"
+		"    --batch=N                  calls timed together (default 16)\n"
+		"    --ring=BYTES               ring capacity for each thread (default 1048576)\n"
+		"    --file=PATH                append the log to a file, instead of discarding it\n"
+		"    --sync                     format and write each record in the calling thread, for comparison\n",
+		program
+	    );
+    }
+
+    void report(Options const &options, vector<ThreadStats> const &stats, AsyncLog::Statistics const *logStatistics)
+    {
+	vector<uint_least64_t> batchTicks;
+	int_least64_t totalTicks = 0;
+	uint_least64_t dropped = 0U, calls = static_cast<uint_least64_t>(options.threads) * options.records;
+
+	for (ThreadStats const &threadStats: stats)
+	{
+	    batchTicks.insert(batchTicks.end(), threadStats.batchTicks.begin(), threadStats.batchTicks.end());
+	    totalTicks += threadStats.totalTicks;
+	    dropped += threadStats.dropped;
+	}
+
+	std::sort(batchTicks.begin(), batchTicks.end());
+
+	double nanosecondsPerTick = 1e9 / static_cast<double>(ticksPerSecond());
+
+	auto callNs = [&](double percent)
+	{
+	    size_t index = std::min(batchTicks.size() - 1U, static_cast<size_t>(percent / 100.0 * static_cast<double>(batchTicks.size())));
+
+	    return static_cast<double>(batchTicks[index]) * nanosecondsPerTick / static_cast<double>(options.batch);
+	};
+
+	std::printf
+	    (
+		"%s, threads %u, records %u per thread, ring %zu bytes, %s\n"
+		"mean %.1f ns per call\n"
+		"per call in batches of %u, ns: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n"
+		"dropped %llu of %llu",
+		options.sync ? "synchronous" : "AsyncLog", options.threads, options.records, options.ringCapacity,
+		options.file.empty() ? "output discarded" : options.file.c_str(),
+		static_cast<double>(totalTicks) * nanosecondsPerTick / static_cast<double>(calls),
+		options.batch, callNs(50.0), callNs(90.0), callNs(99.0), callNs(99.9), callNs(100.0),
+		static_cast<unsigned long long>(dropped), static_cast<unsigned long long>(calls)
+	    );
+
+	if (logStatistics)
+	    std::printf(", written %llu", static_cast<unsigned long long>(logStatistics->written));
+
+	std::printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+try
+{
+    Options options;
+
+    for (int index = 1; index < argc; index++)
+	if (!parseOption(argv[index], options))		// including --help
+	{
+	    usage(argv[0]);
+	    return 2;
+	}
+
+    if (!options.threads || !options.records || !options.batch)
+    {
+	usage(argv[0]);
+	return 2;
+    }
+
+    NullSink nullSink;
+    unique_ptr<AsyncLog::FileSink> fileSink;
+
+    if (!options.file.empty())
+	fileSink = std::make_unique<AsyncLog::FileSink>(options.file.c_str());
+
+    AsyncLog::Sink &sink = fileSink ? static_cast<AsyncLog::Sink &>(*fileSink) : nullSink;
+    vector<ThreadStats> stats(options.threads);
+    vector<thread> threads;
+
+    if (options.sync)
+    {
+	SyncLog syncLog(sink);
+
+	for (unsigned index = 0U; index < options.threads; index++)
+	    threads.emplace_back([&, index]() { runThread(options, syncLog, index, stats[index]); });
+
+	for (thread &logThread: threads)
+	    logThread.join();
+
+	report(options, stats, nullptr);
+    }
+    else
+    {
+	AsyncLog::Settings settings;
+
+	settings.ringCapacity = options.ringCapacity;
+
+	AsyncLog asyncLog(sink, settings);
+
+	for (unsigned index = 0U; index < options.threads; index++)
+	    threads.emplace_back([&, index]()
+	    {
+		ProducerLog producerLog(asyncLog);
+
+		runThread(options, producerLog, index, stats[index]);
+	    });
+
+	for (thread &logThread: threads)
+	    logThread.join();
+
+	// wait for the writer to catch up
+	uint_least64_t logged = static_cast<uint_least64_t>(options.threads) * options.records;
+
+	AsyncLog::Statistics logStatistics = asyncLog.statistics();
+
+	while (logStatistics.written + logStatistics.dropped < logged)
+	{
+	    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	    logStatistics = asyncLog.statistics();
+	}
+
+	report(options, stats, &logStatistics);
+    }
+
+    return 0;
+}
+catch (exception const &ex)
+{
+    std::fprintf(stderr, "Error: %s\n", ex.what());
+    return 1;
+}